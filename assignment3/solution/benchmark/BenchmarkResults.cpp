@@ -0,0 +1,142 @@
+#include "BenchmarkResults.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "SIMD.hpp"
+#include "TileScheduler.h"
+
+namespace {
+	/**
+	  * Finds "key": in line, and returns the position of its value
+	  */
+	inline const char* findValue(const std::string& line, const char* key) {
+		std::string pattern = std::string("\"") + key + "\":";
+		std::string::size_type pos = line.find(pattern);
+		if (pos == std::string::npos) return NULL;
+		const char* value = line.c_str() + pos + pattern.size();
+		while (*value == ' ') ++value;
+		return value;
+	}
+
+	inline double readNumber(const std::string& line, const char* key) {
+		const char* value = findValue(line, key);
+		return value ? std::strtod(value, NULL) : 0.0;
+	}
+
+	inline std::string readString(const std::string& line, const char* key) {
+		const char* value = findValue(line, key);
+		if (!value || *value != '"') return "";
+		const char* end = std::strchr(value+1, '"');
+		return end ? std::string(value+1, end) : "";
+	}
+}
+
+std::string BenchmarkResult::getName() const {
+	std::stringstream name;
+	name << scene << " " << width << "x" << height << " " << threads << (threads == 1 ? " thread" : " threads");
+	return name.str();
+}
+
+void BenchmarkResults::save(const std::string& filename, const std::vector<BenchmarkResult>& results) {
+	std::ofstream file(filename.c_str());
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to open " << filename << " for writing";
+		throw std::runtime_error(log.str());
+	}
+
+	file << "{" << std::endl;
+	file << "\t\"simd_width\": " << simd::width << "," << std::endl;
+	file << "\t\"hardware_threads\": " << TileScheduler::getThreadCount(0) << "," << std::endl;
+	file << "\t\"results\": [" << std::endl;
+	for (unsigned int k=0; k<results.size(); ++k) {
+		const BenchmarkResult& r = results[k];
+		file << "\t\t{\"scene\": \"" << r.scene << "\", \"width\": " << r.width << ", \"height\": " << r.height
+			<< ", \"threads\": " << r.threads << std::setprecision(6)
+			<< ", \"seconds\": " << r.seconds << ", \"first_tile_seconds\": " << r.first_tile_seconds
+			<< ", \"primary_rays_per_second\": " << r.primary_rays_per_second
+			<< ", \"secondary_rays_per_second\": " << r.secondary_rays_per_second
+			<< ", \"scaling_efficiency\": " << r.scaling_efficiency
+			<< ", \"memory_mb\": " << r.memory_mb << "}"
+			<< (k+1 < results.size() ? "," : "") << std::endl;
+	}
+	file << "\t]" << std::endl;
+	file << "}" << std::endl;
+
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to write " << filename;
+		throw std::runtime_error(log.str());
+	}
+}
+
+std::vector<BenchmarkResult> BenchmarkResults::load(const std::string& filename) {
+	std::ifstream file(filename.c_str());
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to open " << filename;
+		throw std::runtime_error(log.str());
+	}
+
+	std::vector<BenchmarkResult> results;
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!findValue(line, "scene")) continue;
+		BenchmarkResult r;
+		r.scene = readString(line, "scene");
+		r.width = static_cast<unsigned int>(readNumber(line, "width"));
+		r.height = static_cast<unsigned int>(readNumber(line, "height"));
+		r.threads = static_cast<unsigned int>(readNumber(line, "threads"));
+		r.seconds = readNumber(line, "seconds");
+		r.first_tile_seconds = readNumber(line, "first_tile_seconds");
+		r.primary_rays_per_second = readNumber(line, "primary_rays_per_second");
+		r.secondary_rays_per_second = readNumber(line, "secondary_rays_per_second");
+		r.scaling_efficiency = readNumber(line, "scaling_efficiency");
+		r.memory_mb = readNumber(line, "memory_mb");
+		results.push_back(r);
+	}
+	return results;
+}
+
+unsigned int BenchmarkResults::compare(const std::vector<BenchmarkResult>& baseline,
+		const std::vector<BenchmarkResult>& current, double tolerance, std::ostream& out) {
+	unsigned int regressions = 0;
+
+	for (unsigned int k=0; k<current.size(); ++k) {
+		const BenchmarkResult& now = current[k];
+		const std::string name = now.getName();
+		const BenchmarkResult* before = NULL;
+		for (unsigned int b=0; b<baseline.size() && !before; ++b) {
+			if (baseline[b].getName() == name) before = &baseline[b];
+		}
+		if (!before) {
+			out << std::setw(36) << std::left << name << "  not in baseline" << std::endl;
+			continue;
+		}
+
+		//Rays per second covers both primary and secondary rays, so a change in shading shows up too
+		double rate_before = before->primary_rays_per_second + before->secondary_rays_per_second;
+		double rate_now = now.primary_rays_per_second + now.secondary_rays_per_second;
+		double change = (rate_before > 0.0) ? rate_now/rate_before - 1.0 : 0.0;
+		bool regressed = change < -tolerance;
+
+		//Baselines without the memory of every run have 0
+		double growth = now.memory_mb - before->memory_mb;
+		bool memory_regressed = before->memory_mb > 0.0 && growth > 1.0 && growth > tolerance*before->memory_mb;
+		if (regressed || memory_regressed) ++regressions;
+
+		out << std::setw(36) << std::left << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(8) << 100.0*change << "% rays/s"
+			<< std::setw(8) << 1000.0*before->first_tile_seconds << " -> " << 1000.0*now.first_tile_seconds << " ms first tile"
+			<< std::setw(8) << before->memory_mb << " -> " << now.memory_mb << " MB"
+			<< (regressed ? "  REGRESSION" : "") << (memory_regressed ? "  MEMORY REGRESSION" : "") << std::endl;
+		out.unsetf(std::ios::fixed);
+	}
+
+	return regressions;
+}
@@ -0,0 +1,59 @@
+#ifndef _BENCHMARKRESULTS_H__
+#define _BENCHMARKRESULTS_H__
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+/**
+  * Result of rendering one benchmark scene at one resolution and thread count
+  */
+struct BenchmarkResult {
+	BenchmarkResult() : width(0), height(0), threads(0), seconds(0.0), first_tile_seconds(0.0),
+		primary_rays_per_second(0.0), secondary_rays_per_second(0.0), scaling_efficiency(0.0), memory_mb(0.0) {}
+
+	/**
+	  * Returns what identifies the run across result files, e.g. "bunny 512x512 4 threads"
+	  */
+	std::string getName() const;
+
+	std::string scene;
+	unsigned int width, height;
+	unsigned int threads;
+	double seconds; //< Best wall time of the repetitions
+	double first_tile_seconds;
+	double primary_rays_per_second;
+	double secondary_rays_per_second;
+	double scaling_efficiency; //< Speedup over one thread, divided by the number of threads
+	double memory_mb; //< Resident memory the scene and renderer take after the run, 0 if unknown
+};
+
+/**
+  * Reading, writing and comparing benchmark results. Results are stored as
+  * JSON with one result object per line, which is all load() understands:
+  * it reads files written by save(), not arbitrary JSON.
+  */
+class BenchmarkResults {
+public:
+	/**
+	  * Writes results to filename, throwing on failure
+	  */
+	static void save(const std::string& filename, const std::vector<BenchmarkResult>& results);
+
+	/**
+	  * Reads the results of a file written by save(), throwing on failure
+	  */
+	static std::vector<BenchmarkResult> load(const std::string& filename);
+
+	/**
+	  * Prints the change of every result in current that is also in baseline.
+	  * A result regressed if it traces more than tolerance (e.g. 0.05 for 5%)
+	  * fewer rays per second than the baseline, or takes more than tolerance
+	  * more memory (and at least a megabyte, below which it is noise).
+	  * @return The number of regressions
+	  */
+	static unsigned int compare(const std::vector<BenchmarkResult>& baseline,
+		const std::vector<BenchmarkResult>& current, double tolerance, std::ostream& out);
+};
+
+#endif
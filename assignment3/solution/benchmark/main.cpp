@@ -0,0 +1,236 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+#include "RayTracer.h"
+#include "SphereBatch.hpp"
+#include "CubeMap.hpp"
+#include "Model.h"
+#include "BenchmarkResults.h"
+
+namespace {
+	/**
+	  * Returns the current resident memory of the process in megabytes. Unlike
+	  * the peak, it drops again when a scene is freed, so the difference over
+	  * loading and rendering a scene is the memory that scene takes.
+	  */
+	double getResidentMemory() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0.0;
+		return counters.WorkingSetSize/(1024.0*1024.0);
+#elif defined(__APPLE__)
+		mach_task_basic_info_data_t info;
+		mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+		if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) return 0.0;
+		return info.resident_size/(1024.0*1024.0);
+#else
+		//The second field of statm is the number of resident pages
+		unsigned long size = 0, resident = 0;
+		std::FILE* statm = std::fopen("/proc/self/statm", "r");
+		if (!statm) return 0.0;
+		int n = std::fscanf(statm, "%lu %lu", &size, &resident);
+		std::fclose(statm);
+		return (n == 2) ? resident*static_cast<double>(sysconf(_SC_PAGESIZE))/(1024.0*1024.0) : 0.0;
+#endif
+	}
+
+	/**
+	  * A benchmark scene: a fixed set of objects, loaded before and shared by all its runs
+	  */
+	struct Scene {
+		std::string name;
+		std::vector<std::shared_ptr<SceneObject> > objects;
+	};
+
+	std::shared_ptr<SceneObject> loadCubeMap() {
+		return std::shared_ptr<SceneObject>(new CubeMap(
+			"cubemaps/SaintLazarusChurch3/posx.jpg", "cubemaps/SaintLazarusChurch3/negx.jpg",
+			"cubemaps/SaintLazarusChurch3/posy.jpg", "cubemaps/SaintLazarusChurch3/negy.jpg",
+			"cubemaps/SaintLazarusChurch3/posz.jpg", "cubemaps/SaintLazarusChurch3/negz.jpg",
+			"cubemaps"));
+	}
+
+	const char* scene_names[] = { "spheres", "cubemap_fresnel", "teapot", "dragon_10k", "bunny" };
+	const unsigned int n_scenes = sizeof(scene_names)/sizeof(scene_names[0]);
+
+	/**
+	  * Builds scene k of the benchmark matrix. Nothing in it is random,
+	  * so every run traces exactly the same rays.
+	  */
+	Scene loadScene(unsigned int k) {
+		std::shared_ptr<SceneObjectEffect> fresnel(new FresnelEffect());
+		std::shared_ptr<SceneObjectEffect> steel(new SteelEffect());
+		std::shared_ptr<SceneObjectEffect> phong(new PhongEffect(glm::vec3(0.0f, 10.0f, 10.0f)));
+		Scene scene;
+		scene.name = scene_names[k];
+
+		if (k == 0) {
+			//Spheres only: a grid of diffuse and reflective spheres against the background color
+			std::shared_ptr<SphereBatch> grid(new SphereBatch());
+			for (int y=-2; y<=2; ++y) {
+				for (int x=-2; x<=2; ++x) {
+					grid->addSphere(glm::vec3(2.5f*x, 2.5f*y, -2.0f*((x+y)&1)), 1.0f, ((x+y)&1) ? steel : phong);
+				}
+			}
+			scene.objects.push_back(grid);
+		}
+		else if (k == 1) {
+			//The scene of the ray tracer itself: reflection and refraction of the environment map
+			std::shared_ptr<SphereBatch> batch(new SphereBatch());
+			batch->addSphere(glm::vec3(0.0f, 0.0f, 0.0f), 3.0f, fresnel);
+			batch->addSphere(glm::vec3(-3.5f, 3.5f, -3.0f), 2.0f, steel);
+			batch->addSphere(glm::vec3(3.5f, -3.5f, 3.0f), 2.5f, steel);
+			batch->addSphere(glm::vec3(-4.0f, -2.0f, 6.0f), 2.5f, steel);
+			batch->addSphere(glm::vec3(4.0f, 2.0f, 9.0f), 2.5f, steel);
+			scene.objects.push_back(loadCubeMap());
+			scene.objects.push_back(batch);
+		}
+		else {
+			//Meshes of increasing size, reflecting the environment map
+			scene.objects.push_back(loadCubeMap());
+			scene.objects.push_back(std::shared_ptr<SceneObject>(new Model(std::string("models/") + scene.name + ".obj",
+				glm::vec3(0.0f), 4.0f, steel)));
+		}
+		return scene;
+	}
+
+	/**
+	  * Renders scene repeat times, and returns the fastest run
+	  * @param base_memory Resident memory before the scene was loaded
+	  */
+	BenchmarkResult run(Scene& scene, unsigned int size, unsigned int threads, unsigned int repeat, double base_memory) {
+		RayTracer rt(size, size);
+		rt.setVerbose(false);
+		rt.setThreadCount(threads);
+		for (unsigned int k=0; k<scene.objects.size(); ++k) {
+			rt.addSceneObject(scene.objects[k]);
+		}
+
+		BenchmarkResult result;
+		result.scene = scene.name;
+		result.width = size;
+		result.height = size;
+		result.threads = threads;
+		for (unsigned int r=0; r<repeat; ++r) {
+			rt.render();
+			const RayTracer::Statistics& stats = rt.getStatistics();
+			if (r == 0 || stats.seconds < result.seconds) {
+				result.seconds = stats.seconds;
+				result.first_tile_seconds = stats.first_tile_seconds;
+				result.primary_rays_per_second = stats.primary_rays/stats.seconds;
+				result.secondary_rays_per_second = stats.secondary_rays/stats.seconds;
+			}
+		}
+		//While the scene and the framebuffer are still held
+		result.memory_mb = getResidentMemory() - base_memory;
+		return result;
+	}
+
+	void printUsage() {
+		std::cout << "Usage: benchmark [--output results.json] [--repeat n] [--threads max]" << std::endl
+			<< "                 [--compare baseline.json [--input results.json] [--tolerance 0.05]]" << std::endl
+			<< "Renders every scene at every resolution with 1, 2, 4, ... threads, and writes the" << std::endl
+			<< "results as JSON. With --compare, the results (or those of --input, without" << std::endl
+			<< "rendering) are compared to the baseline, exiting with 1 if any regressed." << std::endl;
+	}
+}
+
+/**
+  * Benchmarks the ray tracer on a fixed matrix of scenes, resolutions and thread counts
+  */
+int main(int argc, char *argv[]) {
+	try {
+		std::string output = "benchmark.json";
+		std::string baseline;
+		std::string input;
+		double tolerance = 0.05;
+		unsigned int repeat = 3;
+		unsigned int max_threads = TileScheduler::getThreadCount(0);
+
+		for (int i=1; i<argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--help" || i+1 >= argc) {
+				printUsage();
+				return (arg == "--help") ? 0 : -1;
+			}
+			if (arg == "--output") output = argv[++i];
+			else if (arg == "--compare") baseline = argv[++i];
+			else if (arg == "--input") input = argv[++i];
+			else if (arg == "--tolerance") tolerance = std::atof(argv[++i]);
+			else if (arg == "--repeat") repeat = std::max(std::atoi(argv[++i]), 1);
+			else if (arg == "--threads") max_threads = std::max(std::atoi(argv[++i]), 1);
+			else {
+				printUsage();
+				return -1;
+			}
+		}
+
+		std::vector<BenchmarkResult> results;
+		if (!input.empty()) {
+			results = BenchmarkResults::load(input);
+		}
+		else {
+			const unsigned int sizes[] = { 256, 512 };
+			std::vector<unsigned int> thread_counts;
+			for (unsigned int t=1; t<max_threads; t*=2) thread_counts.push_back(t);
+			thread_counts.push_back(max_threads);
+
+			std::cout << std::setw(36) << std::left << "run" << std::right
+				<< std::setw(12) << "primary/s" << std::setw(12) << "second./s" << std::setw(12) << "first tile"
+				<< std::setw(12) << "efficiency" << std::setw(12) << "memory MB" << std::endl;
+			for (unsigned int s=0; s<n_scenes; ++s) {
+				//Every scene is loaded just before its runs, and freed after them
+				const double base_memory = getResidentMemory();
+				Scene scene = loadScene(s);
+				for (unsigned int k=0; k<2; ++k) {
+					double single_thread_rate = 0.0;
+					for (unsigned int t=0; t<thread_counts.size(); ++t) {
+						BenchmarkResult result = run(scene, sizes[k], thread_counts[t], repeat, base_memory);
+						double rate = result.primary_rays_per_second + result.secondary_rays_per_second;
+						if (t == 0) single_thread_rate = rate;
+						result.scaling_efficiency = (single_thread_rate > 0.0) ? rate/(single_thread_rate*result.threads) : 0.0;
+						results.push_back(result);
+
+						std::cout << std::setw(36) << std::left << result.getName() << std::right
+							<< std::setprecision(3) << std::setw(12) << result.primary_rays_per_second
+							<< std::setw(12) << result.secondary_rays_per_second
+							<< std::setw(10) << 1000.0*result.first_tile_seconds << "ms"
+							<< std::setw(12) << result.scaling_efficiency
+							<< std::setw(12) << result.memory_mb << std::endl;
+					}
+				}
+			}
+
+			BenchmarkResults::save(output, results);
+			std::cout << "Saved " << output << std::endl;
+		}
+
+		if (!baseline.empty()) {
+			unsigned int regressions = BenchmarkResults::compare(BenchmarkResults::load(baseline), results, tolerance, std::cout);
+			std::cout << regressions << " regressions against " << baseline << std::endl;
+			if (regressions > 0) return 1;
+		}
+	} catch (std::exception &e) {
+		std::string err = e.what();
+		std::cout << err.c_str() << std::endl;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,321 @@
+#ifndef _BVH_H__
+#define _BVH_H__
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+
+/**
+  * Axis aligned bounding box
+  */
+struct AABB {
+	AABB() {
+		min = glm::vec3(std::numeric_limits<float>::max());
+		max = glm::vec3(-std::numeric_limits<float>::max());
+	}
+
+	inline void extend(const glm::vec3& p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	inline void extend(const AABB& b) {
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
+	}
+
+	inline glm::vec3 center() const {
+		return 0.5f*(min+max);
+	}
+
+	inline float surfaceArea() const {
+		glm::vec3 d = max-min;
+		if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f) return 0.0f;
+		return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+/**
+  * Bounding volume hierarchy built using the surface area heuristic (SAH).
+  * The BVH only knows the bounding boxes of the primitives: after build(),
+  * getIndices() gives the order the owner should store its primitives in,
+  * so that every leaf references a contiguous range [offset, offset+count).
+  * Nodes are stored depth first in one flat array: the first child of an
+  * inner node always directly follows its parent, and offset is the index
+  * of the second child. The nodes either belong to the BVH (build()), or
+  * live in memory owned by someone else, e.g. a mapped cache file (attach()).
+  */
+class BVH {
+public:
+	struct Node {
+		glm::vec3 min;
+		unsigned int offset; //< First primitive for leaves, second child for inner nodes
+		glm::vec3 max;
+		unsigned short count; //< Number of primitives, 0 for inner nodes
+		unsigned short axis; //< Split axis, used to visit the nearest child first
+	};
+
+	BVH() {
+		node_data = NULL;
+		node_count = 0;
+	}
+
+	/**
+	  * Builds the hierarchy from the bounding boxes of the primitives
+	  * @param bounds Bounding box of every primitive
+	  * @param max_leaf_size Leaves with this many primitives or less are never split
+	  * @param leaf_alignment The offset of every leaf is a multiple of this,
+	  * so that leaves can start at, e.g., a block of simd::width primitives
+	  */
+	void build(const std::vector<AABB>& bounds, unsigned int max_leaf_size=4, unsigned int leaf_alignment=1);
+
+	/**
+	  * Updates the boxes of all nodes after primitives moved, keeping the tree
+	  * itself. This is far cheaper than build(), but the tree gets worse the
+	  * further primitives move from where they were when it was built: compare
+	  * getCost() to its value after build() to decide when to rebuild.
+	  * @param bounds Bounding box of every primitive, in the order of getIndices()
+	  * (boxes at padding are ignored)
+	  */
+	void refit(const std::vector<AABB>& bounds);
+
+	/**
+	  * Returns the expected cost of tracing a ray through the tree by the
+	  * surface area heuristic, in units of primitive intersections
+	  */
+	float getCost() const;
+
+	/**
+	  * Index in getIndices() of the gaps between aligned leaves
+	  */
+	static const unsigned int padding = 0xFFFFFFFF;
+
+	/**
+	  * Returns the primitive order that the leaves reference. If leaves are
+	  * aligned, the gaps between them hold padding.
+	  */
+	inline const std::vector<unsigned int>& getIndices() const { return indices; }
+
+	/**
+	  * Uses count nodes stored elsewhere, see getNodes(). The memory must
+	  * outlive the BVH. The primitive order is not known, so getIndices() is empty.
+	  */
+	void attach(const Node* nodes, unsigned int count);
+
+	inline const Node* getNodes() const { return node_data; }
+	inline unsigned int getNodeCount() const { return node_count; }
+
+	inline AABB getBounds() const {
+		AABB b;
+		if (node_count > 0) {
+			b.min = node_data[0].min;
+			b.max = node_data[0].max;
+		}
+		return b;
+	}
+
+	/**
+	  * Traverses the hierarchy front to back. For every leaf hit,
+	  * intersector(offset, count, t_max) is called, and should return true and
+	  * decrease t_max if it finds a closer intersection.
+	  * @return true if any leaf reported an intersection
+	  */
+	template <class Intersector>
+	bool intersect(const Ray& r, float& t_max, Intersector& intersector) const;
+
+	/**
+	  * Traverses the hierarchy until any leaf reports an intersection, for
+	  * shadow rays. For every leaf hit, intersector(offset, count, t_max) is
+	  * called, and should return true if any primitive is hit before t_max.
+	  * @return true if a leaf reported an intersection
+	  */
+	template <class Intersector>
+	bool occluded(const Ray& r, float t_max, Intersector& intersector) const;
+
+	/**
+	  * Traverses the hierarchy with a packet of coherent rays. A node is visited
+	  * if any active ray hits it, and the children are ordered using the
+	  * direction of the first active ray. For every leaf hit,
+	  * intersector(offset, count, mask, t_max) is called with the lanes that hit
+	  * the leaf in mask, and should lower t_max in lanes with closer intersections.
+	  */
+	template <class Intersector>
+	void intersect(const RayPacket& packet, simd::vfloat& t_max, Intersector& intersector) const;
+
+private:
+	BVH(const BVH&);
+	BVH& operator=(const BVH&);
+
+	struct BuildPrimitive {
+		AABB bounds;
+		glm::vec3 center;
+	};
+
+	void buildRecursive(std::vector<BuildPrimitive>& prims, unsigned int first, unsigned int count, unsigned int depth);
+
+	static inline bool intersectBox(const Node& node, const glm::vec3& origin, const glm::vec3& inv_dir, float t_max) {
+		glm::vec3 t0 = (node.min - origin)*inv_dir;
+		glm::vec3 t1 = (node.max - origin)*inv_dir;
+		glm::vec3 t_near = glm::min(t0, t1);
+		glm::vec3 t_far = glm::max(t0, t1);
+		float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+		float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, t_max));
+		return t_enter <= t_exit;
+	}
+
+	static inline simd::vfloat intersectBox(const Node& node, const simd::vvec3& origin, const simd::vvec3& inv_dir, const simd::vfloat& t_max) {
+		simd::vfloat tx0 = (simd::vfloat(node.min.x) - origin.x)*inv_dir.x;
+		simd::vfloat tx1 = (simd::vfloat(node.max.x) - origin.x)*inv_dir.x;
+		simd::vfloat ty0 = (simd::vfloat(node.min.y) - origin.y)*inv_dir.y;
+		simd::vfloat ty1 = (simd::vfloat(node.max.y) - origin.y)*inv_dir.y;
+		simd::vfloat tz0 = (simd::vfloat(node.min.z) - origin.z)*inv_dir.z;
+		simd::vfloat tz1 = (simd::vfloat(node.max.z) - origin.z)*inv_dir.z;
+		simd::vfloat t_enter = simd::max(simd::max(simd::min(tx0, tx1), simd::min(ty0, ty1)),
+			simd::max(simd::min(tz0, tz1), simd::vfloat(0.0f)));
+		simd::vfloat t_exit = simd::min(simd::min(simd::max(tx0, tx1), simd::max(ty0, ty1)),
+			simd::min(simd::max(tz0, tz1), t_max));
+		return t_enter <= t_exit;
+	}
+
+	static const unsigned int stack_size = 64;
+	static const unsigned int max_depth = 32;
+
+	unsigned int max_leaf_size;
+	std::vector<Node> nodes; //< Nodes built by this BVH
+	std::vector<unsigned int> indices;
+	const Node* node_data;
+	unsigned int node_count;
+};
+
+template <class Intersector>
+inline bool BVH::intersect(const Ray& r, float& t_max, Intersector& intersector) const {
+	if (node_count == 0) return false;
+
+	const glm::vec3 origin = r.getOrigin();
+	const glm::vec3 inv_dir = 1.0f/r.getDirection();
+	const bool dir_neg[3] = { inv_dir.x < 0.0f, inv_dir.y < 0.0f, inv_dir.z < 0.0f };
+
+	unsigned int stack[stack_size];
+	unsigned int top = 0;
+	unsigned int current = 0;
+	bool hit = false;
+
+	while (true) {
+		const Node& node = node_data[current];
+		if (intersectBox(node, origin, inv_dir, t_max)) {
+			if (node.count > 0) {
+				hit |= intersector(node.offset, node.count, t_max);
+				if (top == 0) break;
+				current = stack[--top];
+			}
+			else if (dir_neg[node.axis]) {
+				//Second child is nearest, visit it first
+				stack[top++] = current+1;
+				current = node.offset;
+			}
+			else {
+				stack[top++] = node.offset;
+				current = current+1;
+			}
+		}
+		else {
+			if (top == 0) break;
+			current = stack[--top];
+		}
+	}
+
+	return hit;
+}
+
+template <class Intersector>
+inline bool BVH::occluded(const Ray& r, float t_max, Intersector& intersector) const {
+	if (node_count == 0) return false;
+
+	const glm::vec3 origin = r.getOrigin();
+	const glm::vec3 inv_dir = 1.0f/r.getDirection();
+	const bool dir_neg[3] = { inv_dir.x < 0.0f, inv_dir.y < 0.0f, inv_dir.z < 0.0f };
+
+	unsigned int stack[stack_size];
+	unsigned int top = 0;
+	unsigned int current = 0;
+
+	while (true) {
+		const Node& node = node_data[current];
+		if (intersectBox(node, origin, inv_dir, t_max)) {
+			if (node.count > 0) {
+				//Any hit will do, so there is no need to look further
+				if (intersector(node.offset, node.count, t_max)) return true;
+				if (top == 0) break;
+				current = stack[--top];
+			}
+			else if (dir_neg[node.axis]) {
+				stack[top++] = current+1;
+				current = node.offset;
+			}
+			else {
+				stack[top++] = node.offset;
+				current = current+1;
+			}
+		}
+		else {
+			if (top == 0) break;
+			current = stack[--top];
+		}
+	}
+
+	return false;
+}
+
+template <class Intersector>
+inline void BVH::intersect(const RayPacket& packet, simd::vfloat& t_max, Intersector& intersector) const {
+	const int lanes = simd::movemask(packet.getActive());
+	if (node_count == 0 || lanes == 0) return;
+
+	const simd::vvec3& origin = packet.getOrigin();
+	const simd::vvec3& dir = packet.getDirection();
+	const simd::vfloat one(1.0f);
+	const simd::vvec3 inv_dir(one/dir.x, one/dir.y, one/dir.z);
+
+	unsigned int first_lane = 0;
+	while (!(lanes & (1 << first_lane))) ++first_lane;
+	const bool dir_neg[3] = { simd::get(dir.x, first_lane) < 0.0f,
+		simd::get(dir.y, first_lane) < 0.0f, simd::get(dir.z, first_lane) < 0.0f };
+
+	unsigned int stack[stack_size];
+	unsigned int top = 0;
+	unsigned int current = 0;
+
+	while (true) {
+		const Node& node = node_data[current];
+		simd::vfloat mask = packet.getActive() & intersectBox(node, origin, inv_dir, t_max);
+		if (simd::movemask(mask) != 0) {
+			if (node.count > 0) {
+				intersector(node.offset, node.count, mask, t_max);
+				if (top == 0) break;
+				current = stack[--top];
+			}
+			else if (dir_neg[node.axis]) {
+				stack[top++] = current+1;
+				current = node.offset;
+			}
+			else {
+				stack[top++] = node.offset;
+				current = current+1;
+			}
+		}
+		else {
+			if (top == 0) break;
+			current = stack[--top];
+		}
+	}
+}
+
+#endif
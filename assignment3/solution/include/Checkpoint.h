@@ -0,0 +1,100 @@
+#ifndef _CHECKPOINT_H__
+#define _CHECKPOINT_H__
+
+#include <string>
+#include <cstdio>
+#include <mutex>
+#include <functional>
+
+#include "FrameBuffer.hpp"
+#include "TileScheduler.h"
+#include "Timer.h"
+
+/**
+  * Log of the finished tiles of a render, so that an interrupted render can
+  * be resumed. Every finished tile is appended to the file with its pixels
+  * in the format the image is kept in, and the number of samples it took.
+  * The file is flushed to disk at a fixed interval, so an interruption
+  * loses at most that much work. Tiles depend only on their position (the
+  * random numbers are seeded per ray), so a resumed render gives the same
+  * image, bit for bit, as one that was never interrupted.
+  *
+  * The file starts with a key of the render settings, and every tile
+  * carries a hash of its contents, so tiles of another render and the
+  * partly written last tile of a crash are never used.
+  */
+class Checkpoint {
+public:
+	/**
+	  * @param key Hash of everything that changes the pixels of a tile, except the scene
+	  * @param format Format the tiles are stored in
+	  * @param interval Seconds between flushes to disk
+	  */
+	Checkpoint(std::string filename, unsigned long long key, FrameBuffer::Format format, double interval);
+	~Checkpoint();
+
+	/**
+	  * Opens the file for writing tiles. With resume, the tiles of a
+	  * previous render with the same key are read first, and handed to
+	  * restore, which returns false for a tile that does not belong to the
+	  * render; those tiles are kept in the file. Without resume, or if the
+	  * file is missing or empty, a new file is started.
+	  * @throws std::runtime_error With resume, if the file belongs to another render
+	  * @return The number of tiles restored
+	  */
+	unsigned int open(bool resume, const std::function<bool(const Tile&, FrameBuffer&, unsigned long long samples)>& restore);
+
+	/**
+	  * Appends a finished tile, rendered with samples primary rays. Safe to
+	  * call from several threads at once. Write errors are reported by
+	  * close(), so that render threads never throw.
+	  */
+	void addTile(const Tile& tile, FrameBuffer& pixels, unsigned long long samples);
+
+	/**
+	  * Flushes and closes the file, throwing if any write failed
+	  */
+	void close();
+
+private:
+	Checkpoint(const Checkpoint&);
+	Checkpoint& operator=(const Checkpoint&);
+
+	static const unsigned int version = 1; //< Increase when the file layout changes
+
+	struct Header {
+		char magic[8];
+		unsigned int version;
+		unsigned int format;
+		unsigned long long key;
+	};
+
+	struct Record {
+		unsigned int index; //< Index of the tile in the TileScheduler
+		unsigned int x, y, width, height;
+		unsigned int padding;
+		unsigned long long samples;
+		unsigned long long hash; //< Hash of the record, with hash 0, and the pixels
+	};
+
+	/**
+	  * Returns the hash of record and pixels for Record::hash
+	  */
+	static unsigned long long hashRecord(Record record, FrameBuffer& pixels);
+
+	/**
+	  * Writes buffered tiles to disk
+	  */
+	void flush();
+
+	std::string filename;
+	unsigned long long key;
+	FrameBuffer::Format format;
+	double interval;
+	std::FILE* file;
+	bool failed;
+	Timer last_flush;
+	std::mutex lock;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef _COORDINATOR_H__
+#define _COORDINATOR_H__
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "FrameBuffer.hpp"
+#include "TileScheduler.h"
+#include "Socket.h"
+#include "Timer.h"
+
+/**
+  * Renders frames on worker processes, on this machine or others. The
+  * coordinator splits a frame into chunks, much larger than the tiles of the
+  * threads, and hands them out over TCP to workers started with
+  * RayTracer::serve(), which build the same scene, render a chunk with all
+  * their threads and send its pixels back. Every worker gets a second chunk
+  * before it finishes the first, so it never waits for the network.
+  *
+  * Workers can connect and disconnect at any time. The chunks of a worker
+  * that disconnects or stays silent for longer than the timeout are handed
+  * out again. When no chunks are left to hand out, idle workers also get a
+  * copy of chunks that have taken much longer than the average, and the
+  * first copy to arrive is used, so one slow node cannot hold up the frame.
+  */
+class Coordinator {
+public:
+	/**
+	  * Message header of the protocol. Every message is a header; pixels
+	  * follow MESSAGE_PIXELS as width*height RGB floats, row by row. All
+	  * values are in the byte order of the machines, which must agree.
+	  */
+	struct Message {
+		unsigned int type; //< MessageType
+		unsigned int id; //< Chunk id, or protocol version in MESSAGE_HELLO
+		unsigned int x, y; //< Lower left corner of the chunk
+		unsigned int width, height; //< Size of the chunk, or of the image in MESSAGE_HELLO
+		unsigned long long key; //< Render settings of the worker in MESSAGE_HELLO, see render()
+	};
+
+	enum MessageType {
+		MESSAGE_HELLO = 0x4b575452, //< Worker to coordinator on connecting, "RTWK"
+		MESSAGE_CHUNK, //< Coordinator to worker: render a chunk
+		MESSAGE_PIXELS, //< Worker to coordinator: the pixels of a chunk
+		MESSAGE_QUIT //< Coordinator to worker: stop serving
+	};
+
+	static const unsigned int protocol_version = 2;
+
+	/**
+	  * Listens for workers on port (0 picks a free port, see getPort())
+	  * @param width Width of the image, workers must render the same size
+	  * @param height Height of the image
+	  */
+	Coordinator(unsigned short port, unsigned int width, unsigned int height);
+
+	/**
+	  * Stops the workers, see close()
+	  */
+	~Coordinator();
+
+	/**
+	  * Renders a frame on the workers, calling output for every chunk as it
+	  * arrives. Waits for workers to connect if there are none.
+	  * @param key Hash of the render settings, workers with other settings
+	  *        are turned away, see RayTracer::renderDistributed()
+	  */
+	void render(unsigned long long key, const std::function<void(const Tile&, FrameBuffer&)>& output);
+
+	/**
+	  * Tells all workers to stop, and closes their connections
+	  */
+	void close();
+
+	/**
+	  * Sets the width and height of the chunks handed out. With a multiple of
+	  * the tile size of the workers, they render the same tiles, and so the
+	  * same image, as a single machine.
+	  */
+	inline void setChunkSize(unsigned int size) { chunk_size = size; }
+
+	/**
+	  * Sets the seconds a worker with chunks may stay silent before it is
+	  * dropped and its chunks are handed out again
+	  */
+	inline void setTimeout(double seconds) { timeout = seconds; }
+
+	/**
+	  * Sets how many times longer than the average a chunk must take before
+	  * an idle worker gets a copy of it
+	  */
+	inline void setStragglerFactor(double factor) { straggler_factor = factor; }
+
+	/**
+	  * Enables or disables printing workers joining and leaving, and statistics after every frame
+	  */
+	inline void setVerbose(bool enable) { verbose = enable; }
+
+	inline unsigned short getPort() const { return listener->getPort(); }
+	inline unsigned int getWidth() const { return width; }
+	inline unsigned int getHeight() const { return height; }
+
+private:
+	Coordinator(const Coordinator&);
+	Coordinator& operator=(const Coordinator&);
+
+	struct Assignment {
+		unsigned int id; //< Chunk id, which may belong to an earlier frame
+		double issued; //< Time the chunk was sent
+	};
+
+	struct Worker {
+		std::shared_ptr<Socket> socket;
+		unsigned int number; //< Number of the worker in messages
+		bool ready; //< Whether the worker has said hello
+		unsigned long long key; //< Render settings the worker said hello with
+		double last_seen; //< Time of the last message
+		std::vector<Assignment> chunks; //< Chunks sent and not yet returned
+		unsigned int rendered; //< Chunks returned this frame
+	};
+
+	struct Chunk {
+		Tile tile;
+		bool done;
+		unsigned int copies; //< Number of workers rendering the chunk
+		double issued; //< Time the last copy was sent
+	};
+
+	/**
+	  * Sends chunk k of the current frame to worker
+	  */
+	void issue(Worker& worker, unsigned int k, double now);
+
+	/**
+	  * Reads a message from worker, calling output for new pixels
+	  */
+	void receive(Worker& worker, double now, const std::function<void(const Tile&, FrameBuffer&)>& output);
+
+	/**
+	  * Closes the connection of worker k, handing its chunks out again
+	  */
+	void drop(unsigned int k, const char* reason);
+
+	/**
+	  * Returns the index of the slowest chunk of this frame worth a second copy,
+	  * or chunks.size() if there is none
+	  */
+	unsigned int findStraggler(double now) const;
+
+	static const unsigned int max_chunks_per_worker = 2;
+
+	std::shared_ptr<Socket> listener;
+	std::vector<Worker> workers;
+	unsigned int width, height;
+	unsigned long long key; //< Render settings of the current frame
+	unsigned int chunk_size;
+	double timeout;
+	double straggler_factor;
+	bool verbose;
+	Timer clock; //< All times are seconds on this clock, which runs across frames
+	unsigned int n_connected; //< Workers connected so far, numbers them
+
+	//State of the frame being rendered
+	std::vector<Chunk> chunks;
+	std::vector<unsigned int> pending; //< Chunks to hand out, the next at the back
+	unsigned int first_id; //< Id of the first chunk of the frame, ids are never reused
+	unsigned int remaining;
+	double chunk_seconds; //< Sum of the time from issue to result of all returned chunks
+	unsigned int n_returned;
+	unsigned int n_reissued; //< Chunks handed out again after losing a worker
+	unsigned int n_copies; //< Extra copies of slow chunks handed out
+	unsigned int n_discarded; //< Chunks that arrived after another copy
+};
+
+#endif
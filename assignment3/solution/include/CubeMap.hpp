@@ -4,109 +4,125 @@
 #include <string>
 #include <limits>
 #include <sstream>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
 
 #include <glm/glm.hpp>
 
 #include <IL/il.h>
 #include <IL/ilu.h>
 
+#include "MipTexture.h"
+#include "TextureCache.h"
+#include "Hash.h"
+#include "RenderCounters.h"
+
 class CubeMap : public SceneObject {
 public:
+	/**
+	  * Loads the six faces of the cube map
+	  * @param cache_directory Directory for the converted faces (see
+	  * TextureCache), which are reused while the images do not change.
+	  * Leave empty to always decode the images.
+	  */
 	CubeMap(std::string posx, std::string negx, 
 			std::string posy, std::string negy,
-			std::string posz, std::string negz) {
+			std::string posz, std::string negz,
+			std::string cache_directory="") {
+		std::string filenames[] = { posx, negx, posy, negy, posz, negz };
+		MipTexture* faces[] = { &this->posx, &this->negx, &this->posy, &this->negy, &this->posz, &this->negz };
+
+		std::string cache_filename;
+		unsigned long long key = 0;
+		if (!cache_directory.empty()) {
+			key = hashing::hashFiles(std::vector<std::string>(filenames, filenames+6));
+			cache_filename = TextureCache::getFilename(cache_directory, key);
+			cache = TextureCache::load(cache_filename, key, faces, 6);
+			if (cache) return;
+		}
+
 		ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
-		loadImage(posx, this->posx);
-		loadImage(negx, this->negx);
-		loadImage(posy, this->posy);
-		loadImage(negy, this->negy);
-		loadImage(posz, this->posz);
-		loadImage(negz, this->negz);
+		for (int k=0; k<6; ++k) {
+			loadImage(filenames[k], *faces[k]);
+		}
+
+		if (!cache_directory.empty()) {
+			//Without a cache the next run is slower, but this one is fine
+			try {
+				TextureCache::save(cache_filename, key, faces, 6);
+			}
+			catch (std::runtime_error& e) {
+				std::cout << e.what() << std::endl;
+			}
+		}
 	}
 	
-	glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state) {
+	glm::vec3 rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree) {
 		glm::vec3 out_color;
-		glm::vec3 dir =  ray.getDirection();
+		glm::vec3 dir = glm::normalize(ray.getDirection());
+		glm::vec3 a = glm::abs(dir);
 
 		//x is major axis
-		if (fabs(dir.x) >= fabs(dir.y) && fabs(dir.x) >= fabs(dir.z)) {
+		if (a.x >= a.y && a.x >= a.z) {
 			float s = 0.5f-0.5f*dir.z/dir.x;
 			float t = 0.5f-0.5f*dir.y/dir.x;
 			if (dir.x > 0)
-				out_color = readTexture(posx, s, t);
+				out_color = readTexture(posx, s, t, ray, a.x);
 			else
-				out_color = readTexture(negx, s, 1.0f-t);
+				out_color = readTexture(negx, s, 1.0f-t, ray, a.x);
 		}
 		//y is major axis
-		if (fabs(dir.y) >= fabs(dir.x) && fabs(dir.y) >= fabs(dir.z)) {
+		if (a.y >= a.x && a.y >= a.z) {
 			float s = 0.5f*dir.x/dir.y+0.5f;
 			float t = 0.5f*dir.z/dir.y+0.5f;
 			if (dir.y > 0)
-				out_color = readTexture(posy, s, t);
+				out_color = readTexture(posy, s, t, ray, a.y);
 			else
-				out_color = readTexture(negy, 1.0f-s, t);
+				out_color = readTexture(negy, 1.0f-s, t, ray, a.y);
 		}
 		//z is major axis
-		else if(fabs(dir.z) >= fabs(dir.x) && fabs(dir.z) >= fabs(dir.y)) {
+		else if (a.z >= a.x && a.z >= a.y) {
 			float s = 0.5f*dir.x/dir.z+0.5f;
 			float t = 0.5f*dir.y/dir.z+0.5f;
 			if (dir.z > 0)
-				out_color = readTexture(posz, s, 1.0f-t);
+				out_color = readTexture(posz, s, 1.0f-t, ray, a.z);
 			else
-				out_color = readTexture(negz, s, t);
+				out_color = readTexture(negz, s, t, ray, a.z);
 		}
 
-		ray.invalidate();
 		return out_color;
 	}
 	
-	float intersect(const Ray& r) {
-		return std::numeric_limits<float>::max();
+	HitRecord intersect(const Ray& r, float t_max) {
+		//The cube map is infinitely far away, so anything else is in front of it
+		HitRecord hit;
+		hit.t = std::numeric_limits<float>::max();
+		if (hit.t < t_max) hit.object = this;
+		return hit;
 	}
 
-private:
-	struct texture {
-		std::vector<float> data;
-		unsigned int width;
-		unsigned int height;
-	};
-
-	static glm::vec3 readTexture(texture& tex, float s, float t) {
-		glm::vec3 out_color;
-
-		float xf = std::min(s*tex.width, tex.width-1.0f);
-		float yf = std::min(t*tex.height, tex.height-1.0f);
-
-		unsigned int xm = static_cast<unsigned int>(xf);
-		unsigned int ym = static_cast<unsigned int>(yf);
-		unsigned int xp = std::min(xm+1, tex.width-1);
-		unsigned int yp = std::min(ym+1, tex.height-1);
-
-
-		float xs = xf - xm;
-		float ys = yf - ym;
-		
-		unsigned int i0 = (ym*tex.width + xm)*3;
-		unsigned int i1 = (ym*tex.width + xp)*3;
-		unsigned int i2 = (yp*tex.width + xm)*3;
-		unsigned int i3 = (yp*tex.width + xp)*3;
-
-		for (int k=0; k<3; ++k) {
-			float c0 = tex.data.at(i0+k);
-			float c1 = tex.data.at(i1+k);
-			float c2 = tex.data.at(i2+k);
-			float c3 = tex.data.at(i3+k);
-			
-			float d0 = (1.0f-xs)*c0 + xs*c1;
-			float d1 = (1.0f-xs)*c2 + xs*c3;
-
-			out_color[k] = (1.0f-ys)*d0 + ys*d1;
-		}
+	void intersect(const RayPacket& packet, HitPacket& hits) {
+		const simd::vfloat t(std::numeric_limits<float>::max());
+		hits.update(packet.getActive() & (t < hits.t), t, this);
+	}
 
-		return out_color;
+private:
+	/**
+	  * Filtered lookup of the footprint of the ray cone on a face
+	  * @param major Major component of the normalized ray direction
+	  */
+	static glm::vec3 readTexture(const MipTexture& tex, float s, float t, const Ray& ray, float major) {
+		//The face coordinate is 0.5*tan(angle), which changes by 0.5/cos^2 = 0.5/major^2 per radian
+		float footprint = ray.getConeAngle()*0.5f/(major*major)*tex.getWidth();
+		float lod = (footprint > 0.0f) ? std::log(footprint)*1.44269504f : 0.0f;
+		RenderCounters::add(RenderCounters::CUBEMAP_LOOKUPS);
+		return tex.sample(s, t, lod);
 	}
 
-	static void loadImage(std::string filename, texture& tex) {
+	static void loadImage(std::string filename, MipTexture& tex) {
 		ILuint ImageName;
 
 		ilGenImages(1, &ImageName); // Grab a new image name.
@@ -122,15 +138,18 @@ private:
 			throw std::runtime_error(error.str());
 		}
 
-		tex.width = ilGetInteger(IL_IMAGE_WIDTH); // getting image width
-		tex.height = ilGetInteger(IL_IMAGE_HEIGHT); // and height
-		tex.data.resize(tex.width*tex.height*3);
+		unsigned int width = ilGetInteger(IL_IMAGE_WIDTH); // getting image width
+		unsigned int height = ilGetInteger(IL_IMAGE_HEIGHT); // and height
+		std::vector<float> data(width*height*3);
 		
-		ilCopyPixels(0, 0, 0, tex.width, tex.height, 1, IL_RGB, IL_FLOAT, tex.data.data());
+		ilCopyPixels(0, 0, 0, width, height, 1, IL_RGB, IL_FLOAT, data.data());
 		ilDeleteImages(1, &ImageName); // Delete the image name. 
+
+		tex.build(data.data(), width, height);
 	}
 
-	texture posx, negx, posy, negy, posz, negz;
+	MipTexture posx, negx, posy, negy, posz, negz;
+	std::shared_ptr<MappedFile> cache; //< Holds the faces if they were loaded from the cache
 };
 
 #endif
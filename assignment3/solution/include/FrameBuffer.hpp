@@ -3,36 +3,205 @@
 
 #include <vector>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
 
 #include <glm/glm.hpp>
 
+#include "PixelFormat.hpp"
+
+/**
+  * RGB framebuffer with a selectable storage format. Pixels are always
+  * written and read as floats, and converted to and from the storage
+  * format on the fly. setPixels() and getPixels() convert whole runs of
+  * pixels with SIMD, and should be preferred over the single pixel versions
+  * for anything but sparse access.
+  */
 class FrameBuffer {
 public:
-	FrameBuffer(unsigned int width, unsigned int height) {
+	enum Format {
+		FORMAT_RGB_FLOAT,   //< Interleaved 32 bit floats, 12 bytes per pixel
+		FORMAT_RGB_HALF,    //< Interleaved 16 bit half floats, 6 bytes per pixel
+		FORMAT_RGB9E5,      //< 9 bit mantissas with a shared 5 bit exponent, 4 bytes per pixel
+		FORMAT_RGBE,        //< 8 bit mantissas with a shared 8 bit exponent, 4 bytes per pixel
+		FORMAT_PLANAR_FLOAT //< One 32 bit float plane per channel, rows aligned for SIMD loads
+	};
+
+	FrameBuffer(unsigned int width, unsigned int height, Format format=FORMAT_RGB_FLOAT) {
 		this->width = width;
 		this->height = height;
-		data.resize(width*height*3);
+		this->format = format;
+
+		switch (format) {
+		case FORMAT_RGB_FLOAT: stride = 3*width*sizeof(float); break;
+		case FORMAT_RGB_HALF: stride = 3*width*sizeof(unsigned short); break;
+		case FORMAT_RGB9E5:
+		case FORMAT_RGBE: stride = width*sizeof(unsigned int); break;
+		case FORMAT_PLANAR_FLOAT:
+			//Pad every row to a whole number of aligned vectors
+			stride = ((width+alignment/sizeof(float)-1) & ~(alignment/sizeof(float)-1))*sizeof(float);
+			break;
+		default: throw std::runtime_error("Unknown framebuffer format");
+		}
+
+		bytes = static_cast<size_t>(stride)*height*((format == FORMAT_PLANAR_FLOAT) ? 3 : 1);
+		data = static_cast<unsigned char*>(_mm_malloc(std::max<size_t>(bytes, 1), alignment));
+		if (data == NULL) {
+			throw std::runtime_error("Unable to allocate framebuffer");
+		}
+		std::memset(data, 0, bytes);
+	}
+
+	~FrameBuffer() {
+		_mm_free(data);
 	}
 
 	inline unsigned int getWidth() { return width; }
 	inline unsigned int getHeight() {return height; }
-	inline const std::vector<float>& getData() { return data; }
+	inline Format getFormat() { return format; }
+
+	/**
+	  * Returns the size of the pixel storage in bytes
+	  */
+	inline size_t getBytes() { return bytes; }
+
+	/**
+	  * Returns the pixel storage, getBytes() bytes in the layout of the format
+	  */
+	inline unsigned char* getData() { return data; }
+
+	/**
+	  * Returns the first row of channel c (0, 1 or 2) of a planar framebuffer.
+	  * Every row starts on a 32 byte boundary, and rows are getPlaneStride() floats apart.
+	  */
+	inline float* getPlane(unsigned int c) {
+		assert(format == FORMAT_PLANAR_FLOAT && c < 3);
+		return reinterpret_cast<float*>(data + static_cast<size_t>(c)*stride*height);
+	}
+
+	inline unsigned int getPlaneStride() { return stride/sizeof(float); }
 
 	/**
 	  * Sets the pixel at (i, j) to the color (r, g, b).
+	  * The coordinates are only checked in debug builds.
 	  */
 	inline void setPixel(unsigned int i, unsigned int j, glm::vec3 color) {
-		assert(i >= 0 && i < width);
-		assert(j >= 0 && j < height);
-		unsigned int index = 3*(i+j*width);
-		data.at(index) = color.r;
-		data.at(index+1) = color.g;
-		data.at(index+2) = color.b;
+		assert(i < width);
+		assert(j < height);
+		if (format == FORMAT_RGB_FLOAT) {
+			float* p = reinterpret_cast<float*>(row(j)) + 3*i;
+			p[0] = color.r;
+			p[1] = color.g;
+			p[2] = color.b;
+		}
+		else {
+			setPixels(i, j, 1, &color);
+		}
+	}
+
+	inline glm::vec3 getPixel(unsigned int i, unsigned int j) {
+		glm::vec3 color;
+		getPixels(i, j, 1, &color);
+		return color;
+	}
+
+	/**
+	  * Sets the n pixels starting at (i, j) along row j
+	  */
+	inline void setPixels(unsigned int i, unsigned int j, unsigned int n, const glm::vec3* colors) {
+		assert(i+n <= width);
+		assert(j < height);
+		const float* rgb = &colors[0].r;
+		switch (format) {
+		case FORMAT_RGB_FLOAT:
+			std::memcpy(reinterpret_cast<float*>(row(j)) + 3*i, rgb, 3*n*sizeof(float));
+			break;
+		case FORMAT_RGB_HALF:
+			pixel::encodeHalf(rgb, reinterpret_cast<unsigned short*>(row(j)) + 3*i, 3*n);
+			break;
+		case FORMAT_RGB9E5:
+			pixel::encodeShared<pixel::encodeRGB9E5>(rgb, reinterpret_cast<unsigned int*>(row(j)) + i, n);
+			break;
+		case FORMAT_RGBE:
+			pixel::encodeShared<pixel::encodeRGBE>(rgb, reinterpret_cast<unsigned int*>(row(j)) + i, n);
+			break;
+		case FORMAT_PLANAR_FLOAT:
+			pixel::encodePlanar(rgb, plane(0, j)+i, plane(1, j)+i, plane(2, j)+i, n);
+			break;
+		}
+	}
+
+	/**
+	  * Gets the n pixels starting at (i, j) along row j
+	  */
+	inline void getPixels(unsigned int i, unsigned int j, unsigned int n, glm::vec3* colors) {
+		assert(i+n <= width);
+		assert(j < height);
+		float* rgb = &colors[0].r;
+		switch (format) {
+		case FORMAT_RGB_FLOAT:
+			std::memcpy(rgb, reinterpret_cast<float*>(row(j)) + 3*i, 3*n*sizeof(float));
+			break;
+		case FORMAT_RGB_HALF:
+			pixel::decodeHalf(reinterpret_cast<unsigned short*>(row(j)) + 3*i, rgb, 3*n);
+			break;
+		case FORMAT_RGB9E5:
+			pixel::decodeShared<pixel::decodeRGB9E5>(reinterpret_cast<unsigned int*>(row(j)) + i, rgb, n);
+			break;
+		case FORMAT_RGBE:
+			pixel::decodeShared<pixel::decodeRGBE>(reinterpret_cast<unsigned int*>(row(j)) + i, rgb, n);
+			break;
+		case FORMAT_PLANAR_FLOAT:
+			pixel::decodePlanar(plane(0, j)+i, plane(1, j)+i, plane(2, j)+i, rgb, n);
+			break;
+		}
+	}
+
+	/**
+	  * Copies all pixels of tile into this framebuffer, with the lower left corner at (x, y).
+	  * Rows are copied as is if both have the same format, and converted otherwise.
+	  */
+	inline void setTile(unsigned int x, unsigned int y, FrameBuffer& tile) {
+		assert(x + tile.getWidth() <= width);
+		assert(y + tile.getHeight() <= height);
+		std::vector<glm::vec3> colors;
+		for (unsigned int j=0; j<tile.getHeight(); ++j) {
+			if (format == tile.format && format != FORMAT_PLANAR_FLOAT) {
+				const size_t pixel_bytes = stride/width;
+				std::memcpy(row(y+j) + x*pixel_bytes, tile.row(j), tile.getWidth()*pixel_bytes);
+			}
+			else if (tile.format == FORMAT_RGB_FLOAT) {
+				setPixels(x, y+j, tile.getWidth(), reinterpret_cast<const glm::vec3*>(tile.row(j)));
+			}
+			else {
+				colors.resize(tile.getWidth());
+				tile.getPixels(0, j, tile.getWidth(), &colors[0]);
+				setPixels(x, y+j, tile.getWidth(), &colors[0]);
+			}
+		}
 	}
 
 private:
-	std::vector<float> data;
+	//Not copyable, the storage is owned
+	FrameBuffer(const FrameBuffer&);
+	FrameBuffer& operator=(const FrameBuffer&);
+
+	inline unsigned char* row(unsigned int j) {
+		return data + static_cast<size_t>(j)*stride;
+	}
+
+	inline float* plane(unsigned int c, unsigned int j) {
+		return reinterpret_cast<float*>(data + (static_cast<size_t>(c)*height + j)*stride);
+	}
+
+	static const unsigned int alignment = 32;
+
+	unsigned char* data;
+	size_t bytes;
+	unsigned int stride; //< Bytes per row
 	unsigned int width, height;
+	Format format;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,31 @@
+#ifndef _HASH_H__
+#define _HASH_H__
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/**
+  * 64 bit FNV-1a hashing, used to key caches by the contents of their sources
+  */
+namespace hashing {
+	static const unsigned long long fnv_offset = 0xcbf29ce484222325ULL; //< Hash of no data
+
+	/**
+	  * Adds size bytes of data to hash
+	  */
+	inline void fnv1a(unsigned long long& hash, const void* data, size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t k=0; k<size; ++k) {
+			hash ^= bytes[k];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+
+	/**
+	  * Returns the hash of the contents of the files, throwing if one cannot be read
+	  */
+	unsigned long long hashFiles(const std::vector<std::string>& filenames);
+}
+
+#endif
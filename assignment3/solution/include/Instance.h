@@ -0,0 +1,51 @@
+#ifndef _INSTANCE_H__
+#define _INSTANCE_H__
+
+#include <memory>
+
+#include <glm/glm.hpp>
+
+#include "SceneObject.hpp"
+#include "Mesh.h"
+
+/**
+  * Places a shared Mesh in the scene with an affine transform and an effect.
+  * Rays are transformed to mesh space when intersected, so an instance only
+  * stores its transforms: any number of instances can use the same mesh
+  * data and BVH. Ray directions are not normalized in mesh space, so t is
+  * the same in both spaces.
+  */
+class Instance : public SceneObject {
+public:
+	/**
+	  * @param transform Transformation from mesh space to world space
+	  */
+	Instance(std::shared_ptr<const Mesh> mesh, const glm::mat4& transform, std::shared_ptr<SceneObjectEffect> effect);
+
+	void setTransform(const glm::mat4& transform);
+	inline const glm::mat4& getTransform() const { return transform; }
+
+	inline const std::shared_ptr<const Mesh>& getMesh() const { return mesh; }
+
+	/**
+	  * Returns the world space bounding box of the instance
+	  */
+	inline const AABB& getBounds() const { return bounds; }
+
+	HitRecord intersect(const Ray& r, float t_max);
+	void intersect(const RayPacket& packet, HitPacket& hits);
+	SceneObject* occluded(const Ray& r, float t_max);
+
+	glm::vec3 getNormal(const Ray& ray, const HitRecord& hit);
+
+	glm::vec3 rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree);
+
+private:
+	std::shared_ptr<const Mesh> mesh;
+	glm::mat4 transform;
+	glm::mat4 inverse; //< World space to mesh space
+	glm::mat3 normal_matrix; //< Inverse transpose of transform, for normals
+	AABB bounds;
+};
+
+#endif
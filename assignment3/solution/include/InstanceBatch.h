@@ -0,0 +1,116 @@
+#ifndef _INSTANCEBATCH_H__
+#define _INSTANCEBATCH_H__
+
+#include <memory>
+#include <vector>
+
+#include "SceneObject.hpp"
+#include "Instance.h"
+#include "BVH.h"
+
+/**
+  * A batch of instances acting as one scene object, with a BVH over the
+  * world bounds of the instances (the top level of a two level hierarchy;
+  * every mesh has its own BVH as the bottom level). Hits are reported on
+  * the instance that was hit, so the instance shades them. The BVH is built
+  * in prepare(), so instances may be added and moved between frames. When
+  * instances only moved, the BVH is refit rather than rebuilt, until moving
+  * made it too slow to trace, see setRebuildThreshold().
+  */
+class InstanceBatch : public SceneObject {
+public:
+	InstanceBatch() {
+		modified = true;
+		rebuild_threshold = 1.5f;
+		build_cost = 0.0f;
+	}
+
+	void addInstance(std::shared_ptr<Instance> instance);
+
+	inline unsigned int size() const { return static_cast<unsigned int>(instances.size()); }
+
+	/**
+	  * Sets when prepare() rebuilds the BVH of moved instances instead of
+	  * refitting it: once the SAH cost of the refit tree exceeds threshold
+	  * times its cost after the last build
+	  */
+	inline void setRebuildThreshold(float threshold) { rebuild_threshold = threshold; }
+
+	void prepare();
+
+	HitRecord intersect(const Ray& r, float t_max);
+	void intersect(const RayPacket& packet, HitPacket& hits);
+	SceneObject* occluded(const Ray& r, float t_max);
+
+	/**
+	  * Never called, as hits are reported on the instances
+	  */
+	glm::vec3 rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree) { return glm::vec3(0.0f); }
+
+private:
+	/**
+	  * Intersects the instances of a leaf, remembering the closest hit
+	  */
+	struct LeafIntersector {
+		LeafIntersector(const std::vector<std::shared_ptr<Instance> >& instances, const Ray& ray) : instances(instances), ray(ray) {}
+		inline bool operator()(unsigned int first, unsigned int count, float& t_max) {
+			bool found = false;
+			for (unsigned int k=first; k<first+count; ++k) {
+				HitRecord h = instances[k]->intersect(ray, t_max);
+				if (h.isHit()) {
+					t_max = h.t;
+					hit = h;
+					found = true;
+				}
+			}
+			return found;
+		}
+		const std::vector<std::shared_ptr<Instance> >& instances;
+		const Ray& ray;
+		HitRecord hit;
+	};
+
+	/**
+	  * Tests the instances of a leaf for any hit, remembering the instance that was hit
+	  */
+	struct OcclusionLeafIntersector {
+		OcclusionLeafIntersector(const std::vector<std::shared_ptr<Instance> >& instances, const Ray& ray)
+			: instances(instances), ray(ray), occluder(NULL) {}
+		inline bool operator()(unsigned int first, unsigned int count, float t_max) {
+			for (unsigned int k=first; k<first+count; ++k) {
+				occluder = instances[k]->occluded(ray, t_max);
+				if (occluder) return true;
+			}
+			return false;
+		}
+		const std::vector<std::shared_ptr<Instance> >& instances;
+		const Ray& ray;
+		SceneObject* occluder;
+	};
+
+	/**
+	  * Intersects the instances of a leaf with the lanes of a packet that hit the leaf
+	  */
+	struct PacketLeafIntersector {
+		PacketLeafIntersector(const std::vector<std::shared_ptr<Instance> >& instances, const RayPacket& packet, HitPacket& hits)
+			: instances(instances), packet(packet), hits(hits) {}
+		inline void operator()(unsigned int first, unsigned int count, const simd::vfloat& mask, simd::vfloat& t_max) {
+			//t_max is hits.t, which the instances update themselves
+			RayPacket leaf_packet(packet.getOrigin(), packet.getDirection(), mask);
+			for (unsigned int k=first; k<first+count; ++k) {
+				instances[k]->intersect(leaf_packet, hits);
+			}
+		}
+		const std::vector<std::shared_ptr<Instance> >& instances;
+		const RayPacket& packet;
+		HitPacket& hits;
+	};
+
+	std::vector<std::shared_ptr<Instance> > instances; //< In leaf order after prepare()
+	BVH bvh;
+	bool modified; //< Instances were added since the last build
+	float rebuild_threshold;
+	float build_cost; //< SAH cost of the BVH right after it was built
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _MAPPEDFILE_H__
+#define _MAPPEDFILE_H__
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+
+/**
+  * Read-only memory mapping of a whole file. Pages are loaded on first
+  * access, and processes that map the same file share them.
+  */
+class MappedFile {
+public:
+	/**
+	  * Maps filename, throwing if it cannot be opened or mapped
+	  */
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	inline const void* getData() const { return data; }
+	inline size_t getSize() const { return size; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const void* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;    //< HANDLE of the file
+	void* mapping; //< HANDLE of the file mapping
+#endif
+};
+
+/**
+  * Writes a file for mapping by other processes, which never see it
+  * partly written: write fills a temporary file of this process, which is
+  * then renamed to filename, replacing an existing (stale) file. If filename
+  * cannot be replaced because a concurrent writer holds it, that is only
+  * fine when it has the same contents.
+  * @param write Writes the contents to the file, returning false on failure
+  * @throws std::runtime_error If the file cannot be written or replaced
+  */
+void writeFileAtomically(const std::string& filename, const std::function<bool(std::FILE*)>& write);
+
+/**
+  * Writes size bytes of data as filename, see above
+  */
+void writeFileAtomically(const std::string& filename, const void* data, size_t size);
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef _MESH_H__
+#define _MESH_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <assimp.h>
+#include <aiPostProcess.h>
+#include <aiScene.h>
+
+#include <glm/glm.hpp>
+
+#include "SceneObject.hpp"
+#include "BVH.h"
+#include "MappedFile.h"
+#include "RenderCounters.h"
+
+/**
+  * Triangle mesh loaded with assimp. At load time the mesh is flattened into
+  * transformed triangles, stored in SIMD blocks in the leaf order of a BVH.
+  * The result can be cached in <filename>.bvhcache, keyed by a hash of the
+  * mesh file and the build parameters: later loads map the cache read-only
+  * and use it in place, skipping both the import and the BVH build.
+  *
+  * A mesh is not a scene object itself: it is placed in the scene by one or
+  * more Instances, which share the mesh data.
+  */
+class Mesh {
+public:
+	/**
+	  * @param use_cache Load from, or else write, <filename>.bvhcache
+	  */
+	Mesh(const std::string& filename, bool use_cache=true);
+
+	/**
+	  * Returns the bounding box of all vertices
+	  */
+	inline AABB getBounds() const {
+		AABB b;
+		b.min = min_dim;
+		b.max = max_dim;
+		return b;
+	}
+
+	/**
+	  * Finds the closest triangle hit by r (in mesh space) before t_max
+	  * @return The intersection, reported as a hit on object
+	  */
+	HitRecord intersect(const Ray& r, float t_max, SceneObject* object) const;
+
+	/**
+	  * Intersects a packet of rays in mesh space, reporting hits on object
+	  */
+	void intersect(const RayPacket& packet, HitPacket& hits, SceneObject* object) const;
+
+	/**
+	  * Returns true if any triangle is hit by r (in mesh space) before t_max
+	  */
+	bool occluded(const Ray& r, float t_max) const;
+
+	/**
+	  * Returns the interpolated vertex normal at hit, in mesh space
+	  */
+	glm::vec3 getNormal(const HitRecord& hit) const;
+
+private:
+	Mesh(const Mesh&);
+	Mesh& operator=(const Mesh&);
+
+	/**
+	  * Triangle with its vertices transformed to mesh space, and its vertex
+	  * normals (the face normal if the mesh has none)
+	  */
+	struct Triangle {
+		glm::vec3 a, b, c;
+		glm::vec3 normals[3];
+	};
+
+	/**
+	  * simd::width consecutive triangles in structure of arrays layout, with
+	  * the edges of the Moller-Trumbore test precomputed, so that one ray is
+	  * tested against all of them at once. Leaves start at a new block.
+	  */
+	struct TriangleBlock {
+		float a[3][simd::width];
+		float e1[3][simd::width]; //< b-a
+		float e2[3][simd::width]; //< c-a
+	};
+
+	/**
+	  * Intersects a range of triangles (a BVH leaf), remembering the closest
+	  */
+	struct LeafIntersector {
+		LeafIntersector(const TriangleBlock* blocks, const Ray& ray)
+			: blocks(blocks), origin(ray.getOrigin()), direction(ray.getDirection()), hit(-1) {}
+		inline bool operator()(unsigned int first, unsigned int count, float& t_max);
+		const TriangleBlock* blocks;
+		simd::vvec3 origin, direction; //< The ray in every lane
+		int hit;
+		glm::vec2 barycentric;
+	};
+
+	/**
+	  * Tests a range of triangles for any hit, for shadow rays
+	  */
+	struct OcclusionIntersector {
+		OcclusionIntersector(const TriangleBlock* blocks, const Ray& ray)
+			: blocks(blocks), origin(ray.getOrigin()), direction(ray.getDirection()) {}
+		inline bool operator()(unsigned int first, unsigned int count, float t_max);
+		const TriangleBlock* blocks;
+		simd::vvec3 origin, direction; //< The ray in every lane
+	};
+
+	/**
+	  * Intersects a range of triangles with the active rays of a packet
+	  */
+	struct PacketLeafIntersector {
+		PacketLeafIntersector(const TriangleBlock* blocks, const RayPacket& packet, HitPacket& hits, SceneObject* object)
+			: blocks(blocks), packet(packet), hits(hits), object(object) {}
+		inline void operator()(unsigned int first, unsigned int count, const simd::vfloat& mask, simd::vfloat& t_max);
+		const TriangleBlock* blocks;
+		const RayPacket& packet;
+		HitPacket& hits;
+		SceneObject* object;
+	};
+
+	static void findBBoxRecursive(const aiScene* scene, const aiNode* node, aiMatrix4x4* trafo, glm::vec3& min_dim, glm::vec3& max_dim);
+	static void collectTrianglesRecursive(const aiScene* scene, const aiNode* node, aiMatrix4x4* trafo, std::vector<Triangle>& triangles);
+
+	/**
+	  * Moller-Trumbore ray-triangle intersection of a, b and c
+	  * @return The lanes where the ray hits the triangle with t in (t_min, t_max)
+	  */
+	static inline simd::vfloat intersect(const simd::vvec3& a, const simd::vvec3& e1, const simd::vvec3& e2,
+		const simd::vvec3& o, const simd::vvec3& d, const simd::vfloat& t_max,
+		simd::vfloat& t, simd::vfloat& u, simd::vfloat& v);
+
+	/**
+	  * Start of the cache file (and of the in-memory copy of a built mesh).
+	  * The BVH nodes, triangle blocks and normals follow, each aligned to 64 bytes.
+	  */
+	struct CacheHeader {
+		char magic[8];
+		unsigned long long key; //< Hash of the mesh file and the build parameters
+		float min_dim[3];
+		float max_dim[3];
+		unsigned int node_count;
+		unsigned int triangle_count; //< Including padding, a multiple of simd::width
+	};
+
+	/**
+	  * Computes the offsets of the sections, and the total size, of a cache
+	  */
+	static void getCacheLayout(const CacheHeader& header, size_t& nodes, size_t& blocks, size_t& normals, size_t& size);
+
+	/**
+	  * Imports the mesh with assimp, and builds the BVH and triangle blocks into storage
+	  */
+	void import(const std::string& filename, unsigned long long key);
+
+	/**
+	  * Maps a cache file
+	  * @return false if it does not exist, belongs to another key, or is invalid
+	  */
+	bool loadCache(const std::string& filename, unsigned long long key);
+	void saveCache(const std::string& filename) const;
+
+	/**
+	  * Points the BVH, blocks and normals into a cache image
+	  */
+	void attach(const unsigned char* data);
+
+	std::vector<unsigned char> storage; //< Cache image of an imported mesh
+	std::shared_ptr<MappedFile> cache; //< Mapped cache file, if the mesh was loaded from one
+	const TriangleBlock* blocks; //< Triangle k is lane k%simd::width of block k/simd::width
+	const glm::vec3* normals; //< Three vertex normals per triangle
+	BVH bvh;
+
+	glm::vec3 min_dim;
+	glm::vec3 max_dim;
+};
+
+inline simd::vfloat Mesh::intersect(const simd::vvec3& a, const simd::vvec3& e1, const simd::vvec3& e2,
+		const simd::vvec3& o, const simd::vvec3& d, const simd::vfloat& t_max,
+		simd::vfloat& t, simd::vfloat& u, simd::vfloat& v) {
+	const simd::vfloat z_offset(10e-4f);
+	const simd::vfloat zero(0.0f);
+	const simd::vfloat one(1.0f);
+
+	simd::vvec3 p = simd::cross(d, e2);
+	simd::vfloat inv_det = one/simd::dot(e1, p);
+	simd::vvec3 s = o - a;
+	u = simd::dot(s, p)*inv_det;
+	simd::vvec3 q = simd::cross(s, e1);
+	v = simd::dot(d, q)*inv_det;
+	t = simd::dot(e2, q)*inv_det;
+
+	return (u > zero) & (v > zero) & (u+v < one) & (t > z_offset) & (t < t_max);
+}
+
+/**
+  * One ray against the triangles of a leaf, a block of simd::width triangles at a time
+  */
+inline bool Mesh::LeafIntersector::operator()(unsigned int first, unsigned int count, float& t_max) {
+	const unsigned int end = first+count;
+	bool found = false;
+	RenderCounters::add(RenderCounters::TRIANGLE_TESTS, count);
+
+	for (unsigned int k=first; k<end; k+=simd::width) {
+		const TriangleBlock& block = blocks[k/simd::width];
+		simd::vvec3 a(simd::load(block.a[0]), simd::load(block.a[1]), simd::load(block.a[2]));
+		simd::vvec3 e1(simd::load(block.e1[0]), simd::load(block.e1[1]), simd::load(block.e1[2]));
+		simd::vvec3 e2(simd::load(block.e2[0]), simd::load(block.e2[1]), simd::load(block.e2[2]));
+
+		simd::vfloat t, u, v;
+		simd::vfloat valid = simd::laneMask(end-k) & Mesh::intersect(a, e1, e2, origin, direction, simd::vfloat(t_max), t, u, v);
+		int lanes = simd::movemask(valid);
+		if (lanes == 0) continue;
+
+		//Several triangles of a block may be hit, keep the closest
+		float ts[simd::width];
+		simd::store(ts, t);
+		unsigned int closest = simd::width;
+		for (unsigned int i=0; i<simd::width; ++i) {
+			if ((lanes & (1 << i)) && ts[i] < t_max) {
+				t_max = ts[i];
+				closest = i;
+			}
+		}
+		hit = k+closest;
+		barycentric = glm::vec2(simd::get(u, closest), simd::get(v, closest));
+		found = true;
+	}
+	return found;
+}
+
+/**
+  * One ray against the triangles of a leaf, stopping at the first block with a hit
+  */
+inline bool Mesh::OcclusionIntersector::operator()(unsigned int first, unsigned int count, float t_max) {
+	const unsigned int end = first+count;
+	const simd::vfloat vt_max(t_max);
+	RenderCounters::add(RenderCounters::TRIANGLE_TESTS, count);
+
+	for (unsigned int k=first; k<end; k+=simd::width) {
+		const TriangleBlock& block = blocks[k/simd::width];
+		simd::vvec3 a(simd::load(block.a[0]), simd::load(block.a[1]), simd::load(block.a[2]));
+		simd::vvec3 e1(simd::load(block.e1[0]), simd::load(block.e1[1]), simd::load(block.e1[2]));
+		simd::vvec3 e2(simd::load(block.e2[0]), simd::load(block.e2[1]), simd::load(block.e2[2]));
+
+		simd::vfloat t, u, v;
+		simd::vfloat valid = simd::laneMask(end-k) & Mesh::intersect(a, e1, e2, origin, direction, vt_max, t, u, v);
+		if (simd::movemask(valid) != 0) return true;
+	}
+	return false;
+}
+
+/**
+  * All rays in the packet against one triangle at a time, using the precomputed edges
+  */
+inline void Mesh::PacketLeafIntersector::operator()(unsigned int first, unsigned int count, const simd::vfloat& mask, simd::vfloat& t_max) {
+	const simd::vvec3& o = packet.getOrigin();
+	const simd::vvec3& d = packet.getDirection();
+	RenderCounters::add(RenderCounters::TRIANGLE_TESTS, count*simd::laneCount(mask));
+
+	for (unsigned int k=first; k<first+count; ++k) {
+		const TriangleBlock& block = blocks[k/simd::width];
+		const unsigned int l = k%simd::width;
+		simd::vvec3 a(simd::vfloat(block.a[0][l]), simd::vfloat(block.a[1][l]), simd::vfloat(block.a[2][l]));
+		simd::vvec3 e1(simd::vfloat(block.e1[0][l]), simd::vfloat(block.e1[1][l]), simd::vfloat(block.e1[2][l]));
+		simd::vvec3 e2(simd::vfloat(block.e2[0][l]), simd::vfloat(block.e2[1][l]), simd::vfloat(block.e2[2][l]));
+
+		simd::vfloat t, u, v;
+		simd::vfloat valid = mask & Mesh::intersect(a, e1, e2, o, d, t_max, t, u, v);
+		int lanes = simd::movemask(valid);
+		if (lanes == 0) continue;
+
+		t_max = simd::select(valid, t, t_max);
+		for (unsigned int i=0; i<simd::width; ++i) {
+			if (!(lanes & (1 << i))) continue;
+			hits.hits[i].object = object;
+			hits.hits[i].primitive = k;
+			hits.hits[i].barycentric = glm::vec2(simd::get(u, i), simd::get(v, i));
+		}
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef _MIPTEXTURE_H__
+#define _MIPTEXTURE_H__
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+/**
+  * Mipmapped RGB texture for fast filtered lookups. Every level is stored in
+  * 4x4 texel blocks, and the blocks are ordered along a Morton (Z-order)
+  * curve, so the four texels of a bilinear lookup, and lookups close to each
+  * other, mostly share cache lines. Texels are four half floats (RGB and
+  * padding), so a texel is a single 8 byte load. Filtering uses SSE.
+  *
+  * The texels either belong to the texture (build()), or live in memory
+  * owned by someone else, such as a memory mapped cache file (attach()).
+  */
+class MipTexture {
+public:
+	MipTexture() {
+		texel_count = 0;
+		texels = NULL;
+	}
+
+	/**
+	  * Builds the texture and its mip pyramid (using a 2x2 box filter)
+	  * @param rgb width*height interleaved RGB texels, row by row
+	  */
+	void build(const float* rgb, unsigned int width, unsigned int height);
+
+	/**
+	  * Uses the texels of a texture of the given size that were stored
+	  * elsewhere, see getData(). The memory must outlive the texture.
+	  */
+	void attach(const void* data, unsigned int width, unsigned int height);
+
+	/**
+	  * Returns the texels of all levels, getDataSize() bytes
+	  */
+	inline const void* getData() const { return texels; }
+	inline size_t getDataSize() const { return levels.empty() ? 0 : 8*static_cast<size_t>(texel_count); }
+
+	inline unsigned int getWidth() const { return levels.empty() ? 0 : levels[0].width; }
+	inline unsigned int getHeight() const { return levels.empty() ? 0 : levels[0].height; }
+	inline unsigned int getLevelCount() const { return static_cast<unsigned int>(levels.size()); }
+
+	/**
+	  * Returns the texel (x, y) of a level
+	  */
+	glm::vec3 getTexel(unsigned int level, unsigned int x, unsigned int y) const;
+
+	/**
+	  * Trilinear lookup with clamp to edge addressing
+	  * @param s Horizontal texture coordinate in [0, 1]
+	  * @param t Vertical texture coordinate in [0, 1]
+	  * @param lod Level of detail, log2 of the footprint of the lookup in level 0 texels
+	  */
+	glm::vec3 sample(float s, float t, float lod) const;
+
+private:
+	MipTexture(const MipTexture&);
+	MipTexture& operator=(const MipTexture&);
+
+	struct Level {
+		unsigned int width, height;
+		unsigned int offset; //< Index of the first texel of the level
+	};
+
+	static const unsigned int block_bits = 2; //< Blocks are 4x4 texels
+
+	static unsigned int mortonCode(unsigned int x, unsigned int y);
+
+	/**
+	  * Computes the size and offset of all levels
+	  */
+	void layout(unsigned int width, unsigned int height);
+
+	inline unsigned int texel(const Level& level, unsigned int x, unsigned int y) const {
+		const unsigned int block = mortonCode(x >> block_bits, y >> block_bits);
+		const unsigned int mask = (1u << block_bits) - 1;
+		return level.offset + (block << (2*block_bits)) + ((y & mask) << block_bits) + (x & mask);
+	}
+
+	/**
+	  * Bilinear lookup in one level, the result is in the first three floats of out
+	  */
+	void bilinear(const Level& level, float s, float t, float* out) const;
+
+	std::vector<Level> levels;
+	unsigned int texel_count;
+	std::vector<unsigned short> storage; //< Texels built by this texture
+	const unsigned short* texels;
+};
+
+#endif
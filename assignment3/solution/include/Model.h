@@ -3,61 +3,26 @@
 
 #include <memory>
 #include <string>
-#include <vector>
-#include <map>
-
-#include <assimp.h>
-#include <aiPostProcess.h>
-#include <aiScene.h>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
-#include "SceneObject.hpp"
+#include "Instance.h"
 
-class Model : public SceneObject {
+/**
+  * Convenience for a mesh used once: loads the mesh, and places it centered
+  * at origin, scaled so that its smallest extent is scale
+  */
+class Model : public Instance {
 public:
-	Model(std::string filename, glm::vec3 origin, float scale, std::shared_ptr<SceneObjectEffect> effect);
-	~Model();
-	float intersect(const Ray& r);
-	
-	glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state);
-
-private:
-	struct Triangle {
-		Triangle() {
-			mesh = NULL;
-			face = NULL;
-		}
-		const aiMesh* mesh;
-		const aiFace* face;
-	};
-
-	static void findBBoxRecursive(const aiScene* scene, const aiNode* node, aiMatrix4x4* trafo, glm::vec3& min_dim, glm::vec3& max_dim);
-
-	static float intersect(const aiMesh* mesh, const aiFace* face, const Ray& r);
-	static void intersectRecursive(const aiScene* scene, const aiNode* node, aiMatrix4x4* trafo, const Ray& r, float& t, Triangle& tri);
-
-	const aiScene* scene;
-	
-	Ray worldToModel(const Ray& r) const;
-
-	glm::vec3 min_dim;
-	glm::vec3 max_dim;
-	glm::vec3 translation;
-	float scale;
-
-	std::map<int, Triangle> cache;
+	/**
+	  * @param use_cache Load from, or else write, <filename>.bvhcache
+	  */
+	Model(std::string filename, glm::vec3 origin, float scale, std::shared_ptr<SceneObjectEffect> effect, bool use_cache=true);
+
+	/**
+	  * Returns the transform that centers mesh at origin, with its smallest extent scaled to scale
+	  */
+	static glm::mat4 getPlacement(const Mesh& mesh, glm::vec3 origin, float scale);
 };
 
-//Scale the ray we intersect with instead of scaling the model...
-inline Ray Model::worldToModel(const Ray& r) const {
-	glm::vec3 p0 = r.getOrigin();
-	glm::vec3 l = r.getDirection();
-	p0 = (p0-translation)*scale;
-	l = l*scale;
-	
-	return Ray(p0, l);
-}
-
-#endif
\ No newline at end of file
+#endif
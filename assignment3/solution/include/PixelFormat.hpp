@@ -0,0 +1,302 @@
+#ifndef _PIXELFORMAT_HPP__
+#define _PIXELFORMAT_HPP__
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+/**
+  * Conversion between 32 bit floats and the compact framebuffer formats.
+  * All conversions work on groups of four values (or four pixels) with SSE2,
+  * and handle the remainder by padding it into a temporary group, so any
+  * count can be converted.
+  */
+namespace pixel {
+
+	/**
+	  * Converts four floats to half floats, rounding to nearest even.
+	  * Values too large for a half become infinity, NaNs stay NaNs.
+	  * The halves are returned in the low 16 bits of every 32 bit lane.
+	  */
+	inline __m128i floatToHalf(__m128 f) {
+		const __m128i sign_mask = _mm_set1_epi32(0x80000000);
+		const __m128i half_max = _mm_set1_epi32((127+16) << 23); //Everything above rounds to infinity
+		const __m128i min_normal = _mm_set1_epi32((127-14) << 23); //Smallest float that gives a normalized half
+		const __m128i subnormal_magic = _mm_set1_epi32(((127-15) + (23-10) + 1) << 23);
+		const __m128i normal_bias = _mm_set1_epi32(0xfff - ((127-15) << 23)); //Rebias the exponent and round
+
+		__m128 sign = _mm_and_ps(_mm_castsi128_ps(sign_mask), f);
+		__m128 abs_f = _mm_xor_ps(f, sign);
+		__m128i abs_i = _mm_castps_si128(abs_f);
+
+		__m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(abs_f, abs_f));
+		__m128i is_regular = _mm_cmpgt_epi32(half_max, abs_i);
+		__m128i is_subnormal = _mm_cmpgt_epi32(min_normal, abs_i);
+		__m128i inf_or_nan = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+		//Subnormal results: let the float adder do the rounding for us
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(abs_f, _mm_castsi128_ps(subnormal_magic))), subnormal_magic);
+
+		//Normal results: round to nearest even by adding one more if the lowest kept bit is set
+		__m128i odd = _mm_srai_epi32(_mm_slli_epi32(abs_i, 31-13), 31);
+		__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(abs_i, normal_bias), odd), 13);
+
+		__m128i result = _mm_or_si128(_mm_and_si128(is_subnormal, subnormal), _mm_andnot_si128(is_subnormal, normal));
+		result = _mm_or_si128(_mm_and_si128(is_regular, result), _mm_andnot_si128(is_regular, inf_or_nan));
+		return _mm_or_si128(result, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+	}
+
+	/**
+	  * Converts four half floats, stored in the low 16 bits of every 32 bit lane, to floats
+	  */
+	inline __m128 halfToFloat(__m128i h) {
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254-15) << 23));
+		const __m128 inf_nan_exponent = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+		__m128i exp_mantissa = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(h, exp_mantissa), 16);
+
+		//Shift into place, and rescale the exponent (this also normalizes subnormals)
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exp_mantissa, 13)), magic);
+		__m128 was_inf_nan = _mm_castsi128_ps(_mm_cmpgt_epi32(exp_mantissa, _mm_set1_epi32(0x7bff)));
+
+		return _mm_or_ps(_mm_or_ps(scaled, _mm_castsi128_ps(sign)), _mm_and_ps(was_inf_nan, inf_nan_exponent));
+	}
+
+	/**
+	  * Splits four interleaved RGB pixels (12 floats) into one vector per channel
+	  */
+	inline void deinterleave(const float* rgb, __m128& r, __m128& g, __m128& b) {
+		__m128 a0 = _mm_loadu_ps(rgb);   //r0 g0 b0 r1
+		__m128 a1 = _mm_loadu_ps(rgb+4); //g1 b1 r2 g2
+		__m128 a2 = _mm_loadu_ps(rgb+8); //b2 r3 g3 b3
+		r = _mm_shuffle_ps(a0, _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		g = _mm_shuffle_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(0, 0, 1, 1)),
+			_mm_shuffle_ps(a1, a2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		b = _mm_shuffle_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 1, 2, 2)),
+			_mm_shuffle_ps(a2, a2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	/**
+	  * Inverse of deinterleave
+	  */
+	inline void interleave(const __m128& r, const __m128& g, const __m128& b, float* rgb) {
+		_mm_storeu_ps(rgb, _mm_shuffle_ps(_mm_shuffle_ps(r, g, _MM_SHUFFLE(0, 0, 0, 0)),
+			_mm_shuffle_ps(b, r, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(rgb+4, _mm_shuffle_ps(_mm_shuffle_ps(g, b, _MM_SHUFFLE(1, 1, 1, 1)),
+			_mm_shuffle_ps(r, g, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(rgb+8, _mm_shuffle_ps(_mm_shuffle_ps(b, r, _MM_SHUFFLE(3, 3, 2, 2)),
+			_mm_shuffle_ps(g, b, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+
+	/**
+	  * Returns 2^e for integer exponents in [-126, 127]
+	  */
+	inline __m128 exp2i(__m128i e) {
+		return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+	}
+
+	/**
+	  * Returns floor(log2(x)) for positive, normalized x
+	  */
+	inline __m128i log2i(__m128 x) {
+		return _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(x), 23), _mm_set1_epi32(127));
+	}
+
+	inline __m128i max(__m128i a, __m128i b) {
+		__m128i a_greater = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(a_greater, a), _mm_andnot_si128(a_greater, b));
+	}
+
+	/**
+	  * Encodes four pixels as RGB9E5: a 9 bit mantissa per channel and a
+	  * shared 5 bit exponent. Negative values and NaNs become zero,
+	  * values above 65408 are clamped.
+	  */
+	inline __m128i encodeRGB9E5(__m128 r, __m128 g, __m128 b) {
+		const __m128 max_value = _mm_set1_ps(65408.0f); //(2^9-1)/2^9 * 2^(31-15)
+		r = _mm_min_ps(_mm_max_ps(r, _mm_setzero_ps()), max_value);
+		g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), max_value);
+		b = _mm_min_ps(_mm_max_ps(b, _mm_setzero_ps()), max_value);
+		__m128 max_rgb = _mm_max_ps(_mm_max_ps(r, g), b);
+
+		//Shared exponent, biased by 15, such that the largest channel gets a 9 bit mantissa
+		__m128i exponent = _mm_add_epi32(max(log2i(max_rgb), _mm_set1_epi32(-16)), _mm_set1_epi32(16));
+		__m128 scale = exp2i(_mm_sub_epi32(_mm_set1_epi32(15+9), exponent));
+
+		//Rounding the largest channel may overflow the mantissa, then use the next exponent
+		__m128i overflow = _mm_cmpeq_epi32(_mm_cvtps_epi32(_mm_mul_ps(max_rgb, scale)), _mm_set1_epi32(512));
+		exponent = _mm_sub_epi32(exponent, overflow);
+		scale = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(overflow), _mm_mul_ps(scale, _mm_set1_ps(0.5f))),
+			_mm_andnot_ps(_mm_castsi128_ps(overflow), scale));
+
+		__m128i result = _mm_cvtps_epi32(_mm_mul_ps(r, scale));
+		result = _mm_or_si128(result, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(g, scale)), 9));
+		result = _mm_or_si128(result, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(b, scale)), 18));
+		return _mm_or_si128(result, _mm_slli_epi32(exponent, 27));
+	}
+
+	inline void decodeRGB9E5(__m128i p, __m128& r, __m128& g, __m128& b) {
+		const __m128i mask = _mm_set1_epi32(0x1ff);
+		__m128 scale = exp2i(_mm_sub_epi32(_mm_srli_epi32(p, 27), _mm_set1_epi32(15+9)));
+		r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask)), scale);
+		g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 9), mask)), scale);
+		b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 18), mask)), scale);
+	}
+
+	/**
+	  * Encodes four pixels as Ward's RGBE: an 8 bit mantissa per channel and a
+	  * shared 8 bit exponent, stored as r | g << 8 | b << 16 | e << 24.
+	  * Negative values and NaNs become zero.
+	  */
+	inline __m128i encodeRGBE(__m128 r, __m128 g, __m128 b) {
+		const __m128 max_value = _mm_set1_ps(1.0e38f);
+		r = _mm_min_ps(_mm_max_ps(r, _mm_setzero_ps()), max_value);
+		g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), max_value);
+		b = _mm_min_ps(_mm_max_ps(b, _mm_setzero_ps()), max_value);
+		__m128 max_rgb = _mm_max_ps(_mm_max_ps(r, g), b);
+
+		//Same as frexp: max_rgb = m*2^e with m in [0.5, 1)
+		__m128i e = _mm_add_epi32(log2i(max_rgb), _mm_set1_epi32(1));
+		__m128 scale = exp2i(_mm_sub_epi32(_mm_set1_epi32(8), e));
+
+		__m128i result = _mm_cvttps_epi32(_mm_mul_ps(r, scale));
+		result = _mm_or_si128(result, _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(g, scale)), 8));
+		result = _mm_or_si128(result, _mm_slli_epi32(_mm_cvttps_epi32(_mm_mul_ps(b, scale)), 16));
+		result = _mm_or_si128(result, _mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(128)), 24));
+
+		//Too small to represent: store black
+		__m128 is_zero = _mm_cmplt_ps(max_rgb, _mm_set1_ps(1.0e-32f));
+		return _mm_andnot_si128(_mm_castps_si128(is_zero), result);
+	}
+
+	inline void decodeRGBE(__m128i p, __m128& r, __m128& g, __m128& b) {
+		const __m128i mask = _mm_set1_epi32(0xff);
+		__m128i e = _mm_srli_epi32(p, 24);
+		//Reconstruct the middle of the quantization interval. e == 0 is black
+		__m128 scale = exp2i(_mm_sub_epi32(e, _mm_set1_epi32(128+8)));
+		scale = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(e, _mm_setzero_si128())), scale);
+		const __m128 half = _mm_set1_ps(0.5f);
+		r = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask)), half), scale);
+		g = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), mask)), half), scale);
+		b = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), mask)), half), scale);
+	}
+
+	/**
+	  * Converts n floats to half floats
+	  */
+	inline void encodeHalf(const float* src, unsigned short* dst, unsigned int n) {
+		unsigned int k = 0;
+		for (; k+8 <= n; k+=8) {
+			//Sign extend the halves, so that the saturating pack keeps all 16 bits
+			__m128i lo = _mm_srai_epi32(_mm_slli_epi32(floatToHalf(_mm_loadu_ps(src+k)), 16), 16);
+			__m128i hi = _mm_srai_epi32(_mm_slli_epi32(floatToHalf(_mm_loadu_ps(src+k+4)), 16), 16);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+k), _mm_packs_epi32(lo, hi));
+		}
+		for (; k < n; k+=4) {
+			float tmp[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			unsigned int m = (n-k < 4) ? n-k : 4;
+			for (unsigned int i=0; i<m; ++i) tmp[i] = src[k+i];
+			unsigned int out[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), floatToHalf(_mm_loadu_ps(tmp)));
+			for (unsigned int i=0; i<m; ++i) dst[k+i] = static_cast<unsigned short>(out[i]);
+		}
+	}
+
+	/**
+	  * Converts n half floats to floats
+	  */
+	inline void decodeHalf(const unsigned short* src, float* dst, unsigned int n) {
+		unsigned int k = 0;
+		for (; k+8 <= n; k+=8) {
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src+k));
+			_mm_storeu_ps(dst+k, halfToFloat(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+			_mm_storeu_ps(dst+k+4, halfToFloat(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+		}
+		for (; k < n; k+=4) {
+			unsigned int tmp[4] = { 0, 0, 0, 0 };
+			unsigned int m = (n-k < 4) ? n-k : 4;
+			for (unsigned int i=0; i<m; ++i) tmp[i] = src[k+i];
+			float out[4];
+			_mm_storeu_ps(out, halfToFloat(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tmp))));
+			for (unsigned int i=0; i<m; ++i) dst[k+i] = out[i];
+		}
+	}
+
+	/**
+	  * Encodes n interleaved RGB pixels with a shared exponent encoder (encodeRGB9E5 or encodeRGBE)
+	  */
+	template <__m128i (*Encode)(__m128, __m128, __m128)>
+	inline void encodeShared(const float* rgb, unsigned int* dst, unsigned int n) {
+		__m128 r, g, b;
+		unsigned int k = 0;
+		for (; k+4 <= n; k+=4) {
+			deinterleave(rgb+3*k, r, g, b);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+k), Encode(r, g, b));
+		}
+		if (k < n) {
+			float tmp[12] = { 0.0f };
+			unsigned int out[4];
+			for (unsigned int i=0; i<3*(n-k); ++i) tmp[i] = rgb[3*k+i];
+			deinterleave(tmp, r, g, b);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), Encode(r, g, b));
+			for (unsigned int i=0; i<n-k; ++i) dst[k+i] = out[i];
+		}
+	}
+
+	/**
+	  * Decodes n shared exponent pixels (decodeRGB9E5 or decodeRGBE) to interleaved RGB
+	  */
+	template <void (*Decode)(__m128i, __m128&, __m128&, __m128&)>
+	inline void decodeShared(const unsigned int* src, float* rgb, unsigned int n) {
+		__m128 r, g, b;
+		unsigned int k = 0;
+		for (; k+4 <= n; k+=4) {
+			Decode(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+k)), r, g, b);
+			interleave(r, g, b, rgb+3*k);
+		}
+		if (k < n) {
+			unsigned int tmp[4] = { 0, 0, 0, 0 };
+			float out[12];
+			for (unsigned int i=0; i<n-k; ++i) tmp[i] = src[k+i];
+			Decode(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tmp)), r, g, b);
+			interleave(r, g, b, out);
+			for (unsigned int i=0; i<3*(n-k); ++i) rgb[3*k+i] = out[i];
+		}
+	}
+
+	/**
+	  * Splits n interleaved RGB pixels into three planes
+	  */
+	inline void encodePlanar(const float* rgb, float* r, float* g, float* b, unsigned int n) {
+		__m128 vr, vg, vb;
+		unsigned int k = 0;
+		for (; k+4 <= n; k+=4) {
+			deinterleave(rgb+3*k, vr, vg, vb);
+			_mm_storeu_ps(r+k, vr);
+			_mm_storeu_ps(g+k, vg);
+			_mm_storeu_ps(b+k, vb);
+		}
+		for (; k < n; ++k) {
+			r[k] = rgb[3*k];
+			g[k] = rgb[3*k+1];
+			b[k] = rgb[3*k+2];
+		}
+	}
+
+	/**
+	  * Merges three planes into n interleaved RGB pixels
+	  */
+	inline void decodePlanar(const float* r, const float* g, const float* b, float* rgb, unsigned int n) {
+		unsigned int k = 0;
+		for (; k+4 <= n; k+=4) {
+			interleave(_mm_loadu_ps(r+k), _mm_loadu_ps(g+k), _mm_loadu_ps(b+k), rgb+3*k);
+		}
+		for (; k < n; ++k) {
+			rgb[3*k] = r[k];
+			rgb[3*k+1] = g[k];
+			rgb[3*k+2] = b[k];
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _PROGRESSREPORTER_H__
+#define _PROGRESSREPORTER_H__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+
+#include "RenderCounters.h"
+#include "Timer.h"
+
+/**
+  * Prints the progress of a render, its ray rate and the estimated time
+  * left at a fixed interval, from a thread of its own. The reporter only
+  * reads the progress the render threads publish in RenderCounters, so it
+  * never blocks them, and all output comes from one thread in order.
+  * Reporting stops when the reporter is destroyed.
+  */
+class ProgressReporter {
+public:
+	/**
+	  * @param counters Counters of the render, which must outlive the reporter
+	  * @param n_tiles Number of tiles in the render
+	  * @param interval Seconds between reports
+	  */
+	ProgressReporter(const RenderCounters& counters, unsigned int n_tiles, double interval, std::ostream& out);
+	~ProgressReporter();
+
+private:
+	ProgressReporter(const ProgressReporter&);
+	ProgressReporter& operator=(const ProgressReporter&);
+
+	void run();
+
+	const RenderCounters& counters;
+	unsigned int n_tiles;
+	double interval;
+	std::ostream& out;
+	Timer timer;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopped;
+	std::thread thread;
+};
+
+#endif
@@ -5,10 +5,20 @@
 
 class Ray {
 public:
-	Ray(glm::vec3 origin, glm::vec3 direction) {
+	/**
+	  * Creates an uninitialized ray, for use in arrays
+	  */
+	Ray() {}
+
+	/**
+	  * @param cone_angle Spread angle (in radians) of the cone of directions the ray stands for
+	  */
+	Ray(glm::vec3 origin, glm::vec3 direction, float cone_angle=0.0f) {
 		this->origin = origin;
 		this->direction = direction;
+		this->cone_angle = cone_angle;
 		depth = 0;
+		weight = glm::vec3(1.0f);
 	}
 
 	/**
@@ -21,27 +31,40 @@ public:
 	  */
 	inline const glm::vec3& getDirection() const { return direction; }
 
-	inline Ray spawn(float t, glm::vec3 d) const {
-		Ray r(getOrigin()+t*getDirection(), d);
-		r.depth = this->depth + 1;
-		return r;
-	}
+	/**
+	  * Returns the number of bounces since the primary ray
+	  */
+	inline unsigned int getDepth() const { return depth; }
 
-	inline bool isValid() const {
-		return (depth <= max_depth);
-	}
+	/**
+	  * Returns the fraction of the color seen along this ray that reaches the primary ray
+	  */
+	inline const glm::vec3& getWeight() const { return weight; }
+
+	/**
+	  * Returns the spread angle of the ray cone, used to pick the level of
+	  * detail of texture lookups (see Igehy, "Tracing Ray Differentials")
+	  */
+	inline float getConeAngle() const { return cone_angle; }
 
-	inline void invalidate() {
-		this->depth = max_depth;
+	/**
+	  * Creates a secondary ray starting at origin + t*direction
+	  * @param weight Fraction of the color of the new ray that reaches this ray
+	  */
+	inline Ray spawn(float t, glm::vec3 d, glm::vec3 weight=glm::vec3(1.0f)) const {
+		//Surfaces are treated as flat, so the cone keeps its spread angle
+		Ray r(getOrigin()+t*getDirection(), d, cone_angle);
+		r.depth = this->depth + 1;
+		r.weight = this->weight*weight;
+		return r;
 	}
 
 private:
-	friend class RayTracer;
-
-	static const unsigned int max_depth = 7;
 	unsigned int depth;
 	glm::vec3 origin;
 	glm::vec3 direction;
+	glm::vec3 weight;
+	float cone_angle;
 };
 
 #endif
\ No newline at end of file
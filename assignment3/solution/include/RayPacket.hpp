@@ -0,0 +1,69 @@
+#ifndef _RAYPACKET_HPP__
+#define _RAYPACKET_HPP__
+
+#include <glm/glm.hpp>
+
+#include "Ray.hpp"
+#include "SIMD.hpp"
+
+/**
+  * A packet of simd::width primary rays stored as structure of arrays, so that
+  * one SIMD instruction operates on all the rays at once. Lanes that are not
+  * in use are masked out by getActive().
+  */
+class RayPacket {
+public:
+	/**
+	  * Creates a packet from count <= simd::width rays
+	  * @param cone_angle Spread angle of the rays, see Ray::getConeAngle()
+	  */
+	RayPacket(const glm::vec3* origins, const glm::vec3* directions, unsigned int count, float cone_angle=0.0f) {
+		float o[3][simd::width];
+		float d[3][simd::width];
+
+		for (unsigned int i=0; i<simd::width; ++i) {
+			//Unused lanes get a copy of the first ray so they never produce NaNs
+			unsigned int k = (i < count) ? i : 0;
+			for (unsigned int c=0; c<3; ++c) {
+				o[c][i] = origins[k][c];
+				d[c][i] = directions[k][c];
+			}
+		}
+
+		origin = simd::vvec3(simd::load(o[0]), simd::load(o[1]), simd::load(o[2]));
+		direction = simd::vvec3(simd::load(d[0]), simd::load(d[1]), simd::load(d[2]));
+		active = simd::laneMask(count);
+		this->cone_angle = cone_angle;
+	}
+
+	RayPacket(const simd::vvec3& origin, const simd::vvec3& direction, const simd::vfloat& active, float cone_angle=0.0f) {
+		this->origin = origin;
+		this->direction = direction;
+		this->active = active;
+		this->cone_angle = cone_angle;
+	}
+
+	inline const simd::vvec3& getOrigin() const { return origin; }
+	inline const simd::vvec3& getDirection() const { return direction; }
+
+	/**
+	  * Returns a mask of the lanes that hold a ray
+	  */
+	inline const simd::vfloat& getActive() const { return active; }
+
+	/**
+	  * Returns the ray in lane i as an ordinary ray
+	  */
+	inline Ray getRay(unsigned int i) const {
+		return Ray(glm::vec3(simd::get(origin.x, i), simd::get(origin.y, i), simd::get(origin.z, i)),
+			glm::vec3(simd::get(direction.x, i), simd::get(direction.y, i), simd::get(direction.z, i)), cone_angle);
+	}
+
+private:
+	simd::vvec3 origin;
+	simd::vvec3 direction;
+	simd::vfloat active;
+	float cone_angle;
+};
+
+#endif
@@ -4,13 +4,33 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <functional>
 
 #include "FrameBuffer.hpp"
 #include "SceneObject.hpp"
 #include "RayTracerState.hpp"
+#include "TileScheduler.h"
+#include "WavefrontTracer.h"
+#include "RenderCounters.h"
+#include "Coordinator.h"
+#include "Checkpoint.h"
 
 class RayTracer {
 public:
+	/**
+	  * Statistics of the last frame rendered
+	  */
+	struct Statistics {
+		double seconds; //< Wall time of the frame, including prepare()
+		double first_tile_seconds; //< Time until the first tile was rendered, restored tiles are left out
+		unsigned long long primary_rays; //< Rays traced by this run, without those of restored tiles
+		unsigned long long secondary_rays;
+		unsigned int restored_tiles; //< Tiles taken from the checkpoint of an interrupted render
+		unsigned long long restored_samples; //< Primary rays of the restored tiles
+		unsigned int threads;
+		RenderCounters::Totals counters;
+	};
+
 	RayTracer(unsigned int width, unsigned int height);
 
 	/**
@@ -23,16 +43,259 @@ public:
 	  */
 	void render();
 
+	/**
+	  * Renders the current scene straight to an image file (.ppm or .pfm),
+	  * writing every tile as soon as it is done. The full frame is never held
+	  * in memory, so the resolution is limited only by disk space.
+	  */
+	void renderToFile(std::string filename);
+
+	/**
+	  * Renders an animation of frames frames. Before every frame, update(frame)
+	  * is called to move the camera and objects; everything else (loaded
+	  * meshes and textures, acceleration structures, the framebuffer) stays
+	  * resident, so the cost per frame is just rendering it. Frame n is
+	  * saved as basename followed by n in four digits and extension, which is
+	  * streamed to disk tile by tile if it is .ppm or .pfm.
+	  *
+	  * With a checkpoint file, every frame gets its own, numbered the same
+	  * way. Resuming skips the frames that are done, and continues the
+	  * interrupted one from its checkpoint.
+	  */
+	void renderSequence(unsigned int frames, const std::function<void(unsigned int frame)>& update,
+		std::string basename, std::string extension);
+
+	/**
+	  * Renders the current scene on the workers of coordinator, and saves it
+	  * as filename, which is streamed to disk chunk by chunk if it is .ppm or
+	  * .pfm. Nothing is rendered by this process.
+	  */
+	void renderDistributed(Coordinator& coordinator, std::string filename);
+
+	/**
+	  * Works for the coordinator listening on port of host: renders the
+	  * chunks it hands out with all threads and sends them back, until the
+	  * coordinator says to stop or closes the connection. The scene has to
+	  * be the same as the one the coordinator is meant to render. So do all
+	  * settings, or the coordinator turns the worker away. The scene is
+	  * prepared once, when connecting; chunks write no summary or checkpoint.
+	  */
+	void serve(const std::string& host, unsigned short port);
+
+	/**
+	  * Places the camera, which looks down its negative z axis
+	  * @param camera_to_world Rigid transform from camera space to world space
+	  */
+	inline void setCamera(const glm::mat4& camera_to_world) { state->setCamera(camera_to_world); }
+
+	/**
+	  * Enables or disables tracing primary rays in SIMD packets
+	  */
+	inline void setPacketTracing(bool enable) { packet_tracing = enable; }
+
+	/**
+	  * Sets the size of the tiles the image is split into for rendering
+	  */
+	inline void setTileSize(unsigned int size) { tile_size = size; }
+
+	/**
+	  * Enables or disables the wavefront engine, which traces whole generations
+	  * of rays per tile and shades them sorted by effect. Adaptive sampling
+	  * takes precedence, as it decides on more samples one pixel at a time.
+	  */
+	inline void setWavefront(bool enable) { wavefront = enable; }
+
+	/**
+	  * Sets the maximum number of bounces after the primary ray
+	  */
+	inline void setMaxDepth(unsigned int depth) { state->setMaxDepth(depth); }
+
+	/**
+	  * Sets the contribution below which secondary rays are dropped, see
+	  * RayTracerState::setContributionThreshold
+	  */
+	inline void setContributionThreshold(float threshold) { state->setContributionThreshold(threshold); }
+
+	/**
+	  * Enables or disables Russian roulette for secondary rays
+	  */
+	inline void setRussianRoulette(bool enable) { state->setRussianRoulette(enable); }
+
+	/**
+	  * Sets the storage format of the framebuffer used by render() and save().
+	  * The compact formats trade precision for memory on large renders.
+	  */
+	inline void setFrameBufferFormat(FrameBuffer::Format format) { fb_format = format; }
+
+	/**
+	  * Sets the number of render threads, 0 means one per hardware thread
+	  */
+	inline void setThreadCount(unsigned int count) { n_threads = count; }
+
+	/**
+	  * Enables adaptive supersampling: every pixel starts with min_samples
+	  * samples, and more stratified samples are added until the standard error
+	  * of the pixel's luminance drops below threshold, or max_samples is reached.
+	  */
+	void setAdaptiveSampling(unsigned int min_samples, unsigned int max_samples, float threshold);
+
+	/**
+	  * Disables adaptive supersampling, using the four fixed multisamples for every pixel
+	  */
+	inline void disableAdaptiveSampling() { adaptive.enabled = false; }
+
+	/**
+	  * Enables or disables printing progress while rendering, and statistics after every frame
+	  */
+	inline void setVerbose(bool enable) { verbose = enable; }
+
+	/**
+	  * Sets the seconds between progress reports when verbose, 0 disables them
+	  */
+	inline void setProgressInterval(double seconds) { progress_interval = seconds; }
+
+	/**
+	  * Sets a file that the statistics of every frame are written to as JSON,
+	  * replacing those of the frame before. Empty (the default) writes nothing.
+	  */
+	inline void setSummaryFile(std::string filename) { summary_file = filename; }
+
+	/**
+	  * Sets a file that finished tiles are logged to while rendering, see
+	  * Checkpoint. It is removed once the image is saved. Empty (the
+	  * default) disables checkpoints.
+	  */
+	inline void setCheckpointFile(std::string filename) { checkpoint_file = filename; }
+
+	/**
+	  * Sets the seconds between writing the checkpoint to disk, and so the
+	  * most work an interruption can lose
+	  */
+	inline void setCheckpointInterval(double seconds) { checkpoint_interval = seconds; }
+
+	/**
+	  * Enables or disables resuming: the tiles in the checkpoint file of an
+	  * interrupted render with the same settings are used instead of
+	  * rendered. The scene must be the same as well, which is not checked.
+	  */
+	inline void setResume(bool enable) { resume = enable; }
+
+	inline const Statistics& getStatistics() const { return statistics; }
+
 	/**
 	  * Saves the currently rendered frame as an image file
 	  */
 	void save(std::string basename, std::string extension);
 
 private:
+	/**
+	  * Saves the currently rendered frame as filename, overwriting it
+	  */
+	void saveImage(const std::string& filename);
+
+	/**
+	  * Computes the primary ray through the point (x, y) in pixel coordinates
+	  */
+	void getPrimaryRay(float x, float y, glm::vec3& origin, glm::vec3& direction);
+
+	/**
+	  * Returns the spread angle of a primary ray: the angle between the rays
+	  * through neighbouring multisamples, half a pixel apart
+	  */
+	inline float getPrimaryConeAngle() const { return 0.5f*(screen.top-screen.bottom)/static_cast<float>(height); }
+
+	/**
+	  * Renders all tiles of region in parallel, calling output for every
+	  * finished tile
+	  * @param format The format output keeps the tiles in, and so the checkpoint stores them in
+	  * @param frame Whether region is a frame of its own rather than a chunk
+	  *        served to a coordinator. A frame prepares the scene first, uses
+	  *        the checkpoint file if one is set, and writes the summary file.
+	  */
+	void renderTiles(const Tile& region, FrameBuffer::Format format, bool frame,
+		const std::function<void(const Tile&, FrameBuffer&)>& output);
+
+	/**
+	  * Calls prepare() on all objects of the scene
+	  */
+	void prepareScene();
+
+	/**
+	  * Returns the key of the checkpoints of the current settings: a hash of
+	  * everything but the scene that changes what a tile looks like. Workers
+	  * send it to the coordinator, which turns away those that do not match.
+	  */
+	unsigned long long getCheckpointKey(FrameBuffer::Format format) const;
+
+	/**
+	  * Removes the checkpoint file, after the image is saved
+	  */
+	void removeCheckpoint() const;
+
+	/**
+	  * Returns the whole image as a region for renderTiles()
+	  */
+	inline Tile getImageRegion() const {
+		Tile region = { 0, 0, width, height, 0 };
+		return region;
+	}
+
+	/**
+	  * Renders all pixels of a tile into out, which has the size of the tile
+	  */
+	void renderTile(const Tile& tile, FrameBuffer& out);
+
+	/**
+	  * Renders all pixels of a tile using the wavefront engine
+	  * @param arena Buffers of the calling thread
+	  */
+	void renderWavefront(const Tile& tile, FrameBuffer& out, WavefrontTracer::Arena& arena);
+
+	/**
+	  * Writes the statistics of the last frame to the summary file as JSON
+	  */
+	void writeSummary() const;
+
+	/**
+	  * Renders pixel (i, j) with adaptive supersampling
+	  * @param n_samples Set to the number of samples used
+	  */
+	glm::vec3 renderPixelAdaptive(unsigned int i, unsigned int j, unsigned int& n_samples, RayTree& tree);
+
+	/**
+	  * Renders line j of tile into out using ray packets
+	  */
+	void renderPackets(const Tile& tile, unsigned int j, FrameBuffer& out, RayTree& tree);
+
 	std::shared_ptr<FrameBuffer> fb;
+	FrameBuffer::Format fb_format;
 	std::shared_ptr<RayTracerState> state;
+	unsigned int width, height;
 
 	glm::vec2 multisample[4];
+	bool packet_tracing;
+	bool wavefront;
+	unsigned int tile_size;
+	unsigned int n_threads;
+	bool verbose;
+	double progress_interval;
+	std::string summary_file;
+	std::string checkpoint_file;
+	double checkpoint_interval;
+	bool resume;
+	Statistics statistics;
+
+	/**
+	  * Settings for adaptive supersampling, with sample_offsets holding
+	  * the progressive, stratified sample positions within a pixel
+	  */
+	struct {
+		bool enabled;
+		unsigned int min_samples;
+		unsigned int max_samples;
+		float threshold;
+		std::vector<glm::vec2> sample_offsets;
+	} adaptive;
 
 	/**
 	  * Defines the virtual screen we project our rays through
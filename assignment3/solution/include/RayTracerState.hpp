@@ -2,57 +2,289 @@
 #define _RAYTRACER_STATE_HPP__
 
 #include <memory>
+#include <limits>
+#include <cstring>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 #include "SceneObject.hpp"
+#include "RenderCounters.h"
 
 class RayTracerState {
 public:
 	RayTracerState(glm::vec3 camera_position) {
 		this->camera_position = camera_position;
+		camera_rotation = glm::mat3(1.0f);
+		max_depth = 7;
+		contribution_threshold = 0.01f;
+		russian_roulette = false;
 	}
 	
 	inline std::vector<std::shared_ptr<SceneObject> >& getScene() { return scene; }
 	inline glm::vec3 getCamPos() { return camera_position; }
+	inline const glm::mat3& getCamRotation() const { return camera_rotation; }
 
 	/**
-	  * Performs raycasting on the scene for the ray ray
-	  * @param ray The ray to raycast with
-	  * @param t The parameter so that t*ray gives the first intersection point
-	  * @return -1 if no intersection found, otherwise the object index in the scene
+	  * Places the camera. The camera looks down its negative z axis, with y up.
+	  * @param camera_to_world Rigid transform from camera space to world space
 	  */
-	inline glm::vec3 rayTrace(Ray& ray) {
-		const float z_offset = 10e-4f;
+	inline void setCamera(const glm::mat4& camera_to_world) {
+		camera_position = glm::vec3(camera_to_world[3]);
+		camera_rotation = glm::mat3(camera_to_world);
+	}
 
-		float t = -1;
-		float t_min = std::numeric_limits<float>::max();
-		int k_min=-1;
+	inline glm::vec3 getBackground() { return glm::vec3(0.3f); }
 
-		if (!ray.isValid()) return glm::vec3(0.0f);
+	/**
+	  * Sets the maximum number of bounces traced after the primary ray
+	  */
+	inline void setMaxDepth(unsigned int depth) { max_depth = depth; }
+	inline unsigned int getMaxDepth() const { return max_depth; }
+
+	/**
+	  * Secondary rays that contribute less than threshold to the primary ray
+	  * (in every color channel) are dropped, or with Russian roulette, kept
+	  * with a probability proportional to their contribution.
+	  */
+	inline void setContributionThreshold(float threshold) { contribution_threshold = threshold; }
+	inline float getContributionThreshold() const { return contribution_threshold; }
+
+	/**
+	  * Enables Russian roulette: rays below the contribution threshold are
+	  * randomly kept instead of dropped, and effects that split a ray (like
+	  * Fresnel) follow only one of the branches. This keeps the image unbiased
+	  * whilst tracing at most one secondary ray per bounce, at the cost of noise.
+	  */
+	inline void setRussianRoulette(bool enable) { russian_roulette = enable; }
+	inline bool useRussianRoulette() const { return russian_roulette; }
+
+	/**
+	  * Finds the closest intersection between ray and the scene
+	  * @param ray The ray to raycast with
+	  * @return The closest intersection, with object set to NULL if none found
+	  */
+	inline HitRecord intersect(const Ray& ray) {
+		HitRecord closest;
+		float t_max = std::numeric_limits<float>::infinity();
 
 		//Loop through all the objects, to find the closest intersection, if any
 		//This is essentially just ray-casting
 		for (unsigned int k=0; k<scene.size(); ++k) {
-			t = scene.at(k)->intersect(ray);
-
-			if (t > z_offset && t <= t_min) {
-				k_min = k;
-				t_min = t;
+			HitRecord hit = scene[k]->intersect(ray, t_max);
+			if (hit.isHit()) {
+				closest = hit;
+				t_max = hit.t;
 			}
 		}
 
-		if (k_min >= 0) {
-			return scene.at(k_min)->rayTrace(ray, t_min, *this);
-		}
-		else {
-			return glm::vec3(0.3f);
+		return closest;
+	}
+
+	/**
+	  * Tests whether anything in the scene blocks ray before t_max, stopping
+	  * at the first intersection found and shading nothing
+	  * @return The object that blocks the ray, or NULL
+	  */
+	inline SceneObject* occluded(const Ray& ray, float t_max) {
+		for (unsigned int k=0; k<scene.size(); ++k) {
+			SceneObject* occluder = scene[k]->occluded(ray, t_max);
+			if (occluder) return occluder;
 		}
+		return NULL;
 	}
 
+	/**
+	  * Performs ray tracing of the scene for the ray ray
+	  * @param ray The ray to trace
+	  * @param tree Holds the secondary rays, reused between calls by the same thread
+	  * @return The color seen along the ray
+	  */
+	inline glm::vec3 rayTrace(const Ray& ray, RayTree& tree);
+
+	/**
+	  * Performs ray tracing of a packet of primary rays. Intersection is done
+	  * for all rays in the packet at once, whilst shading (and thereby any
+	  * secondary rays) is done one ray at a time.
+	  * @param packet The rays to trace
+	  * @param colors Set to the color seen along each active ray in the packet
+	  * @param tree Holds the secondary rays, reused between calls by the same thread
+	  */
+	inline void rayTrace(const RayPacket& packet, glm::vec3* colors, RayTree& tree);
 
 private:
 	std::vector<std::shared_ptr<SceneObject> > scene;
 	glm::vec3 camera_position;
+	glm::mat3 camera_rotation;
+	unsigned int max_depth;
+	float contribution_threshold;
+	bool russian_roulette;
+};
+
+/**
+  * Evaluates all rays spawned from one primary ray iteratively, using an
+  * explicit stack instead of recursion. Shading returns only the light leaving
+  * the surface directly, and hands secondary rays to spawn() together with the
+  * fraction of their color that reaches the primary ray. Every thread uses its
+  * own tree, so no state is shared between threads.
+  */
+class RayTree {
+public:
+	RayTree(RayTracerState& state) : state(state) {
+		stack.reserve(initial_stack_size);
+		rng = 1;
+		last_occluder = NULL;
+	}
+
+	inline RayTracerState& getState() { return state; }
+
+	inline bool useRussianRoulette() const { return state.useRussianRoulette(); }
+
+	/**
+	  * Returns a uniform random number in [0, 1)
+	  */
+	inline float random() {
+		//xorshift32
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return (rng >> 8)*(1.0f/16777216.0f);
+	}
+
+	/**
+	  * Adds the ray from parent.getOrigin() + t*parent.getDirection() in direction
+	  * d to the tree, unless it is too deep or contributes too little
+	  * @param weight Fraction of the color of the new ray that reaches the parent
+	  */
+	inline void spawn(const Ray& parent, float t, glm::vec3 d, glm::vec3 weight) {
+		if (parent.getDepth() >= state.getMaxDepth()) return;
+
+		Ray ray = parent.spawn(t, d, weight);
+		const glm::vec3& w = ray.getWeight();
+		float contribution = std::max(std::max(w.x, w.y), w.z);
+		if (contribution < state.getContributionThreshold()) {
+			if (!state.useRussianRoulette() || contribution <= 0.0f) return;
+			float p = contribution/state.getContributionThreshold();
+			if (random() >= p) return;
+			ray = parent.spawn(t, d, weight/p);
+		}
+
+		stack.push_back(ray);
+	}
+
+	/**
+	  * Tests whether anything blocks ray before t_max, for shadow rays. The
+	  * object that blocked the last shadow ray of this tree is tested first:
+	  * neighbouring shadow rays are mostly blocked by the same object.
+	  */
+	inline bool occluded(const Ray& ray, float t_max) {
+		RenderCounters::add(RenderCounters::SHADOW_RAYS);
+		if (last_occluder && last_occluder->occluded(ray, t_max)) {
+			RenderCounters::add(RenderCounters::OCCLUDER_CACHE_HITS);
+			return true;
+		}
+		SceneObject* occluder = state.occluded(ray, t_max);
+		if (occluder) last_occluder = occluder;
+		return occluder != NULL;
+	}
+
+	/**
+	  * Removes the most recently spawned ray
+	  * @return false if there are no rays left
+	  */
+	inline bool pop(Ray& ray) {
+		if (stack.empty()) return false;
+		ray = stack.back();
+		stack.pop_back();
+		return true;
+	}
+
+	/**
+	  * Seeds the random numbers from a ray, so that Russian roulette gives the
+	  * same result regardless of which thread traces the ray
+	  */
+	inline void seed(const Ray& ray) {
+		const float seed_data[6] = { ray.getOrigin().x, ray.getOrigin().y, ray.getOrigin().z,
+			ray.getDirection().x, ray.getDirection().y, ray.getDirection().z };
+		unsigned int bits[6];
+		std::memcpy(bits, seed_data, sizeof(bits));
+		rng = 2166136261u;
+		for (unsigned int k=0; k<6; ++k) rng = (rng ^ bits[k])*16777619u;
+		if (rng == 0) rng = 1;
+	}
+
+	/**
+	  * Traces the primary ray and all rays spawned from it
+	  */
+	inline glm::vec3 trace(const Ray& ray) {
+		seed(ray);
+		stack.push_back(ray);
+		return traceStack();
+	}
+
+	/**
+	  * Shades the known intersection hit of the primary ray, and traces all rays spawned from it
+	  */
+	inline glm::vec3 trace(Ray& ray, const HitRecord& hit) {
+		RenderCounters::addRays(ray.getDepth());
+		seed(ray);
+		glm::vec3 color = ray.getWeight()*shade(ray, hit);
+		return color + traceStack();
+	}
+
+private:
+	//Prevent the compiler from generating the assignment operator (state is a reference)
+	RayTree& operator=(const RayTree&);
+
+	inline glm::vec3 shade(Ray& ray, const HitRecord& hit) {
+		if (hit.isHit()) {
+			RenderCounters::addHit(hit.object->getEffect(hit));
+			return hit.object->rayTrace(ray, hit, *this);
+		}
+		else {
+			RenderCounters::add(RenderCounters::MISSES);
+			return state.getBackground();
+		}
+	}
+
+	inline glm::vec3 traceStack() {
+		glm::vec3 color(0.0f);
+		while (!stack.empty()) {
+			Ray ray = stack.back();
+			stack.pop_back();
+			RenderCounters::addRays(ray.getDepth());
+			HitRecord hit = state.intersect(ray);
+			color += ray.getWeight()*shade(ray, hit);
+		}
+		return color;
+	}
+
+	//Rays are traced depth first, and split in at most a few branches, so the stack
+	//rarely grows beyond the maximum depth. It grows further when needed, with any
+	//depth set and any number of rays spawned per hit, instead of dropping rays.
+	static const unsigned int initial_stack_size = 64;
+
+	RayTracerState& state;
+	std::vector<Ray> stack;
+	unsigned int rng;
+	SceneObject* last_occluder; //< Object that blocked the last shadow ray
 };
 
+inline glm::vec3 RayTracerState::rayTrace(const Ray& ray, RayTree& tree) {
+	return tree.trace(ray);
+}
+
+inline void RayTracerState::rayTrace(const RayPacket& packet, glm::vec3* colors, RayTree& tree) {
+	HitPacket hits;
+	for (unsigned int k=0; k<scene.size(); ++k) {
+		scene[k]->intersect(packet, hits);
+	}
+
+	int lanes = simd::movemask(packet.getActive());
+	for (unsigned int i=0; i<simd::width; ++i) {
+		if (!(lanes & (1 << i))) continue;
+		Ray ray = packet.getRay(i);
+		colors[i] = tree.trace(ray, hits.get(i));
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,155 @@
+#ifndef _RENDERCOUNTERS_H__
+#define _RENDERCOUNTERS_H__
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <ostream>
+
+#ifdef _MSC_VER
+#define RT_THREAD_LOCAL __declspec(thread)
+#else
+#define RT_THREAD_LOCAL __thread
+#endif
+
+class SceneObjectEffect;
+
+/**
+  * Counts what the render threads do: rays per depth, intersection tests per
+  * primitive type, hits per effect and time per tile. Every thread counts
+  * into its own block with plain increments, found through a thread local
+  * pointer, so counting never locks or shares a cache line. Finished tiles
+  * are published per thread with relaxed atomic stores, which the progress
+  * reporter sums without blocking the render threads. Outside of attach()
+  * and detach() nothing is counted, so the counting functions are safe to
+  * call from any code.
+  */
+class RenderCounters {
+public:
+	enum Counter {
+		SPHERE_TESTS, //< Ray-sphere tests, counted per ray in packets
+		TRIANGLE_TESTS, //< Ray-triangle tests
+		INSTANCE_TESTS, //< Rays transformed into an instance
+		CUBEMAP_LOOKUPS, //< Texture lookups in the environment map
+		MISSES, //< Rays that hit nothing
+		SHADOW_RAYS, //< Occlusion queries
+		OCCLUDER_CACHE_HITS, //< Shadow rays blocked by the last occluder of the thread
+		COUNTER_COUNT
+	};
+
+	static const unsigned int max_depth = 16; //< Deeper rays are counted with this depth
+	static const unsigned int max_effects = 16; //< Further effects are counted together as "other"
+
+	/**
+	  * Counters of all threads added together
+	  */
+	struct Totals {
+		Totals();
+		unsigned long long rays[max_depth+1];
+		unsigned long long counters[COUNTER_COUNT];
+		std::vector<std::pair<const char*, unsigned long long> > effect_hits; //< Hits per effect name
+		unsigned int tiles;
+		double tile_seconds; //< Sum of the render time of all tiles
+		double max_tile_seconds;
+
+		inline unsigned long long getRayCount(unsigned int first_depth=0) const {
+			unsigned long long n = 0;
+			for (unsigned int d=first_depth; d<=max_depth; ++d) n += rays[d];
+			return n;
+		}
+
+		/**
+		  * Writes the totals as a JSON object
+		  */
+		void writeJSON(std::ostream& out) const;
+	};
+
+	/**
+	  * @param n_threads Number of threads that count, see TileScheduler::getThreadCount()
+	  */
+	RenderCounters(unsigned int n_threads);
+
+	/**
+	  * Makes the calling thread count into the block of thread, until detach()
+	  */
+	void attach(unsigned int thread);
+	static inline void detach() { current = NULL; }
+
+	static inline void add(Counter counter, unsigned int n=1) {
+		if (current) current->counters[counter] += n;
+	}
+
+	static inline void addRays(unsigned int depth, unsigned int n=1) {
+		if (current) current->rays[depth < max_depth ? depth : max_depth] += n;
+	}
+
+	/**
+	  * Returns the rays of depth the calling thread has counted so far
+	  */
+	static inline unsigned long long getRays(unsigned int depth) {
+		return current ? current->rays[depth < max_depth ? depth : max_depth] : 0;
+	}
+
+	/**
+	  * Counts a hit shaded by effect, NULL if the object shades itself
+	  */
+	static inline void addHit(const SceneObjectEffect* effect) {
+		if (!current) return;
+		//A scene has only a handful of effects, so a linear search is fine
+		unsigned int k = 0;
+		while (k < current->n_effects && current->effects[k] != effect) ++k;
+		if (k == current->n_effects) {
+			if (k < max_effects) addEffect(effect);
+			else k = max_effects;
+		}
+		current->effect_hits[k]++;
+	}
+
+	/**
+	  * Records that thread finished a tile in seconds, and publishes the
+	  * progress of the thread to getTilesDone() and getRaysDone()
+	  */
+	void finishTile(unsigned int thread, double seconds);
+
+	/**
+	  * Returns the number of finished tiles. Safe to call while rendering.
+	  */
+	unsigned int getTilesDone() const;
+
+	/**
+	  * Returns the number of rays traced in finished tiles. Safe to call while rendering.
+	  */
+	unsigned long long getRaysDone() const;
+
+	/**
+	  * Adds the counters of all threads, after rendering
+	  */
+	Totals getTotals() const;
+
+private:
+	RenderCounters(const RenderCounters&);
+	RenderCounters& operator=(const RenderCounters&);
+
+	struct Block {
+		Block();
+		unsigned long long rays[max_depth+1];
+		unsigned long long counters[COUNTER_COUNT];
+		const SceneObjectEffect* effects[max_effects];
+		const char* effect_names[max_effects];
+		unsigned long long effect_hits[max_effects+1]; //< The last counts the effects that did not fit
+		unsigned int n_effects;
+		unsigned int tiles;
+		double tile_seconds;
+		double max_tile_seconds;
+		std::atomic<unsigned int> tiles_done; //< Published copy of tiles
+		std::atomic<unsigned long long> rays_done; //< Published ray count
+		char padding[64]; //< Keeps the next block off the last cache line of this one
+	};
+
+	static void addEffect(const SceneObjectEffect* effect);
+
+	static RT_THREAD_LOCAL Block* current;
+	std::vector<std::shared_ptr<Block> > blocks;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _SIMD_HPP__
+#define _SIMD_HPP__
+
+#ifdef __AVX__
+#include <immintrin.h>
+#else
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+/**
+  * Thin wrapper around the SSE (or AVX, if enabled by the compiler) intrinsics,
+  * so that the packet code can be written once for any vector width.
+  * Comparisons return masks with all bits set in the lanes where they hold.
+  */
+namespace simd {
+
+#ifdef __AVX__
+	static const unsigned int width = 8;
+
+	struct vfloat {
+		vfloat() {}
+		vfloat(__m256 v) : v(v) {}
+		explicit vfloat(float f) : v(_mm256_set1_ps(f)) {}
+		inline operator __m256() const { return v; }
+		__m256 v;
+	};
+
+	inline vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void store(float* p, const vfloat& a) { _mm256_storeu_ps(p, a); }
+
+	inline vfloat operator+(const vfloat& a, const vfloat& b) { return _mm256_add_ps(a, b); }
+	inline vfloat operator-(const vfloat& a, const vfloat& b) { return _mm256_sub_ps(a, b); }
+	inline vfloat operator*(const vfloat& a, const vfloat& b) { return _mm256_mul_ps(a, b); }
+	inline vfloat operator/(const vfloat& a, const vfloat& b) { return _mm256_div_ps(a, b); }
+	inline vfloat operator&(const vfloat& a, const vfloat& b) { return _mm256_and_ps(a, b); }
+	inline vfloat operator|(const vfloat& a, const vfloat& b) { return _mm256_or_ps(a, b); }
+	inline vfloat operator<(const vfloat& a, const vfloat& b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline vfloat operator<=(const vfloat& a, const vfloat& b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	inline vfloat operator>(const vfloat& a, const vfloat& b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	inline vfloat operator>=(const vfloat& a, const vfloat& b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	inline vfloat min(const vfloat& a, const vfloat& b) { return _mm256_min_ps(a, b); }
+	inline vfloat max(const vfloat& a, const vfloat& b) { return _mm256_max_ps(a, b); }
+	inline vfloat sqrt(const vfloat& a) { return _mm256_sqrt_ps(a); }
+	inline vfloat select(const vfloat& mask, const vfloat& a, const vfloat& b) { return _mm256_blendv_ps(b, a, mask); }
+	inline int movemask(const vfloat& mask) { return _mm256_movemask_ps(mask); }
+	inline vfloat laneMask(unsigned int count) {
+		__m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+		__m256i n = _mm256_set1_epi32(count);
+		//AVX (without AVX2) has no integer compare, so compare as floats
+		return _mm256_cmp_ps(_mm256_cvtepi32_ps(lanes), _mm256_cvtepi32_ps(n), _CMP_LT_OQ);
+	}
+	inline vfloat laneIndex() { return _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f); }
+#else
+	static const unsigned int width = 4;
+
+	struct vfloat {
+		vfloat() {}
+		vfloat(__m128 v) : v(v) {}
+		explicit vfloat(float f) : v(_mm_set1_ps(f)) {}
+		inline operator __m128() const { return v; }
+		__m128 v;
+	};
+
+	inline vfloat load(const float* p) { return _mm_loadu_ps(p); }
+	inline void store(float* p, const vfloat& a) { _mm_storeu_ps(p, a); }
+
+	inline vfloat operator+(const vfloat& a, const vfloat& b) { return _mm_add_ps(a, b); }
+	inline vfloat operator-(const vfloat& a, const vfloat& b) { return _mm_sub_ps(a, b); }
+	inline vfloat operator*(const vfloat& a, const vfloat& b) { return _mm_mul_ps(a, b); }
+	inline vfloat operator/(const vfloat& a, const vfloat& b) { return _mm_div_ps(a, b); }
+	inline vfloat operator&(const vfloat& a, const vfloat& b) { return _mm_and_ps(a, b); }
+	inline vfloat operator|(const vfloat& a, const vfloat& b) { return _mm_or_ps(a, b); }
+	inline vfloat operator<(const vfloat& a, const vfloat& b) { return _mm_cmplt_ps(a, b); }
+	inline vfloat operator<=(const vfloat& a, const vfloat& b) { return _mm_cmple_ps(a, b); }
+	inline vfloat operator>(const vfloat& a, const vfloat& b) { return _mm_cmpgt_ps(a, b); }
+	inline vfloat operator>=(const vfloat& a, const vfloat& b) { return _mm_cmpge_ps(a, b); }
+	inline vfloat min(const vfloat& a, const vfloat& b) { return _mm_min_ps(a, b); }
+	inline vfloat max(const vfloat& a, const vfloat& b) { return _mm_max_ps(a, b); }
+	inline vfloat sqrt(const vfloat& a) { return _mm_sqrt_ps(a); }
+	inline vfloat select(const vfloat& mask, const vfloat& a, const vfloat& b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+	inline int movemask(const vfloat& mask) { return _mm_movemask_ps(mask); }
+	inline vfloat laneMask(unsigned int count) {
+		return _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set_epi32(3, 2, 1, 0), _mm_set1_epi32(count)));
+	}
+	inline vfloat laneIndex() { return _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f); }
+#endif
+
+	/**
+	  * Returns lane i of a
+	  */
+	inline float get(const vfloat& a, unsigned int i) {
+		float tmp[width];
+		store(tmp, a);
+		return tmp[i];
+	}
+
+	/**
+	  * Returns the number of lanes set in mask
+	  */
+	inline unsigned int laneCount(const vfloat& mask) {
+		unsigned int lanes = static_cast<unsigned int>(movemask(mask));
+		unsigned int n = 0;
+		for (; lanes != 0; lanes &= lanes-1) ++n;
+		return n;
+	}
+
+	/**
+	  * Three component vector with one vector per component (structure of arrays)
+	  */
+	struct vvec3 {
+		vfloat x, y, z;
+		vvec3() {}
+		vvec3(const vfloat& x, const vfloat& y, const vfloat& z) : x(x), y(y), z(z) {}
+		explicit vvec3(const glm::vec3& v) : x(v.x), y(v.y), z(v.z) {}
+	};
+
+	inline vvec3 operator+(const vvec3& a, const vvec3& b) { return vvec3(a.x+b.x, a.y+b.y, a.z+b.z); }
+	inline vvec3 operator-(const vvec3& a, const vvec3& b) { return vvec3(a.x-b.x, a.y-b.y, a.z-b.z); }
+	inline vvec3 operator*(const vvec3& a, const vfloat& s) { return vvec3(a.x*s, a.y*s, a.z*s); }
+	inline vfloat dot(const vvec3& a, const vvec3& b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+	inline vvec3 cross(const vvec3& a, const vvec3& b) {
+		return vvec3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+	}
+}
+
+#endif
@@ -3,32 +3,134 @@
 
 #include <vector>
 #include <memory>
+#include <limits>
 
 #include <glm/glm.hpp>
 
 #include "Ray.hpp"
+#include "RayPacket.hpp"
 
 class RayTracerState;
+class RayTree;
 class SceneObjectEffect;
+class SceneObject;
+
+/**
+  * Everything needed to shade an intersection point. It is returned by value
+  * from SceneObject::intersect, so no state is shared between threads.
+  */
+struct HitRecord {
+	HitRecord() {
+		t = -1.0f;
+		primitive = 0;
+		object = NULL;
+	}
+
+	inline bool isHit() const { return object != NULL; }
+
+	float t; //< Ray parameter so that origin + t*direction is the point of intersection
+	unsigned int primitive; //< Object specific primitive index, e.g., triangle number
+	glm::vec2 barycentric; //< Barycentric (u, v) within the primitive, where applicable
+	SceneObject* object; //< The object that was hit, NULL if no intersection
+};
+
+/**
+  * The closest intersections found so far for a RayPacket. The t vector also
+  * acts as t_max for every lane when intersecting further objects.
+  */
+struct HitPacket {
+	HitPacket() : t(std::numeric_limits<float>::infinity()) {}
+
+	/**
+	  * Records object as the closest hit at t_new for the lanes in mask
+	  * @return The lanes in mask as a bit mask
+	  */
+	inline int update(const simd::vfloat& mask, const simd::vfloat& t_new, SceneObject* object) {
+		int lanes = simd::movemask(mask);
+		if (lanes == 0) return 0;
+		t = simd::select(mask, t_new, t);
+		for (unsigned int i=0; i<simd::width; ++i) {
+			if (lanes & (1 << i)) hits[i].object = object;
+		}
+		return lanes;
+	}
+
+	/**
+	  * Returns the intersection for lane i
+	  */
+	inline HitRecord get(unsigned int i) const {
+		HitRecord hit = hits[i];
+		hit.t = simd::get(t, i);
+		return hit;
+	}
+
+	simd::vfloat t;
+	HitRecord hits[simd::width];
+};
 
 class SceneObject {
 public:
 	/**
 	  * Computes the closest point of intersection
 	  * @param r The ray to perform intersection test against
-	  * @param t If intersection found, this is set so that t*r is the point of intersection
-	  * @return true if intersection found, false otherwise
+	  * @param t_max Only intersections closer than t_max are reported
+	  * @return The intersection, with object set to NULL if none was found
+	  */
+	virtual HitRecord intersect(const Ray& r, float t_max) = 0;
+
+	/**
+	  * Intersects all active rays in a packet, updating hits for the lanes
+	  * where this object is closer than hits.t. The default implementation
+	  * simply intersects one lane at a time.
+	  */
+	virtual void intersect(const RayPacket& packet, HitPacket& hits) {
+		float t[simd::width];
+		int lanes = simd::movemask(packet.getActive());
+		simd::store(t, hits.t);
+		for (unsigned int i=0; i<simd::width; ++i) {
+			if (!(lanes & (1 << i))) continue;
+			HitRecord hit = intersect(packet.getRay(i), t[i]);
+			if (hit.isHit()) {
+				hits.hits[i] = hit;
+				t[i] = hit.t;
+			}
+		}
+		hits.t = simd::load(t);
+	}
+
+	/**
+	  * Tests whether the object blocks r before t_max, for shadow rays. Unlike
+	  * intersect(), this may stop at the first intersection found, and the
+	  * default implementation simply uses intersect().
+	  * @return The object that blocks r (the part that was hit, for groups), or NULL
+	  */
+	virtual SceneObject* occluded(const Ray& r, float t_max) { return intersect(r, t_max).object; }
+
+	/**
+	  * Returns the effect that shades hit, or NULL if the object shades itself
+	  */
+	virtual SceneObjectEffect* getEffect(const HitRecord& hit) { return effect.get(); }
+
+	/**
+	  * Returns the surface normal at the intersection hit of ray
+	  */
+	virtual glm::vec3 getNormal(const Ray& ray, const HitRecord& hit) { return glm::vec3(0.0f); }
+
+	/**
+	  * Shades the intersection of ray with this object
+	  * @param ray The incoming ray to trace
+	  * @param hit The intersection of ray with this object
+	  * @param tree The ray tree being traced, used to spawn secondary rays
+	  * @return The color leaving the surface along ray, excluding secondary rays
 	  */
-	virtual float intersect(const Ray& r) = 0;
+	virtual glm::vec3 rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree) = 0;
 
 	/**
-	  * Performs recursive raytracing of the elements in scene
-	  * @param scene All elements in the scene
-	  * @param r The incoming ray to trace
-	  * @param color The color to set
-	  * @param depth The recursion depth of this tracing
+	  * Called before a frame is rendered, after the scene was changed. Objects
+	  * that depend on other objects, such as groups, update their acceleration
+	  * structures here rather than during (multithreaded) intersection.
 	  */
-	virtual glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state) = 0;
+	virtual void prepare() {}
 
 protected:
 	std::shared_ptr<SceneObjectEffect> effect;
@@ -6,7 +6,17 @@
 
 class SceneObjectEffect {
 public:
-	virtual glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTracerState& state) = 0;
+	/**
+	  * Shades the point ray.getOrigin() + t*ray.getDirection(). Reflected and
+	  * refracted light is added by spawning secondary rays in tree.
+	  * @return The color leaving the surface directly along ray
+	  */
+	virtual glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTree& tree) = 0;
+
+	/**
+	  * Returns the name of the effect, used to report statistics
+	  */
+	virtual const char* getName() const { return "effect"; }
 private:
 };
 
@@ -20,14 +30,25 @@ public:
 		this->spec = spec;
 	}
 
-	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTracerState& state) {
+	const char* getName() const { return "phong"; }
+
+	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTree& tree) {
 		glm::vec3 p = ray.getOrigin() + t*ray.getDirection();
-		glm::vec3 l = glm::normalize(pos - p);
+		glm::vec3 to_light = pos - p;
+		float distance = glm::length(to_light);
+		glm::vec3 l = to_light/distance;
+
+		//Points that face away from the light or cannot see it get no direct light, neither diffuse nor
+		//specular. The facing test comes first, so those facing away never pay for a shadow ray.
+		float n_dot_l = glm::dot(normal, l);
+		if (n_dot_l <= 0.0f) return glm::vec3(0.0f);
+		if (tree.occluded(Ray(p, l), distance)) return glm::vec3(0.0f);
+
 		glm::vec3 v = glm::normalize(-ray.getDirection());
 		glm::vec3 h = glm::normalize(l+v);
 		
 		glm::vec3 out_color = glm::vec3(0.0);
-		out_color += std::max(glm::dot(normal, l), 0.0f)*diff;
+		out_color += n_dot_l*diff;
 		out_color += std::pow(glm::dot(normal, h), 128.0f)*spec;
 
 		return out_color;
@@ -40,11 +61,13 @@ private:
 
 class SteelEffect : public SceneObjectEffect {
 public:
-	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTracerState& state) {
+	const char* getName() const { return "steel"; }
+
+	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTree& tree) {
 		glm::vec3 r = glm::reflect(ray.getDirection(), normal);
-		Ray subray = ray.spawn(t, r);
+		tree.spawn(ray, t, r, glm::vec3(0.5f+0.5f*std::powf(glm::dot(normal, glm::normalize(-ray.getDirection())), 0.2)));
 
-		return state.rayTrace(subray)*(0.5f+0.5f*std::powf(glm::dot(normal, glm::normalize(-ray.getDirection())), 0.2));
+		return glm::vec3(0.0f);
 	}
 };
 
@@ -55,7 +78,9 @@ public:
 		this->color = color;
 	}
 
-	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTracerState& state) {
+	const char* getName() const { return "fresnel"; }
+
+	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTree& tree) {
 		const float eta_air = 1.000293f;
 		const float eta_carbondioxide = 1.00045f;
 		const float eta_water = 1.3330f;
@@ -69,8 +94,6 @@ public:
 
 		float eta, R0;
 		float d = 1.0f;
-		int k_min;
-		glm::vec3 out_color(0.0f);
  
 		glm::vec3 v = glm::normalize(-ray.getDirection());
 		glm::vec3 r1, r2;
@@ -96,16 +119,28 @@ public:
 			d = std::max((c-glm::length(t*ray.getDirection())) / c, 0.0f);
 			d = d*d;
 		}
-		
-		//Reflection
-		Ray subray1 = ray.spawn(t, r1);
-		glm::vec3 reflect_color = state.rayTrace(subray1);
-		
-		//Refraction
-		Ray subray2 = ray.spawn(t, r2);
-		glm::vec3 refract_color = state.rayTrace(subray2);
 
-		return fresnel*reflect_color + d*color*(1.0f-fresnel)*refract_color;
+
+		//Total internal reflection: refract returns a zero vector, and all light is reflected
+		if (r2 == glm::vec3(0.0f)) {
+			fresnel = 1.0f;
+		}
+
+		if (tree.useRussianRoulette()) {
+			//Follow only one of the branches, chosen by the Fresnel term
+			if (tree.random() < fresnel) {
+				tree.spawn(ray, t, r1, glm::vec3(1.0f));
+			}
+			else {
+				tree.spawn(ray, t, r2, d*color);
+			}
+		}
+		else {
+			tree.spawn(ray, t, r1, glm::vec3(fresnel));
+			tree.spawn(ray, t, r2, d*color*(1.0f-fresnel));
+		}
+
+		return glm::vec3(0.0f);
 	}
 
 private:
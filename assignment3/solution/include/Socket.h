@@ -0,0 +1,69 @@
+#ifndef _SOCKET_H__
+#define _SOCKET_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+/**
+  * Blocking TCP connection, or a listening socket that accepts them. All
+  * functions throw on errors, except that receive() reports a connection
+  * that was closed between messages.
+  */
+class Socket {
+public:
+	/**
+	  * Connects to port on host, a name or an address
+	  */
+	static std::shared_ptr<Socket> connect(const std::string& host, unsigned short port);
+
+	/**
+	  * Listens on port on all interfaces, 0 picks a free port (see getPort())
+	  */
+	static std::shared_ptr<Socket> listen(unsigned short port);
+
+	/**
+	  * Waits until one of sockets can be read from (or accepted on), for at
+	  * most timeout seconds
+	  * @param ready Set to the indices of the readable sockets
+	  */
+	static void wait(const std::vector<Socket*>& sockets, double timeout, std::vector<unsigned int>& ready);
+
+	~Socket();
+
+	/**
+	  * Accepts a connection on a listening socket
+	  */
+	std::shared_ptr<Socket> accept();
+
+	/**
+	  * Sends all size bytes of data
+	  */
+	void send(const void* data, size_t size);
+
+	/**
+	  * Receives exactly size bytes into data
+	  * @return false if the connection was closed before the first byte
+	  */
+	bool receive(void* data, size_t size);
+
+	/**
+	  * Makes receive() throw if no data arrives for seconds, 0 waits forever
+	  */
+	void setReceiveTimeout(double seconds);
+
+	/**
+	  * Returns the local port of the socket
+	  */
+	unsigned short getPort() const;
+
+private:
+	Socket(size_t handle);
+	Socket(const Socket&);
+	Socket& operator=(const Socket&);
+
+	size_t handle; //< SOCKET on Windows, file descriptor elsewhere
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "RayTracerState.hpp"
 #include "SceneObject.hpp"
 #include "SceneObjectEffect.hpp"
+#include "RenderCounters.h"
 
 #include <glm/glm.hpp>
 
@@ -18,7 +19,9 @@ public:
 	/**
 	  * Computes the ray-sphere intersection
 	  */
-	float intersect(const Ray& r) {
+	HitRecord intersect(const Ray& r, float t_max) {
+		RenderCounters::add(RenderCounters::SPHERE_TESTS);
+		HitRecord hit;
 		const float z_offset = 10e-4f;
 		const glm::vec3 d = r.getDirection();
 		const glm::vec3 p0 = r.getOrigin();
@@ -29,7 +32,7 @@ public:
 		//Solve ax^2 + bx + c = 0
 		if ((b*b-4.0f*a*c) < 0.0f) {
 			//No intersections
-			return -1;
+			return hit;
 		}
 		else {
 			//One or more intersections
@@ -43,21 +46,55 @@ public:
 			t0 = std::min(t0, tmp); //t0 is the "smallest" intersection
 
 			if (t0 > z_offset) 
-				return t0;
+				hit.t = t0;
 			else if (t1 > z_offset)
-				return t1;
+				hit.t = t1;
 			else
-				return -1;
+				return hit;
+
+			if (hit.t < t_max)
+				hit.object = this;
+			return hit;
 		}
 	}
 	
+	/**
+	  * Computes the ray-sphere intersection for all rays in a packet
+	  */
+	void intersect(const RayPacket& packet, HitPacket& hits) {
+		RenderCounters::add(RenderCounters::SPHERE_TESTS, simd::laneCount(packet.getActive()));
+		const simd::vfloat z_offset(10e-4f);
+		const simd::vvec3& d = packet.getDirection();
+		const simd::vvec3 op = packet.getOrigin() - simd::vvec3(p);
+		simd::vfloat a = simd::dot(d, d);
+		simd::vfloat b = simd::vfloat(2.0f)*simd::dot(d, op);
+		simd::vfloat c = simd::dot(op, op) - simd::vfloat(this->r*this->r);
+		simd::vfloat disc = b*b - simd::vfloat(4.0f)*a*c;
+
+		simd::vfloat mask = packet.getActive() & (disc >= simd::vfloat(0.0f));
+		if (simd::movemask(mask) == 0) return;
+
+		simd::vfloat w1 = simd::sqrt(simd::max(disc, simd::vfloat(0.0f)));
+		simd::vfloat w2 = simd::vfloat(0.5f)/a;
+		simd::vfloat t0 = (simd::vfloat(0.0f) - b - w1)*w2; //a > 0, so t0 is the smallest
+		simd::vfloat t1 = (simd::vfloat(0.0f) - b + w1)*w2;
+		simd::vfloat t = simd::select(t0 > z_offset, t0, t1);
+
+		mask = mask & (t > z_offset) & (t < hits.t);
+		hits.update(mask, t, this);
+	}
+
 	const glm::vec3 computeNormal(const Ray& r, const float& t) {
 		return (r.getOrigin() + t*r.getDirection() - p) / this->r;
 	}
 
-	glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state) {
-		glm::vec3 normal = computeNormal(ray, t);
-		return effect->rayTrace(ray, t, normal, state);
+	glm::vec3 getNormal(const Ray& ray, const HitRecord& hit) {
+		return computeNormal(ray, hit.t);
+	}
+
+	glm::vec3 rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree) {
+		glm::vec3 normal = computeNormal(ray, hit.t);
+		return effect->rayTrace(ray, hit.t, normal, tree);
 	}
 
 protected:
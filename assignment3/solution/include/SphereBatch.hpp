@@ -0,0 +1,200 @@
+#ifndef _SPHEREBATCH_HPP__
+#define _SPHEREBATCH_HPP__
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "RayTracerState.hpp"
+#include "SceneObject.hpp"
+#include "SceneObjectEffect.hpp"
+#include "SIMD.hpp"
+#include "RenderCounters.h"
+
+/**
+  * A batch of spheres acting as one scene object. Centers and squared radii
+  * are kept in contiguous arrays (structure of arrays), so that a single ray
+  * is tested against simd::width spheres per instruction without any
+  * virtual calls or pointer chasing. The arrays are padded to a multiple of
+  * simd::width with spheres that can never be hit.
+  */
+class SphereBatch : public SceneObject {
+public:
+	SphereBatch() {
+		count = 0;
+	}
+
+	/**
+	  * Adds a sphere to the batch
+	  */
+	void addSphere(glm::vec3 center, float radius, std::shared_ptr<SceneObjectEffect> effect) {
+		if (count % simd::width == 0) {
+			//Padding: a negative, huge squared radius gives a negative discriminant for any ray
+			const unsigned int size = count + simd::width;
+			cx.resize(size, 0.0f);
+			cy.resize(size, 0.0f);
+			cz.resize(size, 0.0f);
+			r2.resize(size, -std::numeric_limits<float>::max());
+			inv_r.resize(size, 0.0f);
+		}
+		cx[count] = center.x;
+		cy[count] = center.y;
+		cz[count] = center.z;
+		r2[count] = radius*radius;
+		inv_r[count] = 1.0f/radius;
+		effects.push_back(effect);
+		++count;
+	}
+
+	inline unsigned int size() const { return count; }
+
+	/**
+	  * Finds the closest sphere hit by r, testing simd::width spheres at a time
+	  */
+	HitRecord intersect(const Ray& r, float t_max) {
+		const simd::vfloat z_offset(10e-4f);
+		const simd::vfloat zero(0.0f);
+		const glm::vec3& d = r.getDirection();
+		const float a = glm::dot(d, d);
+		const simd::vfloat va(a);
+		const simd::vfloat inv_a(1.0f/a);
+		const simd::vvec3 vd(d);
+		const simd::vvec3 vo(r.getOrigin());
+		RenderCounters::add(RenderCounters::SPHERE_TESTS, count);
+
+		simd::vfloat best_t(t_max);
+		simd::vfloat best_index(-1.0f);
+		simd::vfloat index = simd::laneIndex();
+		const simd::vfloat step(static_cast<float>(simd::width));
+
+		for (unsigned int k=0; k<count; k+=simd::width) {
+			simd::vvec3 oc = vo - simd::vvec3(simd::load(&cx[k]), simd::load(&cy[k]), simd::load(&cz[k]));
+
+			//Solve at^2 + 2bt + c = 0 for all spheres in the block
+			simd::vfloat b = simd::dot(vd, oc);
+			simd::vfloat c = simd::dot(oc, oc) - simd::load(&r2[k]);
+			simd::vfloat disc = b*b - va*c;
+			simd::vfloat mask = (disc >= zero);
+
+			if (simd::movemask(mask) != 0) {
+				simd::vfloat w = simd::sqrt(simd::max(disc, zero));
+				simd::vfloat t0 = (zero - b - w)*inv_a;
+				simd::vfloat t1 = (zero - b + w)*inv_a;
+				simd::vfloat t = simd::select(t0 > z_offset, t0, t1);
+
+				mask = mask & (t > z_offset) & (t < best_t);
+				best_t = simd::select(mask, t, best_t);
+				best_index = simd::select(mask, index, best_index);
+			}
+			index = index + step;
+		}
+
+		//Find the closest of the per-lane hits
+		float t[simd::width];
+		float i[simd::width];
+		simd::store(t, best_t);
+		simd::store(i, best_index);
+
+		HitRecord hit;
+		for (unsigned int l=0; l<simd::width; ++l) {
+			if (i[l] >= 0.0f && (!hit.isHit() || t[l] < hit.t)) {
+				hit.t = t[l];
+				hit.primitive = static_cast<unsigned int>(i[l]);
+				hit.object = this;
+			}
+		}
+		return hit;
+	}
+
+	/**
+	  * Tests whether any sphere is hit by r before t_max, stopping at the first block with a hit
+	  */
+	SceneObject* occluded(const Ray& r, float t_max) {
+		const simd::vfloat z_offset(10e-4f);
+		const simd::vfloat zero(0.0f);
+		const glm::vec3& d = r.getDirection();
+		const float a = glm::dot(d, d);
+		const simd::vfloat va(a);
+		const simd::vfloat inv_a(1.0f/a);
+		const simd::vfloat vt_max(t_max);
+		const simd::vvec3 vd(d);
+		const simd::vvec3 vo(r.getOrigin());
+
+		for (unsigned int k=0; k<count; k+=simd::width) {
+			RenderCounters::add(RenderCounters::SPHERE_TESTS, std::min(simd::width, count-k));
+			simd::vvec3 oc = vo - simd::vvec3(simd::load(&cx[k]), simd::load(&cy[k]), simd::load(&cz[k]));
+			simd::vfloat b = simd::dot(vd, oc);
+			simd::vfloat c = simd::dot(oc, oc) - simd::load(&r2[k]);
+			simd::vfloat disc = b*b - va*c;
+			simd::vfloat mask = (disc >= zero);
+			if (simd::movemask(mask) == 0) continue;
+
+			//Either root in (z_offset, t_max) blocks the ray
+			simd::vfloat w = simd::sqrt(simd::max(disc, zero));
+			simd::vfloat t0 = (zero - b - w)*inv_a;
+			simd::vfloat t1 = (zero - b + w)*inv_a;
+			simd::vfloat t = simd::select(t0 > z_offset, t0, t1);
+			mask = mask & (t > z_offset) & (t < vt_max);
+			if (simd::movemask(mask) != 0) return this;
+		}
+		return NULL;
+	}
+
+	/**
+	  * Intersects a packet of rays, one sphere at a time against all lanes
+	  */
+	void intersect(const RayPacket& packet, HitPacket& hits) {
+		const simd::vfloat z_offset(10e-4f);
+		const simd::vfloat zero(0.0f);
+		const simd::vvec3& d = packet.getDirection();
+		const simd::vvec3& o = packet.getOrigin();
+		const simd::vfloat a = simd::dot(d, d);
+		const simd::vfloat inv_a = simd::vfloat(1.0f)/a;
+		RenderCounters::add(RenderCounters::SPHERE_TESTS, count*simd::laneCount(packet.getActive()));
+
+		for (unsigned int k=0; k<count; ++k) {
+			simd::vvec3 oc = o - simd::vvec3(simd::vfloat(cx[k]), simd::vfloat(cy[k]), simd::vfloat(cz[k]));
+			simd::vfloat b = simd::dot(d, oc);
+			simd::vfloat c = simd::dot(oc, oc) - simd::vfloat(r2[k]);
+			simd::vfloat disc = b*b - a*c;
+			simd::vfloat mask = packet.getActive() & (disc >= zero);
+			if (simd::movemask(mask) == 0) continue;
+
+			simd::vfloat w = simd::sqrt(simd::max(disc, zero));
+			simd::vfloat t0 = (zero - b - w)*inv_a;
+			simd::vfloat t1 = (zero - b + w)*inv_a;
+			simd::vfloat t = simd::select(t0 > z_offset, t0, t1);
+
+			mask = mask & (t > z_offset) & (t < hits.t);
+			int lanes = hits.update(mask, t, this);
+			for (unsigned int l=0; l<simd::width; ++l) {
+				if (lanes & (1 << l)) hits.hits[l].primitive = k;
+			}
+		}
+	}
+
+	SceneObjectEffect* getEffect(const HitRecord& hit) {
+		return effects[hit.primitive].get();
+	}
+
+	glm::vec3 getNormal(const Ray& ray, const HitRecord& hit) {
+		const unsigned int k = hit.primitive;
+		glm::vec3 p = ray.getOrigin() + hit.t*ray.getDirection();
+		return (p - glm::vec3(cx[k], cy[k], cz[k]))*inv_r[k];
+	}
+
+	glm::vec3 rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree) {
+		return effects[hit.primitive]->rayTrace(ray, hit.t, getNormal(ray, hit), tree);
+	}
+
+private:
+	unsigned int count;
+	std::vector<float> cx, cy, cz; //< Sphere centers
+	std::vector<float> r2; //< Squared radii
+	std::vector<float> inv_r; //< Inverse radii, used for normals
+	std::vector<std::shared_ptr<SceneObjectEffect> > effects;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _TEXTURECACHE_H__
+#define _TEXTURECACHE_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "MipTexture.h"
+#include "MappedFile.h"
+
+/**
+  * Cache of decoded and mipmapped textures, so that images are decoded once
+  * instead of by every renderer process. A cache file holds the texels of a
+  * set of MipTextures in their in-memory layout, and is keyed by a hash of
+  * the source images: textures are used straight from the read-only mapping
+  * of the file, so loading is nearly free, and processes on the same machine
+  * share the pages. Cache files are written to a temporary file and renamed,
+  * so concurrent processes never see a partial file.
+  */
+class TextureCache {
+public:
+	/**
+	  * Returns the name of the cache file for key in directory, which
+	  * depends on the version of the file layout as well
+	  */
+	static std::string getFilename(const std::string& directory, unsigned long long key);
+
+	/**
+	  * Maps a cache file, and attaches its textures. The textures use the
+	  * returned mapping, which must be kept while they are in use.
+	  * @return NULL if the file does not exist, belongs to another key, or is invalid
+	  */
+	static std::shared_ptr<MappedFile> load(const std::string& filename, unsigned long long key,
+		MipTexture* const* textures, unsigned int count);
+
+	/**
+	  * Writes textures to a cache file, throwing on failure
+	  */
+	static void save(const std::string& filename, unsigned long long key,
+		const MipTexture* const* textures, unsigned int count);
+
+private:
+	static const unsigned int version = 1; //< Increase when the file or MipTexture layout changes
+	static const unsigned int alignment = 64; //< Texels of every texture start on a cache line
+
+	struct Header {
+		char magic[8];
+		unsigned int version;
+		unsigned int count;
+		unsigned long long key;
+	};
+
+	struct Entry {
+		unsigned int width, height;
+		unsigned long long offset; //< Position of the texels in the file
+		unsigned long long size;
+	};
+};
+
+#endif
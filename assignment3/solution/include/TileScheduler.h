@@ -0,0 +1,88 @@
+#ifndef _TILESCHEDULER_H__
+#define _TILESCHEDULER_H__
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <ostream>
+
+/**
+  * A rectangular part of the image, [x, x+width) x [y, y+height)
+  */
+struct Tile {
+	unsigned int x, y;
+	unsigned int width, height;
+	unsigned int index; //< Position of the tile in traversal (Morton) order
+};
+
+/**
+  * Splits an image into tiles and renders them in parallel. The tiles are
+  * ordered along a Morton (Z-order) curve for cache locality, and each
+  * thread starts with a contiguous run of that order in its own deque.
+  * A thread takes tiles from the front of its own deque, and when it runs
+  * dry it steals half of the remaining tiles from the back of another
+  * thread's deque. This keeps all threads busy even when some parts of the
+  * image are far more expensive than others.
+  */
+class TileScheduler {
+public:
+	/**
+	  * Per-thread statistics from the last call to run()
+	  */
+	struct ThreadStats {
+		ThreadStats() : tiles(0), steals(0), busy(0.0), total(0.0) {}
+		unsigned int tiles; //< Number of tiles rendered
+		unsigned int steals; //< Number of successful steal operations
+		double busy; //< Seconds spent rendering tiles
+		double total; //< Seconds from start until the thread ran out of work
+	};
+
+	/**
+	  * @param width Image width
+	  * @param height Image height
+	  * @param tile_size Width and height of the tiles (the last row and column may be smaller)
+	  */
+	TileScheduler(unsigned int width, unsigned int height, unsigned int tile_size);
+
+	/**
+	  * Calls render_tile(tile, thread) once for every tile, using n_threads threads
+	  * (OpenMP if enabled, std::thread otherwise). thread is in [0, getThreadCount(n_threads)),
+	  * and can be used to index per-thread buffers.
+	  * @param n_threads Number of threads, 0 means one per hardware thread
+	  */
+	void run(const std::function<void(const Tile&, unsigned int)>& render_tile, unsigned int n_threads=0);
+
+	/**
+	  * Returns the number of threads run() uses for n_threads
+	  */
+	static unsigned int getThreadCount(unsigned int n_threads);
+
+	inline const std::vector<Tile>& getTiles() const { return tiles; }
+	inline const std::vector<ThreadStats>& getThreadStats() const { return stats; }
+
+	/**
+	  * Prints the per-thread utilization of the last run
+	  */
+	void printStatistics(std::ostream& out) const;
+
+private:
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<unsigned int> tiles;
+	};
+
+	void worker(unsigned int thread, const std::function<void(const Tile&, unsigned int)>& render_tile);
+	bool pop(unsigned int thread, unsigned int& tile);
+	bool steal(unsigned int thread);
+
+	static unsigned int mortonCode(unsigned int x, unsigned int y);
+
+	std::vector<Tile> tiles;
+	std::vector<std::shared_ptr<WorkQueue> > queues;
+	std::vector<ThreadStats> stats;
+	double wall_time;
+};
+
+#endif
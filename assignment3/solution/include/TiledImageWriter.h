@@ -0,0 +1,64 @@
+#ifndef _TILEDIMAGEWRITER_H__
+#define _TILEDIMAGEWRITER_H__
+
+#include <string>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "FrameBuffer.hpp"
+
+/**
+  * Writes an image to disk one tile at a time, in any order. Both supported
+  * formats have a fixed size header followed by uncompressed scanlines, so the
+  * file position of every pixel is known up front, and a finished tile can be
+  * written straight to its place in the file. Only the tiles currently being
+  * rendered need to be kept in memory, whatever the image resolution.
+  *
+  * The format is chosen from the file extension:
+  * .ppm gives binary 8-bit RGB (P6), quantized from [0, 1],
+  * .pfm gives 32-bit float RGB (PF), keeping the full dynamic range.
+  */
+class TiledImageWriter {
+public:
+	TiledImageWriter(std::string filename, unsigned int width, unsigned int height);
+	~TiledImageWriter();
+
+	/**
+	  * Writes tile to the image, with its lower left corner at pixel (x, y).
+	  * Safe to call from several threads at once. Write errors are
+	  * reported by close(), so that render threads never throw.
+	  */
+	void writeTile(unsigned int x, unsigned int y, FrameBuffer& tile);
+
+	/**
+	  * Closes the file, throwing if any write failed
+	  */
+	void close();
+
+	inline const std::string& getFilename() const { return filename; }
+
+private:
+	enum Format {
+		FORMAT_PPM,
+		FORMAT_PFM
+	};
+
+	/**
+	  * Returns the file offset of pixel (x, y)
+	  */
+	long long offset(unsigned int x, unsigned int y) const;
+
+	std::string filename;
+	std::FILE* file;
+	Format format;
+	unsigned int width, height;
+	unsigned int bytes_per_pixel;
+	long long header_size;
+	bool failed;
+	std::mutex lock;
+	std::vector<unsigned char> scanline;
+	std::vector<glm::vec3> colors;
+};
+
+#endif
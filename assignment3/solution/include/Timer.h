@@ -3,6 +3,10 @@
 
 #ifdef _WIN32
 #include <sys/timeb.h>
+//Keep std::min and std::max usable in files that include the timer
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <windows.h>
 #include <time.h>
 #else
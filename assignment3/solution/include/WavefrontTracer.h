@@ -0,0 +1,80 @@
+#ifndef _WAVEFRONTTRACER_H__
+#define _WAVEFRONTTRACER_H__
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Ray.hpp"
+#include "SceneObject.hpp"
+#include "RayTracerState.hpp"
+
+/**
+  * Wavefront (queue based) alternative to tracing one ray tree at a time.
+  * All queued rays are traced one generation at a time: the whole generation
+  * is intersected in SIMD packets, the hits are binned by the effect that
+  * shades them, and every bin is shaded in one tight loop. The secondary rays
+  * spawned by shading form the next generation. Each thread keeps its buffers
+  * in its own Arena, which is reused between tiles so that rendering does
+  * not allocate once the buffers have grown.
+  */
+class WavefrontTracer {
+public:
+	/**
+	  * Per-thread ray, hit and color buffers
+	  */
+	class Arena {
+	public:
+		/**
+		  * Clears the queue, and sets the color of n_pixels pixels to black
+		  */
+		void reset(unsigned int n_pixels);
+
+		/**
+		  * Queues a ray whose color is added to pixel
+		  */
+		inline void push(const Ray& ray, unsigned int pixel) {
+			rays.push_back(ray);
+			pixels.push_back(pixel);
+		}
+
+		inline const glm::vec3& getColor(unsigned int pixel) const { return colors[pixel]; }
+
+		/**
+		  * Returns the number of rays traced since the last reset
+		  */
+		inline unsigned int getRayCount() const { return n_rays; }
+
+	private:
+		friend class WavefrontTracer;
+
+		std::vector<Ray> rays, next_rays; //< Current and next generation
+		std::vector<unsigned int> pixels, next_pixels; //< Pixel of every ray
+		std::vector<HitRecord> hits;
+		std::vector<const void*> bins; //< What shades the hits of every bin (effect, object or NULL for misses)
+		std::vector<unsigned int> bin_offsets; //< Bin b holds order[bin_offsets[b]] to order[bin_offsets[b+1]-1]
+		std::vector<unsigned int> ray_bins; //< Bin of every ray
+		std::vector<unsigned int> order; //< Ray indices sorted by bin
+		std::vector<glm::vec3> colors;
+		unsigned int n_rays;
+	};
+
+	WavefrontTracer(RayTracerState& state) : state(state) {}
+
+	/**
+	  * Traces all rays queued in arena, and all rays they spawn, adding the
+	  * color seen along each ray (times its weight) to its pixel
+	  */
+	void trace(Arena& arena);
+
+private:
+	WavefrontTracer& operator=(const WavefrontTracer&);
+
+	void intersect(Arena& arena);
+	void sort(Arena& arena);
+	void shade(Arena& arena, RayTree& tree);
+
+	RayTracerState& state;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "BVH.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	//Number of bins used when evaluating the SAH
+	const unsigned int n_bins = 16;
+
+	//Relative cost of traversing a node versus intersecting a primitive
+	const float traversal_cost = 1.0f;
+	const float intersection_cost = 1.0f;
+
+	struct Bin {
+		Bin() : count(0) {}
+		AABB bounds;
+		unsigned int count;
+	};
+}
+
+const unsigned int BVH::padding;
+
+void BVH::build(const std::vector<AABB>& bounds, unsigned int max_leaf_size, unsigned int leaf_alignment) {
+	std::vector<BuildPrimitive> prims(bounds.size());
+
+	this->max_leaf_size = std::max(max_leaf_size, 1u);
+	nodes.clear();
+	indices.resize(bounds.size());
+	node_data = NULL;
+	node_count = 0;
+
+	if (bounds.empty()) return;
+
+	for (unsigned int i=0; i<bounds.size(); ++i) {
+		prims[i].bounds = bounds[i];
+		prims[i].center = bounds[i].center();
+		indices[i] = i;
+	}
+
+	//A binary tree has at most 2n-1 nodes
+	nodes.reserve(2*bounds.size());
+	buildRecursive(prims, 0, static_cast<unsigned int>(bounds.size()), 0);
+
+	if (leaf_alignment > 1) {
+		//Move every leaf to the next multiple of leaf_alignment, and pad the end too
+		std::vector<unsigned int> aligned;
+		aligned.reserve(indices.size() + (leaf_alignment-1)*(nodes.size()+1)/2);
+		for (unsigned int n=0; n<nodes.size(); ++n) {
+			Node& node = nodes[n];
+			if (node.count == 0) continue;
+			aligned.resize((aligned.size()+leaf_alignment-1)/leaf_alignment*leaf_alignment, padding);
+			const unsigned int offset = static_cast<unsigned int>(aligned.size());
+			aligned.insert(aligned.end(), indices.begin()+node.offset, indices.begin()+node.offset+node.count);
+			node.offset = offset;
+		}
+		aligned.resize((aligned.size()+leaf_alignment-1)/leaf_alignment*leaf_alignment, padding);
+		indices.swap(aligned);
+	}
+
+	node_data = nodes.data();
+	node_count = static_cast<unsigned int>(nodes.size());
+}
+
+void BVH::refit(const std::vector<AABB>& bounds) {
+	if (node_count > 0 && nodes.empty()) {
+		throw std::runtime_error("Unable to refit a BVH that uses attached nodes");
+	}
+	if (bounds.size() != indices.size()) {
+		std::stringstream log;
+		log << "Unable to refit a BVH over " << indices.size() << " primitives with " << bounds.size() << " bounding boxes";
+		throw std::runtime_error(log.str());
+	}
+
+	//Children are always stored after their parent, so a backwards sweep updates them first
+	for (unsigned int n=node_count; n-- > 0;) {
+		Node& node = nodes[n];
+		AABB b;
+		if (node.count > 0) {
+			for (unsigned int i=node.offset; i<node.offset+node.count; ++i) {
+				b.extend(bounds[i]);
+			}
+		}
+		else {
+			b.min = glm::min(nodes[n+1].min, nodes[node.offset].min);
+			b.max = glm::max(nodes[n+1].max, nodes[node.offset].max);
+		}
+		node.min = b.min;
+		node.max = b.max;
+	}
+}
+
+float BVH::getCost() const {
+	if (node_count == 0) return 0.0f;
+
+	const float root_area = getBounds().surfaceArea();
+	if (root_area <= 0.0f) return intersection_cost*node_data[0].count;
+
+	//The chance that a ray hitting the root also hits a node is the ratio of their surface areas
+	float cost = 0.0f;
+	for (unsigned int n=0; n<node_count; ++n) {
+		const Node& node = node_data[n];
+		AABB b;
+		b.min = node.min;
+		b.max = node.max;
+		float node_cost = (node.count > 0) ? intersection_cost*node.count : traversal_cost;
+		cost += node_cost*b.surfaceArea();
+	}
+	return cost/root_area;
+}
+
+void BVH::attach(const Node* nodes, unsigned int count) {
+	this->nodes.clear();
+	indices.clear();
+	node_data = nodes;
+	node_count = count;
+}
+
+void BVH::buildRecursive(std::vector<BuildPrimitive>& prims, unsigned int first, unsigned int count, unsigned int depth) {
+	const unsigned int node_index = static_cast<unsigned int>(nodes.size());
+	nodes.push_back(Node());
+
+	//Find bounds of primitives and of their centers
+	AABB node_bounds, center_bounds;
+	for (unsigned int i=first; i<first+count; ++i) {
+		node_bounds.extend(prims[indices[i]].bounds);
+		center_bounds.extend(prims[indices[i]].center);
+	}
+	nodes[node_index].min = node_bounds.min;
+	nodes[node_index].max = node_bounds.max;
+	nodes[node_index].axis = 0;
+
+	glm::vec3 extent = center_bounds.max - center_bounds.min;
+	unsigned int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	//Leaves must fit the 16 bit count, so all-coincident centers can only become a leaf if they fit
+	bool make_leaf = (count <= max_leaf_size) || (extent[axis] <= 0.0f && count <= 0xFFFF);
+	unsigned int mid = first + count/2;
+
+	if (!make_leaf && extent[axis] > 0.0f && depth < max_depth) {
+		//Binned SAH: evaluate n_bins-1 candidate planes along every axis with non-zero extent
+		float best_cost = std::numeric_limits<float>::max();
+		unsigned int best_axis = 0;
+		unsigned int best_split = 0;
+
+		for (unsigned int a=0; a<3; ++a) {
+			if (extent[a] <= 0.0f) continue;
+			Bin bins[n_bins];
+			const float k = n_bins*(1.0f-1.0e-4f)/extent[a];
+
+			for (unsigned int i=first; i<first+count; ++i) {
+				const BuildPrimitive& p = prims[indices[i]];
+				unsigned int b = static_cast<unsigned int>((p.center[a]-center_bounds.min[a])*k);
+				bins[b].count++;
+				bins[b].bounds.extend(p.bounds);
+			}
+
+			//Sweep from the right, storing the area and count of everything right of each plane
+			float right_area[n_bins];
+			unsigned int right_count[n_bins];
+			AABB right;
+			unsigned int n_right = 0;
+			for (unsigned int b=n_bins-1; b>0; --b) {
+				right.extend(bins[b].bounds);
+				n_right += bins[b].count;
+				right_area[b] = right.surfaceArea();
+				right_count[b] = n_right;
+			}
+
+			//...and sweep from the left to evaluate the cost of each plane
+			AABB left;
+			unsigned int n_left = 0;
+			for (unsigned int b=0; b<n_bins-1; ++b) {
+				left.extend(bins[b].bounds);
+				n_left += bins[b].count;
+				if (n_left == 0 || right_count[b+1] == 0) continue;
+				float cost = n_left*left.surfaceArea() + right_count[b+1]*right_area[b+1];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = a;
+					best_split = b;
+				}
+			}
+		}
+
+		float leaf_cost = intersection_cost*count;
+		float split_cost = traversal_cost + intersection_cost*best_cost/node_bounds.surfaceArea();
+
+		if (best_cost == std::numeric_limits<float>::max()) {
+			make_leaf = (count <= 0xFFFF);
+		}
+		else if (split_cost >= leaf_cost && count <= 0xFFFF) {
+			make_leaf = true;
+		}
+		else {
+			//Partition the primitives around the chosen plane
+			const float k = n_bins*(1.0f-1.0e-4f)/extent[best_axis];
+			const float c_min = center_bounds.min[best_axis];
+			unsigned int* middle = std::partition(&indices[first], &indices[first]+count,
+				[&](unsigned int i) {
+					return static_cast<unsigned int>((prims[i].center[best_axis]-c_min)*k) <= best_split;
+				});
+			mid = static_cast<unsigned int>(middle - &indices[0]);
+			axis = best_axis;
+		}
+	}
+	else if (!make_leaf) {
+		//Too deep to trust the SAH (or no extent): median split keeps the depth logarithmic
+		std::nth_element(&indices[first], &indices[mid], &indices[first]+count,
+			[&](unsigned int a, unsigned int b) {
+				return prims[a].center[axis] < prims[b].center[axis];
+			});
+	}
+
+	if (make_leaf) {
+		nodes[node_index].offset = first;
+		nodes[node_index].count = static_cast<unsigned short>(count);
+		return;
+	}
+
+	if (mid == first || mid == first+count) mid = first + count/2;
+
+	nodes[node_index].count = 0;
+	nodes[node_index].axis = static_cast<unsigned short>(axis);
+	buildRecursive(prims, first, mid-first, depth+1);
+	nodes[node_index].offset = static_cast<unsigned int>(nodes.size());
+	buildRecursive(prims, mid, first+count-mid, depth+1);
+}
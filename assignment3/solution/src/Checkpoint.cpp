@@ -0,0 +1,161 @@
+#include "Checkpoint.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Hash.h"
+
+namespace {
+	const char magic[8] = { 'R', 'T', 'C', 'H', 'E', 'C', 'K', 'P' };
+
+	//Checkpoints of large renders are far beyond 2 GB
+	inline int seek(std::FILE* file, long long offset) {
+#ifdef _WIN32
+		return _fseeki64(file, offset, SEEK_SET);
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+	}
+
+	/**
+	  * Flushes file from the C library and from the operating system to disk
+	  */
+	inline bool sync(std::FILE* file) {
+		if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+}
+
+Checkpoint::Checkpoint(std::string filename, unsigned long long key, FrameBuffer::Format format, double interval) {
+	this->filename = filename;
+	this->key = key;
+	this->format = format;
+	this->interval = interval;
+	file = NULL;
+	failed = false;
+}
+
+Checkpoint::~Checkpoint() {
+	if (file) std::fclose(file);
+}
+
+unsigned long long Checkpoint::hashRecord(Record record, FrameBuffer& pixels) {
+	unsigned long long hash = hashing::fnv_offset;
+	record.hash = 0;
+	hashing::fnv1a(hash, &record, sizeof(Record));
+	hashing::fnv1a(hash, pixels.getData(), pixels.getBytes());
+	return hash;
+}
+
+unsigned int Checkpoint::open(bool resume, const std::function<bool(const Tile&, FrameBuffer&, unsigned long long samples)>& restore) {
+	unsigned int restored = 0;
+	long long end = 0; //< End of the last valid tile in the file
+
+	std::FILE* in = resume ? std::fopen(filename.c_str(), "rb") : NULL;
+	if (in) {
+		//A file cut short before its header was written holds no tiles, anything else is never overwritten
+		Header header;
+		if (std::fread(&header, sizeof(Header), 1, in) == 1) {
+			if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version
+					|| header.format != static_cast<unsigned int>(format) || header.key != key) {
+				std::fclose(in);
+				std::stringstream log;
+				log << filename << " is not a checkpoint of this render, remove it or render without resuming";
+				throw std::runtime_error(log.str());
+			}
+			end = sizeof(Header);
+
+			//Read up to the first tile that is incomplete or damaged, the rest is overwritten.
+			//Tiles restore rejects stay in the file, so the valid tiles after them are kept.
+			Record record;
+			while (std::fread(&record, sizeof(Record), 1, in) == 1) {
+				if (record.width == 0 || record.height == 0 || record.width > 4096 || record.height > 4096) break;
+				FrameBuffer pixels(record.width, record.height, format);
+				if (std::fread(pixels.getData(), 1, pixels.getBytes(), in) != pixels.getBytes()) break;
+				if (hashRecord(record, pixels) != record.hash) break;
+
+				Tile tile = { record.x, record.y, record.width, record.height, record.index };
+				if (restore(tile, pixels, record.samples)) ++restored;
+				end += sizeof(Record) + pixels.getBytes();
+			}
+		}
+		std::fclose(in);
+	}
+
+	if (end > 0) {
+		file = std::fopen(filename.c_str(), "r+b");
+		if (file && seek(file, end) != 0) failed = true;
+	}
+	else {
+		file = std::fopen(filename.c_str(), "wb");
+		if (file) {
+			Header header;
+			std::memcpy(header.magic, magic, sizeof(magic));
+			header.version = version;
+			header.format = static_cast<unsigned int>(format);
+			header.key = key;
+			failed = std::fwrite(&header, sizeof(Header), 1, file) != 1;
+		}
+	}
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to open " << filename << " for writing";
+		throw std::runtime_error(log.str());
+	}
+
+	last_flush.restart();
+	return restored;
+}
+
+void Checkpoint::addTile(const Tile& tile, FrameBuffer& pixels, unsigned long long samples) {
+	//Stored in the format of the image, so restoring the tile gives the very same bits
+	FrameBuffer stored(tile.width, tile.height, format);
+	stored.setTile(0, 0, pixels);
+
+	Record record;
+	record.index = tile.index;
+	record.x = tile.x;
+	record.y = tile.y;
+	record.width = tile.width;
+	record.height = tile.height;
+	record.padding = 0;
+	record.samples = samples;
+	record.hash = hashRecord(record, stored);
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (failed) return;
+	failed = std::fwrite(&record, sizeof(Record), 1, file) != 1
+		|| std::fwrite(stored.getData(), 1, stored.getBytes(), file) != stored.getBytes();
+	if (last_flush.elapsed() > interval) flush();
+}
+
+void Checkpoint::flush() {
+	if (!failed && !sync(file)) failed = true;
+	last_flush.restart();
+}
+
+void Checkpoint::close() {
+	if (!file) return;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		flush();
+	}
+	bool ok = !failed && std::fclose(file) == 0;
+	file = NULL;
+	if (!ok) {
+		std::stringstream log;
+		log << "Unable to write " << filename;
+		throw std::runtime_error(log.str());
+	}
+}
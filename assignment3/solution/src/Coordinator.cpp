@@ -0,0 +1,274 @@
+#include "Coordinator.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+Coordinator::Coordinator(unsigned short port, unsigned int width, unsigned int height) {
+	this->width = width;
+	this->height = height;
+	key = 0;
+	chunk_size = 128;
+	timeout = 600.0;
+	straggler_factor = 3.0;
+	verbose = true;
+	n_connected = 0;
+	first_id = 0;
+	remaining = 0;
+	chunk_seconds = 0.0;
+	n_returned = 0;
+	n_reissued = 0;
+	n_copies = 0;
+	n_discarded = 0;
+
+	listener = Socket::listen(port);
+}
+
+Coordinator::~Coordinator() {
+	close();
+}
+
+void Coordinator::close() {
+	for (unsigned int k=0; k<workers.size(); ++k) {
+		if (!workers[k].ready) continue;
+		Message message = { MESSAGE_QUIT, 0, 0, 0, 0, 0, 0 };
+		try {
+			workers[k].socket->send(&message, sizeof(message));
+		}
+		catch (std::runtime_error&) {
+			//The worker is gone already
+		}
+	}
+	workers.clear();
+}
+
+void Coordinator::render(unsigned long long key, const std::function<void(const Tile&, FrameBuffer&)>& output) {
+	const double start = clock.elapsed();
+
+	//Workers of an earlier frame render with their own settings, which may not be those of this one
+	this->key = key;
+	for (unsigned int w=static_cast<unsigned int>(workers.size()); w-- > 0;) {
+		if (workers[w].ready && workers[w].key != key) drop(w, "renders with other settings than this frame");
+	}
+
+	//Chunks are handed out in Morton order, so that workers render neighbouring parts of the scene
+	TileScheduler layout(width, height, chunk_size);
+	const std::vector<Tile>& tiles = layout.getTiles();
+	first_id += static_cast<unsigned int>(chunks.size());
+	chunks.resize(tiles.size());
+	pending.clear();
+	for (unsigned int k=0; k<chunks.size(); ++k) {
+		chunks[k].tile = tiles[k];
+		chunks[k].done = false;
+		chunks[k].copies = 0;
+		chunks[k].issued = 0.0;
+		pending.push_back(static_cast<unsigned int>(chunks.size())-1-k);
+	}
+	remaining = static_cast<unsigned int>(chunks.size());
+	chunk_seconds = 0.0;
+	n_returned = 0;
+	n_reissued = 0;
+	n_copies = 0;
+	n_discarded = 0;
+	for (unsigned int w=0; w<workers.size(); ++w) {
+		workers[w].rendered = 0;
+	}
+
+	bool waiting = false;
+	std::vector<Socket*> sockets;
+	std::vector<unsigned int> ready;
+	while (remaining > 0) {
+		double now = clock.elapsed();
+
+		//Keep every worker busy, with slow chunks once nothing else is left
+		for (unsigned int w=0; w<workers.size(); ++w) {
+			Worker& worker = workers[w];
+			if (!worker.ready) continue;
+			try {
+				while (worker.chunks.size() < max_chunks_per_worker && !pending.empty()) {
+					unsigned int k = pending.back();
+					pending.pop_back();
+					issue(worker, k, now);
+				}
+				if (worker.chunks.empty()) {
+					unsigned int k = findStraggler(now);
+					if (k < chunks.size()) {
+						issue(worker, k, now);
+						++n_copies;
+					}
+				}
+			}
+			catch (std::runtime_error& e) {
+				drop(w--, e.what());
+			}
+		}
+
+		if (verbose && workers.empty() && !waiting) {
+			std::cout << "Waiting for workers on port " << getPort() << std::endl;
+		}
+		waiting = workers.empty();
+
+		sockets.clear();
+		sockets.push_back(listener.get());
+		for (unsigned int w=0; w<workers.size(); ++w) {
+			sockets.push_back(workers[w].socket.get());
+		}
+		Socket::wait(sockets, 0.25, ready);
+		now = clock.elapsed();
+
+		//Backwards, so that dropping a worker keeps the indices of the others, and new workers come last
+		for (unsigned int r=static_cast<unsigned int>(ready.size()); r-- > 0;) {
+			if (ready[r] == 0) {
+				Worker worker;
+				try {
+					worker.socket = listener->accept();
+					worker.socket->setReceiveTimeout(timeout);
+				}
+				catch (std::runtime_error&) {
+					//The worker gave up before it was accepted
+					continue;
+				}
+				worker.number = ++n_connected;
+				worker.ready = false;
+				worker.last_seen = now;
+				worker.rendered = 0;
+				workers.push_back(worker);
+				continue;
+			}
+
+			const unsigned int w = ready[r]-1;
+			try {
+				receive(workers[w], now, output);
+			}
+			catch (std::runtime_error& e) {
+				drop(w, e.what());
+			}
+		}
+
+		for (unsigned int w=static_cast<unsigned int>(workers.size()); w-- > 0;) {
+			if (!workers[w].chunks.empty() && now - workers[w].last_seen > timeout) drop(w, "timed out");
+		}
+	}
+
+	if (verbose) {
+		std::cout << "Rendered " << chunks.size() << " chunks on " << workers.size() << " workers in "
+			<< clock.elapsed()-start << " seconds, handed out " << n_reissued << " again after losing workers and "
+			<< n_copies << " extra copies of slow chunks (" << n_discarded << " arrived too late)" << std::endl;
+		for (unsigned int w=0; w<workers.size(); ++w) {
+			std::cout << "Worker " << workers[w].number << ": " << workers[w].rendered << " chunks" << std::endl;
+		}
+	}
+}
+
+void Coordinator::issue(Worker& worker, unsigned int k, double now) {
+	Chunk& chunk = chunks[k];
+	Message message = { MESSAGE_CHUNK, first_id+k, chunk.tile.x, chunk.tile.y, chunk.tile.width, chunk.tile.height, 0 };
+	Assignment assignment = { message.id, now };
+
+	//An idle worker has not been silent, it had nothing to say
+	if (worker.chunks.empty()) worker.last_seen = now;
+
+	//Recorded before sending, so that drop() hands the chunk out again if sending fails
+	worker.chunks.push_back(assignment);
+	chunk.copies++;
+	chunk.issued = now;
+	worker.socket->send(&message, sizeof(message));
+}
+
+void Coordinator::receive(Worker& worker, double now, const std::function<void(const Tile&, FrameBuffer&)>& output) {
+	Message message;
+	if (!worker.socket->receive(&message, sizeof(message))) {
+		throw std::runtime_error("disconnected");
+	}
+	worker.last_seen = now;
+
+	if (!worker.ready) {
+		if (message.type != MESSAGE_HELLO || message.id != protocol_version) {
+			throw std::runtime_error("is not a worker of this version");
+		}
+		if (message.width != width || message.height != height) {
+			std::stringstream log;
+			log << "renders " << message.width << "x" << message.height << " instead of " << width << "x" << height;
+			throw std::runtime_error(log.str());
+		}
+		//Sampling, depth, tracing mode and camera all change the pixels, so chunks would not fit together
+		if (message.key != key) {
+			throw std::runtime_error("renders with other settings");
+		}
+		worker.ready = true;
+		worker.key = message.key;
+		if (verbose) std::cout << "Worker " << worker.number << " connected" << std::endl;
+		return;
+	}
+
+	if (message.type != MESSAGE_PIXELS) {
+		throw std::runtime_error("sent an unexpected message");
+	}
+	unsigned int a = 0;
+	while (a < worker.chunks.size() && worker.chunks[a].id != message.id) ++a;
+	if (a == worker.chunks.size()) {
+		throw std::runtime_error("sent a chunk it was not given");
+	}
+	if (message.width == 0 || message.height == 0 || message.x+message.width > width || message.y+message.height > height) {
+		throw std::runtime_error("sent a chunk outside of the image");
+	}
+
+	FrameBuffer pixels(message.width, message.height);
+	std::vector<glm::vec3> row(message.width);
+	for (unsigned int j=0; j<message.height; ++j) {
+		if (!worker.socket->receive(&row[0], row.size()*sizeof(glm::vec3))) {
+			throw std::runtime_error("disconnected");
+		}
+		pixels.setPixels(0, j, message.width, &row[0]);
+	}
+	const double issued = worker.chunks[a].issued;
+	worker.chunks.erase(worker.chunks.begin()+a);
+
+	//Chunks of earlier frames can still arrive from copies of slow chunks
+	if (message.id < first_id || message.id-first_id >= chunks.size()) return;
+	Chunk& chunk = chunks[message.id-first_id];
+	chunk.copies--;
+	if (chunk.done) {
+		++n_discarded;
+		return;
+	}
+
+	chunk.done = true;
+	--remaining;
+	++worker.rendered;
+	chunk_seconds += now - issued;
+	++n_returned;
+	output(chunk.tile, pixels);
+}
+
+void Coordinator::drop(unsigned int k, const char* reason) {
+	Worker& worker = workers[k];
+	for (unsigned int a=0; a<worker.chunks.size(); ++a) {
+		const unsigned int id = worker.chunks[a].id;
+		if (id < first_id || id-first_id >= chunks.size()) continue;
+
+		Chunk& chunk = chunks[id-first_id];
+		chunk.copies--;
+		if (!chunk.done && chunk.copies == 0) {
+			pending.push_back(id-first_id);
+			++n_reissued;
+		}
+	}
+
+	if (verbose) std::cout << "Dropped worker " << worker.number << ": " << reason << std::endl;
+	workers.erase(workers.begin()+k);
+}
+
+unsigned int Coordinator::findStraggler(double now) const {
+	if (n_returned == 0) return static_cast<unsigned int>(chunks.size());
+
+	//Only chunks with a single copy, so that a slow chunk is rendered at most twice
+	const double limit = straggler_factor*chunk_seconds/n_returned;
+	unsigned int slowest = static_cast<unsigned int>(chunks.size());
+	for (unsigned int k=0; k<chunks.size(); ++k) {
+		const Chunk& chunk = chunks[k];
+		if (chunk.done || chunk.copies != 1 || now - chunk.issued <= limit) continue;
+		if (slowest == chunks.size() || chunk.issued < chunks[slowest].issued) slowest = k;
+	}
+	return slowest;
+}
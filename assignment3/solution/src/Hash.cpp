@@ -0,0 +1,32 @@
+#include "Hash.h"
+
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+unsigned long long hashing::hashFiles(const std::vector<std::string>& filenames) {
+	unsigned long long hash = fnv_offset;
+	std::vector<unsigned char> buffer(1 << 16);
+
+	for (unsigned int i=0; i<filenames.size(); ++i) {
+		std::FILE* file = std::fopen(filenames[i].c_str(), "rb");
+		if (!file) {
+			std::stringstream log;
+			log << "Unable to open " << filenames[i];
+			throw std::runtime_error(log.str());
+		}
+
+		unsigned long long length = 0;
+		size_t n;
+		while ((n = std::fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+			fnv1a(hash, buffer.data(), n);
+			length += n;
+		}
+		std::fclose(file);
+
+		//Also hash the length, so that moving bytes between files changes the hash
+		fnv1a(hash, &length, sizeof(length));
+	}
+
+	return hash;
+}
@@ -0,0 +1,69 @@
+#include "Instance.h"
+
+#include "RayTracerState.hpp"
+#include "SceneObjectEffect.hpp"
+#include "RenderCounters.h"
+
+namespace {
+	inline simd::vvec3 transformPoint(const glm::mat4& m, const simd::vvec3& p) {
+		return simd::vvec3(
+			simd::vfloat(m[0][0])*p.x + simd::vfloat(m[1][0])*p.y + simd::vfloat(m[2][0])*p.z + simd::vfloat(m[3][0]),
+			simd::vfloat(m[0][1])*p.x + simd::vfloat(m[1][1])*p.y + simd::vfloat(m[2][1])*p.z + simd::vfloat(m[3][1]),
+			simd::vfloat(m[0][2])*p.x + simd::vfloat(m[1][2])*p.y + simd::vfloat(m[2][2])*p.z + simd::vfloat(m[3][2]));
+	}
+
+	inline simd::vvec3 transformVector(const glm::mat4& m, const simd::vvec3& v) {
+		return simd::vvec3(
+			simd::vfloat(m[0][0])*v.x + simd::vfloat(m[1][0])*v.y + simd::vfloat(m[2][0])*v.z,
+			simd::vfloat(m[0][1])*v.x + simd::vfloat(m[1][1])*v.y + simd::vfloat(m[2][1])*v.z,
+			simd::vfloat(m[0][2])*v.x + simd::vfloat(m[1][2])*v.y + simd::vfloat(m[2][2])*v.z);
+	}
+}
+
+Instance::Instance(std::shared_ptr<const Mesh> mesh, const glm::mat4& transform, std::shared_ptr<SceneObjectEffect> effect) {
+	this->mesh = mesh;
+	this->effect = effect;
+	setTransform(transform);
+}
+
+void Instance::setTransform(const glm::mat4& transform) {
+	this->transform = transform;
+	inverse = glm::inverse(transform);
+	normal_matrix = glm::transpose(glm::mat3(inverse));
+
+	//World bounds: the bounds of the transformed corners of the mesh bounds
+	const AABB mesh_bounds = mesh->getBounds();
+	bounds = AABB();
+	for (unsigned int k=0; k<8; ++k) {
+		glm::vec3 corner((k & 1) ? mesh_bounds.max.x : mesh_bounds.min.x,
+			(k & 2) ? mesh_bounds.max.y : mesh_bounds.min.y,
+			(k & 4) ? mesh_bounds.max.z : mesh_bounds.min.z);
+		bounds.extend(glm::vec3(transform*glm::vec4(corner, 1.0f)));
+	}
+}
+
+HitRecord Instance::intersect(const Ray& r, float t_max) {
+	RenderCounters::add(RenderCounters::INSTANCE_TESTS);
+	Ray r_m(glm::vec3(inverse*glm::vec4(r.getOrigin(), 1.0f)), glm::vec3(inverse*glm::vec4(r.getDirection(), 0.0f)));
+	return mesh->intersect(r_m, t_max, this);
+}
+
+void Instance::intersect(const RayPacket& packet, HitPacket& hits) {
+	RenderCounters::add(RenderCounters::INSTANCE_TESTS, simd::laneCount(packet.getActive()));
+	RayPacket packet_m(transformPoint(inverse, packet.getOrigin()), transformVector(inverse, packet.getDirection()), packet.getActive());
+	mesh->intersect(packet_m, hits, this);
+}
+
+SceneObject* Instance::occluded(const Ray& r, float t_max) {
+	RenderCounters::add(RenderCounters::INSTANCE_TESTS);
+	Ray r_m(glm::vec3(inverse*glm::vec4(r.getOrigin(), 1.0f)), glm::vec3(inverse*glm::vec4(r.getDirection(), 0.0f)));
+	return mesh->occluded(r_m, t_max) ? this : NULL;
+}
+
+glm::vec3 Instance::getNormal(const Ray& ray, const HitRecord& hit) {
+	return glm::normalize(normal_matrix*mesh->getNormal(hit));
+}
+
+glm::vec3 Instance::rayTrace(Ray &ray, const HitRecord& hit, RayTree& tree) {
+	return effect->rayTrace(ray, hit.t, getNormal(ray, hit), tree);
+}
@@ -0,0 +1,46 @@
+#include "InstanceBatch.h"
+
+void InstanceBatch::addInstance(std::shared_ptr<Instance> instance) {
+	instances.push_back(instance);
+	modified = true;
+}
+
+void InstanceBatch::prepare() {
+	std::vector<AABB> bounds(instances.size());
+	for (unsigned int k=0; k<instances.size(); ++k) {
+		bounds[k] = instances[k]->getBounds();
+	}
+
+	if (!modified) {
+		//The instances are stored in leaf order, so their bounds are too
+		bvh.refit(bounds);
+		if (bvh.getCost() <= rebuild_threshold*build_cost) return;
+	}
+
+	bvh.build(bounds, 1);
+	build_cost = bvh.getCost();
+	modified = false;
+
+	const std::vector<unsigned int>& order = bvh.getIndices();
+	std::vector<std::shared_ptr<Instance> > sorted(order.size());
+	for (unsigned int k=0; k<order.size(); ++k) {
+		sorted[k] = instances[order[k]];
+	}
+	instances.swap(sorted);
+}
+
+HitRecord InstanceBatch::intersect(const Ray& r, float t_max) {
+	LeafIntersector leaf(instances, r);
+	bvh.intersect(r, t_max, leaf);
+	return leaf.hit;
+}
+
+void InstanceBatch::intersect(const RayPacket& packet, HitPacket& hits) {
+	PacketLeafIntersector leaf(instances, packet, hits);
+	bvh.intersect(packet, hits.t, leaf);
+}
+
+SceneObject* InstanceBatch::occluded(const Ray& r, float t_max) {
+	OcclusionLeafIntersector leaf(instances, r);
+	return bvh.occluded(r, t_max, leaf) ? leaf.occluder : NULL;
+}
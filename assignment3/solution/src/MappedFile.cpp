@@ -0,0 +1,164 @@
+#include "MappedFile.h"
+
+#include <sstream>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	inline void throwError(const std::string& filename, const char* what) {
+		std::stringstream log;
+		log << "Unable to " << what << " " << filename;
+		throw std::runtime_error(log.str());
+	}
+
+	inline unsigned long getProcessId() {
+#ifdef _WIN32
+		return GetCurrentProcessId();
+#else
+		return static_cast<unsigned long>(getpid());
+#endif
+	}
+
+	/**
+	  * Renames from to to, replacing an existing file to
+	  */
+	inline bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	/**
+	  * Returns true if both files can be read and have the same contents
+	  */
+	bool sameContents(const std::string& a, const std::string& b) {
+		std::FILE* file_a = std::fopen(a.c_str(), "rb");
+		std::FILE* file_b = std::fopen(b.c_str(), "rb");
+		bool same = file_a && file_b;
+		while (same) {
+			char buffer_a[4096], buffer_b[4096];
+			size_t read_a = std::fread(buffer_a, 1, sizeof(buffer_a), file_a);
+			size_t read_b = std::fread(buffer_b, 1, sizeof(buffer_b), file_b);
+			same = read_a == read_b && std::memcmp(buffer_a, buffer_b, read_a) == 0;
+			if (read_a < sizeof(buffer_a)) {
+				same = same && !std::ferror(file_a) && !std::ferror(file_b);
+				break;
+			}
+		}
+		if (file_a) std::fclose(file_a);
+		if (file_b) std::fclose(file_b);
+		return same;
+	}
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+	data = NULL;
+	size = 0;
+	mapping = NULL;
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) throwError(filename, "open");
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throwError(filename, "get the size of");
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+	if (size == 0) return;
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping != NULL) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		if (mapping != NULL) CloseHandle(mapping);
+		CloseHandle(file);
+		throwError(filename, "map");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data != NULL) UnmapViewOfFile(data);
+	if (mapping != NULL) CloseHandle(mapping);
+	CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+	data = NULL;
+	size = 0;
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throwError(filename, "open");
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throwError(filename, "get the size of");
+	}
+	size = static_cast<size_t>(info.st_size);
+	if (size == 0) {
+		close(fd);
+		return;
+	}
+
+	//The mapping stays valid after the descriptor is closed
+	void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) throwError(filename, "map");
+	data = p;
+}
+
+MappedFile::~MappedFile() {
+	if (data != NULL) munmap(const_cast<void*>(data), size);
+}
+
+#endif
+
+void writeFileAtomically(const std::string& filename, const std::function<bool(std::FILE*)>& write) {
+	//Every process writes its own temporary file, the rename makes the file visible at once
+	std::stringstream tmp_filename;
+	tmp_filename << filename << "." << getProcessId() << ".tmp";
+	std::FILE* file = std::fopen(tmp_filename.str().c_str(), "wb");
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to open " << tmp_filename.str() << " for writing";
+		throw std::runtime_error(log.str());
+	}
+
+	bool ok = write(file);
+	ok = (std::fclose(file) == 0) && ok;
+
+	if (!ok) {
+		std::remove(tmp_filename.str().c_str());
+		throwError(filename, "write");
+	}
+
+	//An existing file is replaced, it is stale or it would not be rewritten
+	if (!replaceFile(tmp_filename.str(), filename)) {
+		//On Windows, a concurrent writer may have replaced filename and mapped it
+		//first. That is fine if it wrote the same contents, anything else is an error
+		bool raced = sameContents(tmp_filename.str(), filename);
+		std::remove(tmp_filename.str().c_str());
+		if (!raced) throwError(filename, "replace");
+	}
+}
+
+void writeFileAtomically(const std::string& filename, const void* data, size_t size) {
+	writeFileAtomically(filename, [&](std::FILE* file) {
+		return std::fwrite(data, 1, size, file) == size;
+	});
+}
@@ -0,0 +1,279 @@
+#include "Mesh.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+
+#include "Hash.h"
+
+namespace {
+	const unsigned int import_flags = aiProcessPreset_TargetRealtime_Quality | aiProcess_Triangulate;// | aiProcess_FlipWindingOrder;
+	const unsigned int max_leaf_size = simd::width;
+
+	const char cache_magic[8] = { 'R', 'T', 'B', 'V', 'H', 'C', 'A', 'C' };
+	const unsigned int cache_version = 2; //< Increase when the cache layout or the build changes
+
+	inline size_t alignCache(size_t offset) {
+		return (offset+63)/64*64;
+	}
+}
+
+inline glm::vec3 toVec3(aiVector3D& in) {
+	glm::vec3 out;
+	out.x = in.x;
+	out.y = in.y;
+	out.z = in.z;
+	return out;
+}
+
+Mesh::Mesh(const std::string& filename, bool use_cache) {
+	//The cache depends on the mesh, and on everything that changes what is built from it
+	unsigned long long key = 0;
+	std::string cache_filename = filename + ".bvhcache";
+	if (use_cache) {
+		key = hashing::hashFiles(std::vector<std::string>(1, filename));
+		const unsigned int parameters[] = { cache_version, simd::width, max_leaf_size, import_flags,
+			static_cast<unsigned int>(sizeof(BVH::Node)), static_cast<unsigned int>(sizeof(TriangleBlock)) };
+		hashing::fnv1a(key, parameters, sizeof(parameters));
+	}
+
+	if (!use_cache || !loadCache(cache_filename, key)) {
+		import(filename, key);
+
+		if (use_cache) {
+			//Without a cache the next run is slower, but this one is fine
+			try {
+				saveCache(cache_filename);
+			}
+			catch (std::runtime_error& e) {
+				std::cout << e.what() << std::endl;
+			}
+		}
+	}
+}
+
+void Mesh::import(const std::string& filename, unsigned long long key) {
+	struct aiMatrix4x4 trafo;
+	aiIdentityMatrix4(&trafo);
+
+	const aiScene* scene = aiImportFile(filename.c_str(), import_flags);
+	if (!scene) {
+		std::string log = "Unable to load mesh from ";
+		log.append(filename);
+		throw std::runtime_error(log);
+	}
+
+	//Find the bounds of all vertices
+	min_dim = glm::vec3(std::numeric_limits<float>::max());
+	max_dim = glm::vec3(-std::numeric_limits<float>::max());
+	findBBoxRecursive(scene, scene->mRootNode, &trafo, min_dim, max_dim);
+
+	//Flatten the node hierarchy into one list of triangles, and build the BVH over it
+	std::vector<Triangle> triangles;
+	aiIdentityMatrix4(&trafo);
+	collectTrianglesRecursive(scene, scene->mRootNode, &trafo, triangles);
+	aiReleaseImport(scene);
+
+	std::vector<AABB> bounds(triangles.size());
+	for (unsigned int k=0; k<triangles.size(); ++k) {
+		bounds[k].extend(triangles[k].a);
+		bounds[k].extend(triangles[k].b);
+		bounds[k].extend(triangles[k].c);
+	}
+	bvh.build(bounds, max_leaf_size, simd::width);
+
+	//Store everything in the cache layout, with the triangles in leaf order
+	const std::vector<unsigned int>& order = bvh.getIndices();
+	CacheHeader header;
+	std::memcpy(header.magic, cache_magic, sizeof(header.magic));
+	header.key = key;
+	for (unsigned int c=0; c<3; ++c) {
+		header.min_dim[c] = min_dim[c];
+		header.max_dim[c] = max_dim[c];
+	}
+	header.node_count = bvh.getNodeCount();
+	header.triangle_count = static_cast<unsigned int>(order.size());
+
+	size_t nodes_offset, blocks_offset, normals_offset, size;
+	getCacheLayout(header, nodes_offset, blocks_offset, normals_offset, size);
+	storage.assign(size, 0);
+	std::memcpy(&storage[0], &header, sizeof(header));
+	if (header.node_count > 0) {
+		std::memcpy(&storage[nodes_offset], bvh.getNodes(), header.node_count*sizeof(BVH::Node));
+	}
+
+	TriangleBlock* out_blocks = reinterpret_cast<TriangleBlock*>(&storage[blocks_offset]);
+	glm::vec3* out_normals = reinterpret_cast<glm::vec3*>(&storage[normals_offset]);
+	for (unsigned int k=0; k<order.size(); ++k) {
+		//Padding stays a degenerate triangle at the origin, and is never tested
+		if (order[k] == BVH::padding) continue;
+
+		const Triangle& tri = triangles[order[k]];
+		TriangleBlock& block = out_blocks[k/simd::width];
+		const unsigned int l = k%simd::width;
+		for (unsigned int c=0; c<3; ++c) {
+			block.a[c][l] = tri.a[c];
+			block.e1[c][l] = tri.b[c]-tri.a[c];
+			block.e2[c][l] = tri.c[c]-tri.a[c];
+			out_normals[3*k+c] = tri.normals[c];
+		}
+	}
+
+	attach(&storage[0]);
+}
+
+void Mesh::getCacheLayout(const CacheHeader& header, size_t& nodes, size_t& blocks, size_t& normals, size_t& size) {
+	nodes = alignCache(sizeof(CacheHeader));
+	blocks = alignCache(nodes + header.node_count*sizeof(BVH::Node));
+	normals = alignCache(blocks + (header.triangle_count/simd::width)*sizeof(TriangleBlock));
+	size = normals + 3*static_cast<size_t>(header.triangle_count)*sizeof(glm::vec3);
+}
+
+void Mesh::attach(const unsigned char* data) {
+	CacheHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	min_dim = glm::vec3(header.min_dim[0], header.min_dim[1], header.min_dim[2]);
+	max_dim = glm::vec3(header.max_dim[0], header.max_dim[1], header.max_dim[2]);
+
+	size_t nodes_offset, blocks_offset, normals_offset, size;
+	getCacheLayout(header, nodes_offset, blocks_offset, normals_offset, size);
+	bvh.attach(reinterpret_cast<const BVH::Node*>(data + nodes_offset), header.node_count);
+	blocks = reinterpret_cast<const TriangleBlock*>(data + blocks_offset);
+	normals = reinterpret_cast<const glm::vec3*>(data + normals_offset);
+}
+
+bool Mesh::loadCache(const std::string& filename, unsigned long long key) {
+	std::shared_ptr<MappedFile> file;
+	try {
+		file.reset(new MappedFile(filename));
+	}
+	catch (std::runtime_error&) {
+		//No cache yet
+		return false;
+	}
+
+	const unsigned char* data = static_cast<const unsigned char*>(file->getData());
+	if (file->getSize() < sizeof(CacheHeader)) return false;
+
+	CacheHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, cache_magic, sizeof(header.magic)) != 0 || header.key != key
+			|| header.triangle_count % simd::width != 0) {
+		return false;
+	}
+
+	size_t nodes_offset, blocks_offset, normals_offset, size;
+	getCacheLayout(header, nodes_offset, blocks_offset, normals_offset, size);
+	if (file->getSize() != size) return false;
+
+	cache = file;
+	attach(data);
+	return true;
+}
+
+void Mesh::saveCache(const std::string& filename) const {
+	writeFileAtomically(filename, storage.data(), storage.size());
+}
+
+void Mesh::findBBoxRecursive(const aiScene* scene, const aiNode* node, aiMatrix4x4* trafo,
+	glm::vec3& min_dim, glm::vec3& max_dim) {
+	struct aiMatrix4x4 prev;
+
+	prev = *trafo;
+	aiMultiplyMatrix4(trafo, &node->mTransformation);
+
+	for (unsigned int n=0; n < node->mNumMeshes; ++n) {
+		const struct aiMesh* mesh = scene->mMeshes[node->mMeshes[n]];
+		for (unsigned int t = 0; t < mesh->mNumVertices; ++t) {
+
+			struct aiVector3D tmp = mesh->mVertices[t];
+			aiTransformVecByMatrix4(&tmp,trafo);
+
+			min_dim.x = std::min(min_dim.x,tmp.x);
+			min_dim.y = std::min(min_dim.y,tmp.y);
+			min_dim.z = std::min(min_dim.z,tmp.z);
+
+			max_dim.x = std::max(max_dim.x,tmp.x);
+			max_dim.y = std::max(max_dim.y,tmp.y);
+			max_dim.z = std::max(max_dim.z,tmp.z);
+		}
+	}
+
+	for (unsigned int n = 0; n < node->mNumChildren; ++n)
+		findBBoxRecursive(scene, node->mChildren[n],trafo,min_dim,max_dim);
+	*trafo = prev;
+}
+
+void Mesh::collectTrianglesRecursive(const aiScene* scene, const aiNode* node, aiMatrix4x4* trafo,
+	std::vector<Triangle>& triangles) {
+	struct aiMatrix4x4 prev;
+
+	prev = *trafo;
+	aiMultiplyMatrix4(trafo, &node->mTransformation);
+
+	for (unsigned int n=0; n < node->mNumMeshes; ++n) {
+		const struct aiMesh* mesh = scene->mMeshes[node->mMeshes[n]];
+		for (unsigned int k = 0; k < mesh->mNumFaces; ++k) {
+			const struct aiFace* face = &mesh->mFaces[k];
+
+			if(face->mNumIndices != 3) {
+				std::cout << "Vertex count for face was " << face->mNumIndices << ", expected 3. Skipping face" << std::endl;
+				continue;
+			}
+
+			struct aiVector3D a = mesh->mVertices[face->mIndices[0]];
+			struct aiVector3D b = mesh->mVertices[face->mIndices[1]];
+			struct aiVector3D c = mesh->mVertices[face->mIndices[2]];
+			aiTransformVecByMatrix4(&a, trafo);
+			aiTransformVecByMatrix4(&b, trafo);
+			aiTransformVecByMatrix4(&c, trafo);
+
+			Triangle tri;
+			tri.a = toVec3(a);
+			tri.b = toVec3(b);
+			tri.c = toVec3(c);
+			for (unsigned int v=0; v<3; ++v) {
+				tri.normals[v] = mesh->HasNormals()
+					? toVec3(mesh->mNormals[face->mIndices[v]])
+					: glm::normalize(glm::cross(tri.b-tri.a, tri.c-tri.a));
+			}
+			triangles.push_back(tri);
+		}
+	}
+
+	for (unsigned int n = 0; n < node->mNumChildren; ++n)
+		collectTrianglesRecursive(scene, node->mChildren[n], trafo, triangles);
+	*trafo = prev;
+}
+
+glm::vec3 Mesh::getNormal(const HitRecord& hit) const {
+	const glm::vec3* n = &normals[3*hit.primitive];
+	const float u = hit.barycentric.x;
+	const float v = hit.barycentric.y;
+	return glm::normalize((1.0f-u-v)*n[0] + u*n[1] + v*n[2]);
+}
+
+HitRecord Mesh::intersect(const Ray& r, float t_max, SceneObject* object) const {
+	HitRecord hit;
+	float t_min = t_max;
+
+	LeafIntersector leaf(blocks, r);
+	if (bvh.intersect(r, t_min, leaf)) {
+		hit.t = t_min;
+		hit.primitive = leaf.hit;
+		hit.barycentric = leaf.barycentric;
+		hit.object = object;
+	}
+	return hit;
+}
+
+void Mesh::intersect(const RayPacket& packet, HitPacket& hits, SceneObject* object) const {
+	PacketLeafIntersector leaf(blocks, packet, hits, object);
+	bvh.intersect(packet, hits.t, leaf);
+}
+
+bool Mesh::occluded(const Ray& r, float t_max) const {
+	OcclusionIntersector leaf(blocks, r);
+	return bvh.occluded(r, t_max, leaf);
+}
@@ -0,0 +1,149 @@
+#include "MipTexture.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "PixelFormat.hpp"
+
+namespace {
+	//Loads the four halves of a texel as floats
+	inline __m128 loadTexel(const unsigned short* p) {
+		__m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+		return pixel::halfToFloat(_mm_unpacklo_epi16(h, _mm_setzero_si128()));
+	}
+}
+
+unsigned int MipTexture::mortonCode(unsigned int x, unsigned int y) {
+	//Interleave the lower 16 bits of x and y
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	y = (y | (y << 8)) & 0x00FF00FF;
+	y = (y | (y << 4)) & 0x0F0F0F0F;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+	return x | (y << 1);
+}
+
+void MipTexture::layout(unsigned int width, unsigned int height) {
+	const unsigned int block_size = 1u << block_bits;
+
+	//Every level is padded to a square, power of two number of blocks
+	levels.clear();
+	texel_count = 0;
+	unsigned int w = std::max(width, 1u), h = std::max(height, 1u);
+	while (true) {
+		Level level;
+		level.width = w;
+		level.height = h;
+		level.offset = texel_count;
+		levels.push_back(level);
+
+		unsigned int blocks = std::max((w+block_size-1)/block_size, (h+block_size-1)/block_size);
+		unsigned int grid = 1;
+		while (grid < blocks) grid *= 2;
+		texel_count += grid*grid*block_size*block_size;
+
+		if (w == 1 && h == 1) break;
+		w = std::max(w/2, 1u);
+		h = std::max(h/2, 1u);
+	}
+}
+
+void MipTexture::build(const float* rgb, unsigned int width, unsigned int height) {
+	layout(width, height);
+
+	//The pyramid is filtered in floats, and converted to halves at the end
+	std::vector<float> data(4*static_cast<size_t>(texel_count), 0.0f);
+
+	for (unsigned int y=0; y<height; ++y) {
+		for (unsigned int x=0; x<width; ++x) {
+			float* p = &data[4*texel(levels[0], x, y)];
+			const float* src = &rgb[3*(static_cast<size_t>(y)*width + x)];
+			p[0] = src[0];
+			p[1] = src[1];
+			p[2] = src[2];
+		}
+	}
+
+	//Every level is the 2x2 box filtered previous level
+	for (unsigned int l=1; l<levels.size(); ++l) {
+		const Level& src = levels[l-1];
+		const Level& dst = levels[l];
+		for (unsigned int y=0; y<dst.height; ++y) {
+			for (unsigned int x=0; x<dst.width; ++x) {
+				const unsigned int x0 = std::min(2*x, src.width-1), x1 = std::min(2*x+1, src.width-1);
+				const unsigned int y0 = std::min(2*y, src.height-1), y1 = std::min(2*y+1, src.height-1);
+				__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(&data[4*texel(src, x0, y0)]), _mm_loadu_ps(&data[4*texel(src, x1, y0)])),
+					_mm_add_ps(_mm_loadu_ps(&data[4*texel(src, x0, y1)]), _mm_loadu_ps(&data[4*texel(src, x1, y1)])));
+				_mm_storeu_ps(&data[4*texel(dst, x, y)], _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+			}
+		}
+	}
+
+	storage.resize(data.size());
+	pixel::encodeHalf(data.data(), storage.data(), static_cast<unsigned int>(data.size()));
+	texels = storage.data();
+}
+
+void MipTexture::attach(const void* data, unsigned int width, unsigned int height) {
+	layout(width, height);
+	storage.clear();
+	texels = static_cast<const unsigned short*>(data);
+}
+
+glm::vec3 MipTexture::getTexel(unsigned int level, unsigned int x, unsigned int y) const {
+	float c[4];
+	_mm_storeu_ps(c, loadTexel(&texels[4*texel(levels[level], x, y)]));
+	return glm::vec3(c[0], c[1], c[2]);
+}
+
+void MipTexture::bilinear(const Level& level, float s, float t, float* out) const {
+	//Texel centers are at half integer coordinates
+	float xf = std::min(std::max(s*level.width - 0.5f, 0.0f), level.width - 1.0f);
+	float yf = std::min(std::max(t*level.height - 0.5f, 0.0f), level.height - 1.0f);
+
+	unsigned int xm = static_cast<unsigned int>(xf);
+	unsigned int ym = static_cast<unsigned int>(yf);
+	unsigned int xp = std::min(xm+1, level.width-1);
+	unsigned int yp = std::min(ym+1, level.height-1);
+
+	__m128 xs = _mm_set1_ps(xf - xm);
+	__m128 ys = _mm_set1_ps(yf - ym);
+
+	__m128 c0 = loadTexel(&texels[4*texel(level, xm, ym)]);
+	__m128 c1 = loadTexel(&texels[4*texel(level, xp, ym)]);
+	__m128 c2 = loadTexel(&texels[4*texel(level, xm, yp)]);
+	__m128 c3 = loadTexel(&texels[4*texel(level, xp, yp)]);
+
+	__m128 d0 = _mm_add_ps(c0, _mm_mul_ps(xs, _mm_sub_ps(c1, c0)));
+	__m128 d1 = _mm_add_ps(c2, _mm_mul_ps(xs, _mm_sub_ps(c3, c2)));
+	_mm_storeu_ps(out, _mm_add_ps(d0, _mm_mul_ps(ys, _mm_sub_ps(d1, d0))));
+}
+
+glm::vec3 MipTexture::sample(float s, float t, float lod) const {
+	float c[4];
+	const float max_lod = static_cast<float>(levels.size()-1);
+
+	if (!(lod > 0.0f)) {
+		//Magnification (or NaN lod): bilinear from the finest level
+		bilinear(levels[0], s, t, c);
+		return glm::vec3(c[0], c[1], c[2]);
+	}
+	if (lod >= max_lod) {
+		bilinear(levels.back(), s, t, c);
+		return glm::vec3(c[0], c[1], c[2]);
+	}
+
+	//Trilinear: blend bilinear lookups in the two closest levels
+	unsigned int l = static_cast<unsigned int>(lod);
+	float f = lod - l;
+	float c1[4];
+	bilinear(levels[l], s, t, c);
+	bilinear(levels[l+1], s, t, c1);
+
+	__m128 a = _mm_loadu_ps(c);
+	_mm_storeu_ps(c, _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(f), _mm_sub_ps(_mm_loadu_ps(c1), a))));
+	return glm::vec3(c[0], c[1], c[2]);
+}
@@ -0,0 +1,46 @@
+#include "ProgressReporter.h"
+
+#include <chrono>
+#include <iomanip>
+
+ProgressReporter::ProgressReporter(const RenderCounters& counters, unsigned int n_tiles, double interval, std::ostream& out)
+		: counters(counters), n_tiles(n_tiles), interval(interval), out(out) {
+	stopped = false;
+	thread = std::thread(&ProgressReporter::run, this);
+}
+
+ProgressReporter::~ProgressReporter() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopped = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void ProgressReporter::run() {
+	const std::chrono::milliseconds period(static_cast<long long>(1000.0*interval));
+	std::unique_lock<std::mutex> guard(lock);
+
+	while (!stopped) {
+		wake.wait_for(guard, period);
+		if (stopped) break;
+
+		unsigned int done = counters.getTilesDone();
+		double elapsed = timer.elapsed();
+		double fraction = (n_tiles > 0) ? done/static_cast<double>(n_tiles) : 1.0;
+
+		//The estimate assumes the remaining tiles take as long as the finished ones on average
+		out << "Rendered " << std::fixed << std::setprecision(1) << 100.0*fraction << "% ("
+			<< done << "/" << n_tiles << " tiles) in " << elapsed << " s, "
+			<< std::setprecision(2) << counters.getRaysDone()/(1.0e6*elapsed) << " Mrays/s, ETA ";
+		if (done > 0) {
+			out << std::setprecision(0) << elapsed*(1.0-fraction)/fraction << " s" << std::endl;
+		}
+		else {
+			out << "unknown" << std::endl;
+		}
+		out.unsetf(std::ios::fixed);
+		out << std::setprecision(6);
+	}
+}
@@ -4,18 +4,26 @@
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <cmath>
+#include <fstream>
+#include <algorithm>
 #include <sys/stat.h>
 
 #include <IL/il.h>
 #include <IL/ilu.h>
 
 #include "CubeMap.hpp"
+#include "TiledImageWriter.h"
+#include "Timer.h"
+#include "ProgressReporter.h"
+#include "Hash.h"
 
 RayTracer::RayTracer(unsigned int width, unsigned int height) {
 	const glm::vec3 camera_position(0.0f, 0.0f, 10.0f);
 
-	//Initialize framebuffer and virtual screen
-	fb.reset(new FrameBuffer(width, height));
+	//Initialize virtual screen. The framebuffer is allocated by render()
+	this->width = width;
+	this->height = height;
 	float aspect = width/static_cast<float>(height);
 	screen.top = 1.0f;
 	screen.bottom = -1.0f;
@@ -27,6 +35,23 @@ RayTracer::RayTracer(unsigned int width, unsigned int height) {
 	multisample[1] = glm::vec2(+0.25f, -0.25f);
 	multisample[2] = glm::vec2(-0.25f, +0.25f);
 	multisample[3] = glm::vec2(+0.25f, +0.25f);
+	packet_tracing = true;
+	wavefront = false;
+	tile_size = 32;
+	n_threads = 0;
+	verbose = true;
+	progress_interval = 5.0;
+	checkpoint_interval = 60.0;
+	resume = false;
+	statistics.seconds = 0.0;
+	statistics.first_tile_seconds = 0.0;
+	statistics.primary_rays = 0;
+	statistics.secondary_rays = 0;
+	statistics.restored_tiles = 0;
+	statistics.restored_samples = 0;
+	statistics.threads = 0;
+	fb_format = FrameBuffer::FORMAT_RGB_FLOAT;
+	adaptive.enabled = false;
 	
 	//Initialize state
 	state.reset(new RayTracerState(camera_position));
@@ -43,72 +68,488 @@ void RayTracer::addSceneObject(std::shared_ptr<SceneObject>& o) {
 	state->getScene().push_back(o);
 }
 
-void RayTracer::render() {
-	//For every pixel
-#pragma omp parallel for
-#ifdef _OPENMP
-	for (int j=0; j<static_cast<int>(fb->getHeight()); ++j) {
-#else
-	for (unsigned int j=0; j<fb->getHeight(); ++j) {
-#endif
-		for (unsigned int i=0; i<fb->getWidth(); ++i) {
-			glm::vec3 out_color(0.0, 0.0, 0.0);
+namespace {
+	/**
+	  * Radical inverse in base 2 (van der Corput), the first dimension of the Sobol sequence
+	  */
+	inline float vanDerCorput(unsigned int n) {
+		n = (n << 16) | (n >> 16);
+		n = ((n & 0x00ff00ff) << 8) | ((n & 0xff00ff00) >> 8);
+		n = ((n & 0x0f0f0f0f) << 4) | ((n & 0xf0f0f0f0) >> 4);
+		n = ((n & 0x33333333) << 2) | ((n & 0xcccccccc) >> 2);
+		n = ((n & 0x55555555) << 1) | ((n & 0xaaaaaaaa) >> 1);
+		return n * 2.3283064365386963e-10f;
+	}
+
+	/**
+	  * Second dimension of the Sobol sequence
+	  */
+	inline float sobol2(unsigned int n) {
+		unsigned int r = 0;
+		for (unsigned int v = 1u << 31; n != 0; n >>= 1, v ^= v >> 1) {
+			if (n & 1) r ^= v;
+		}
+		return r * 2.3283064365386963e-10f;
+	}
+
+	inline float luminance(const glm::vec3& c) {
+		return 0.2126f*c.r + 0.7152f*c.g + 0.0722f*c.b;
+	}
+}
+
+void RayTracer::setAdaptiveSampling(unsigned int min_samples, unsigned int max_samples, float threshold) {
+	adaptive.enabled = true;
+	adaptive.min_samples = std::max(min_samples, 2u);
+	adaptive.max_samples = std::max(max_samples, adaptive.min_samples);
+	adaptive.threshold = threshold;
+
+	//The 2D Sobol sequence is a (0,2)-sequence: every prefix of 2^m points is stratified.
+	//Shifting it by 1/8 (modulo 1) turns the first four points into a rotated grid.
+	adaptive.sample_offsets.resize(adaptive.max_samples);
+	for (unsigned int n=0; n<adaptive.max_samples; ++n) {
+		float x = vanDerCorput(n) + 0.125f;
+		float y = sobol2(n) + 0.125f;
+		adaptive.sample_offsets[n] = glm::vec2(x - std::floor(x) - 0.5f, y - std::floor(y) - 0.5f);
+	}
+}
+
+void RayTracer::getPrimaryRay(float x, float y, glm::vec3& origin, glm::vec3& direction) {
+	float z;
+
+	// Create the ray using the view screen definition
+	x = x*(screen.right-screen.left)/static_cast<float>(width) + screen.left;
+	y = y*(screen.top-screen.bottom)/static_cast<float>(height) + screen.bottom;
+	z = -1.0f;
+
+	const glm::mat3& rotation = state->getCamRotation();
+	origin = state->getCamPos() + rotation*glm::vec3(x, y, 0);
+	direction = rotation*glm::vec3(x, y, z);
+}
+
+void RayTracer::renderPackets(const Tile& tile, unsigned int j, FrameBuffer& out, RayTree& tree) {
+	const unsigned int x0 = tile.x;
+	const unsigned int x1 = tile.x+tile.width;
+	const unsigned int n_samples = (x1-x0)*4;
+
+	//The four multisamples of neighbouring pixels are packed into consecutive lanes
+	for (unsigned int n=0; n<n_samples; n+=simd::width) {
+		glm::vec3 origins[simd::width];
+		glm::vec3 directions[simd::width];
+		glm::vec3 colors[simd::width];
+		unsigned int count = std::min(simd::width, n_samples-n);
+
+		for (unsigned int l=0; l<count; ++l) {
+			const unsigned int i = x0+(n+l)/4;
+			const unsigned int k = (n+l)%4;
+			getPrimaryRay(i+multisample[k].x, j+multisample[k].y, origins[l], directions[l]);
+		}
+
+		RayPacket packet(origins, directions, count, getPrimaryConeAngle());
+		state->rayTrace(packet, colors, tree);
+
+		//simd::width is a multiple of 4, so a packet holds whole pixels
+		for (unsigned int p=0; p<count/4; ++p) {
+			glm::vec3 out_color = 0.25f*(colors[4*p] + colors[4*p+1] + colors[4*p+2] + colors[4*p+3]);
+			out.setPixel(n/4+p, j-tile.y, out_color);
+		}
+	}
+}
+
+glm::vec3 RayTracer::renderPixelAdaptive(unsigned int i, unsigned int j, unsigned int& n_samples, RayTree& tree) {
+	const unsigned int batch = packet_tracing ? simd::width : 4;
+	glm::vec3 sum(0.0f);
+	float mean = 0.0f;
+	float m2 = 0.0f;
+	unsigned int n = 0;
+
+	while (n < adaptive.max_samples) {
+		glm::vec3 origins[simd::width];
+		glm::vec3 directions[simd::width];
+		glm::vec3 colors[simd::width];
+		unsigned int count = std::min(batch, adaptive.max_samples-n);
+
+		for (unsigned int l=0; l<count; ++l) {
+			const glm::vec2& offset = adaptive.sample_offsets[n+l];
+			getPrimaryRay(i+offset.x, j+offset.y, origins[l], directions[l]);
+		}
+
+		if (packet_tracing) {
+			RayPacket packet(origins, directions, count, getPrimaryConeAngle());
+			state->rayTrace(packet, colors, tree);
+		}
+		else {
+			for (unsigned int l=0; l<count; ++l) {
+				Ray ray = Ray(origins[l], directions[l], getPrimaryConeAngle());
+				colors[l] = state->rayTrace(ray, tree);
+			}
+		}
+
+		//Welford's online algorithm for the mean and variance of the luminance
+		for (unsigned int l=0; l<count; ++l) {
+			float y = luminance(colors[l]);
+			float delta = y - mean;
+			sum += colors[l];
+			++n;
+			mean += delta/n;
+			m2 += delta*(y - mean);
+		}
+
+		if (n >= adaptive.min_samples) {
+			float standard_error = std::sqrt(m2/((n-1)*static_cast<float>(n)));
+			if (standard_error <= adaptive.threshold) break;
+		}
+	}
+
+	n_samples = n;
+	return sum/static_cast<float>(n);
+}
+
+void RayTracer::renderTile(const Tile& tile, FrameBuffer& out) {
+	//Stack of secondary rays, shared by all primary rays of the tile
+	RayTree tree(*state);
+
+	for (unsigned int j=tile.y; j<tile.y+tile.height; ++j) {
+		if (adaptive.enabled) {
+			for (unsigned int i=tile.x; i<tile.x+tile.width; ++i) {
+				unsigned int n_samples;
+				out.setPixel(i-tile.x, j-tile.y, renderPixelAdaptive(i, j, n_samples, tree));
+			}
+		}
+		else if (packet_tracing) {
+			renderPackets(tile, j, out, tree);
+		}
+		else {
+			for (unsigned int i=tile.x; i<tile.x+tile.width; ++i) {
+				glm::vec3 out_color(0.0, 0.0, 0.0);
+
+				for (int k=0; k<4; ++k) {
+					glm::vec3 origin, direction;
+					getPrimaryRay(i+multisample[k].x, j+multisample[k].y, origin, direction);
 
-			for (int k=0; k<4; ++k) {
-				float t = std::numeric_limits<float>::max();
-				float x, y, z;
-
-				// Create the ray using the view screen definition and multisample location
-				x = i+multisample[k].x;
-				y = j+multisample[k].y;
-
-				x = x*(screen.right-screen.left)/static_cast<float>(fb->getWidth()) + screen.left;
-				y = y*(screen.top-screen.bottom)/static_cast<float>(fb->getHeight()) + screen.bottom;
-				z = -1.0f;
-
-				glm::vec3 origin = state->getCamPos() + glm::vec3(x, y, 0);
-				glm::vec3 focus_point = origin + glm::vec3(x, y, z)*10.0f;
-
-#if 0
-				const unsigned int n_rays = 100;
-
-				for (int i=0; i<n_rays; ++i) {
-					float theta = 6.28318531 * rand() / static_cast<float>(RAND_MAX);
-					float r = 0.2 * rand() / static_cast<float>(RAND_MAX);
-					float x_rand = r*cos(theta);
-					float y_rand = r*sin(theta);
-					glm::vec3 r_origin = (origin + glm::vec3(x_rand, y_rand, 0.0f));
-					glm::vec3 r_direction = focus_point - r_origin;
-					Ray ray = Ray(r_origin, r_direction);
-					
 					//Now do the ray-tracing to shade the pixel
-					out_color += 0.25f*state->rayTrace(ray)/static_cast<float>(n_rays);
+					Ray ray = Ray(origin, direction, getPrimaryConeAngle());
+					out_color += 0.25f*state->rayTrace(ray, tree);
 				}
-#else
-				Ray ray = Ray(origin, glm::vec3(x, y, z));
-				out_color += 0.25f*state->rayTrace(ray);
-#endif
+
+				out.setPixel(i-tile.x, j-tile.y, out_color);
+			}
+		}
+	}
+}
+
+void RayTracer::renderWavefront(const Tile& tile, FrameBuffer& out, WavefrontTracer::Arena& arena) {
+	WavefrontTracer tracer(*state);
+
+	//Queue the multisamples of all pixels in the tile as the first generation
+	arena.reset(tile.width*tile.height);
+	for (unsigned int j=0; j<tile.height; ++j) {
+		for (unsigned int i=0; i<tile.width; ++i) {
+			for (int k=0; k<4; ++k) {
+				glm::vec3 origin, direction;
+				getPrimaryRay(tile.x+i+multisample[k].x, tile.y+j+multisample[k].y, origin, direction);
+				arena.push(Ray(origin, direction, getPrimaryConeAngle()), i+j*tile.width);
 			}
+		}
+	}
+
+	tracer.trace(arena);
 
-			fb->setPixel(i, j, out_color);
+	for (unsigned int j=0; j<tile.height; ++j) {
+		for (unsigned int i=0; i<tile.width; ++i) {
+			out.setPixel(i, j, 0.25f*arena.getColor(i+j*tile.width));
 		}
-		std::cout << "Line " << j << " done (" << 100*j/static_cast<float>(fb->getHeight()) << ")%" << std::endl;
 	}
 }
 
+void RayTracer::render() {
+	if (!fb || fb->getFormat() != fb_format) fb.reset(new FrameBuffer(width, height, fb_format));
+
+	renderTiles(getImageRegion(), fb_format, true, [&](const Tile& tile, FrameBuffer& out) {
+		fb->setTile(tile.x, tile.y, out);
+	});
+}
+
+void RayTracer::renderToFile(std::string filename) {
+	TiledImageWriter writer(filename, width, height);
+
+	renderTiles(getImageRegion(), FrameBuffer::FORMAT_RGB_FLOAT, true, [&](const Tile& tile, FrameBuffer& out) {
+		writer.writeTile(tile.x, tile.y, out);
+	});
+
+	writer.close();
+	std::cout << "Saved " << writer.getFilename() << std::endl;
+	removeCheckpoint();
+}
+
+void RayTracer::renderDistributed(Coordinator& coordinator, std::string filename) {
+	if (coordinator.getWidth() != width || coordinator.getHeight() != height) {
+		std::stringstream log;
+		log << "The coordinator renders " << coordinator.getWidth() << "x" << coordinator.getHeight()
+			<< " instead of " << width << "x" << height;
+		throw std::runtime_error(log.str());
+	}
+
+	//Workers send their chunks as floats, whatever the image is stored as
+	const unsigned long long key = getCheckpointKey(FrameBuffer::FORMAT_RGB_FLOAT);
+
+	std::string::size_type dot = filename.find_last_of('.');
+	std::string extension = (dot == std::string::npos) ? "" : filename.substr(dot+1);
+	if (extension == "ppm" || extension == "pfm") {
+		TiledImageWriter writer(filename, width, height);
+		coordinator.render(key, [&](const Tile& tile, FrameBuffer& out) {
+			writer.writeTile(tile.x, tile.y, out);
+		});
+		writer.close();
+		std::cout << "Saved " << writer.getFilename() << std::endl;
+	}
+	else {
+		if (!fb || fb->getFormat() != fb_format) fb.reset(new FrameBuffer(width, height, fb_format));
+		coordinator.render(key, [&](const Tile& tile, FrameBuffer& out) {
+			fb->setTile(tile.x, tile.y, out);
+		});
+		saveImage(filename);
+	}
+}
+
+void RayTracer::serve(const std::string& host, unsigned short port) {
+	std::shared_ptr<Socket> socket = Socket::connect(host, port);
+	Coordinator::Message message = { Coordinator::MESSAGE_HELLO, Coordinator::protocol_version, 0, 0, width, height,
+		getCheckpointKey(FrameBuffer::FORMAT_RGB_FLOAT) };
+	socket->send(&message, sizeof(message));
+
+	//The scene stays the same for the whole connection, so it is prepared once, not for every chunk
+	prepareScene();
+
+	std::vector<glm::vec3> pixels;
+	while (socket->receive(&message, sizeof(message)) && message.type == Coordinator::MESSAGE_CHUNK) {
+		Tile region = { message.x, message.y, message.width, message.height, 0 };
+		if (region.width == 0 || region.height == 0 || region.x+region.width > width || region.y+region.height > height) {
+			throw std::runtime_error("The coordinator sent a chunk outside of the image");
+		}
+
+		FrameBuffer chunk(region.width, region.height);
+		renderTiles(region, FrameBuffer::FORMAT_RGB_FLOAT, false, [&](const Tile& tile, FrameBuffer& out) {
+			chunk.setTile(tile.x-region.x, tile.y-region.y, out);
+		});
+
+		//Sent in one piece, so the coordinator reads the chunk without waiting on the network
+		pixels.resize(region.width*region.height);
+		for (unsigned int j=0; j<region.height; ++j) {
+			chunk.getPixels(0, j, region.width, &pixels[j*region.width]);
+		}
+		message.type = Coordinator::MESSAGE_PIXELS;
+		socket->send(&message, sizeof(message));
+		socket->send(&pixels[0], pixels.size()*sizeof(glm::vec3));
+	}
+}
+
+void RayTracer::prepareScene() {
+	std::vector<std::shared_ptr<SceneObject> >& scene = state->getScene();
+	for (unsigned int k=0; k<scene.size(); ++k) {
+		scene[k]->prepare();
+	}
+}
+
+void RayTracer::renderTiles(const Tile& region, FrameBuffer::Format format, bool frame,
+		const std::function<void(const Tile&, FrameBuffer&)>& output) {
+	Timer timer;
+
+	if (frame) prepareScene();
+
+	//Split the image into tiles, and let the scheduler balance them over all threads.
+	//Each tile is rendered into its own small buffer, and handed to output when done.
+	TileScheduler scheduler(region.width, region.height, tile_size);
+	const unsigned int threads = TileScheduler::getThreadCount(n_threads);
+	const std::vector<Tile>& tiles = scheduler.getTiles();
+	std::vector<double> tile_done(tiles.size(), std::numeric_limits<double>::infinity());
+	std::vector<WavefrontTracer::Arena> arenas(wavefront ? threads : 0);
+	RenderCounters counters(threads);
+
+	//Tiles of an interrupted render are handed to output as they were, and not rendered again
+	std::unique_ptr<Checkpoint> checkpoint;
+	std::vector<unsigned char> restored(tiles.size(), 0);
+	unsigned int n_restored = 0;
+	unsigned long long restored_samples = 0;
+	if (frame && !checkpoint_file.empty()) {
+		checkpoint.reset(new Checkpoint(checkpoint_file, getCheckpointKey(format), format, checkpoint_interval));
+		n_restored = checkpoint->open(resume, [&](const Tile& tile, FrameBuffer& pixels, unsigned long long samples) {
+			if (tile.index >= tiles.size() || restored[tile.index]) return false;
+			const Tile& expected = tiles[tile.index];
+			if (tile.x != expected.x || tile.y != expected.y || tile.width != expected.width || tile.height != expected.height) return false;
+			restored[tile.index] = 1;
+			restored_samples += samples;
+			output(tile, pixels);
+			return true;
+		});
+		if (verbose && n_restored > 0) {
+			std::cout << "Resumed " << n_restored << " of " << tiles.size() << " tiles (" << restored_samples
+				<< " samples) from " << checkpoint_file << std::endl;
+		}
+	}
+
+	{
+		std::unique_ptr<ProgressReporter> progress;
+		if (verbose && progress_interval > 0.0) {
+			progress.reset(new ProgressReporter(counters, static_cast<unsigned int>(tiles.size())-n_restored, progress_interval, std::cout));
+		}
+
+		scheduler.run([&](const Tile& region_tile, unsigned int thread) {
+			if (restored[region_tile.index]) return;
+
+			Timer tile_timer;
+			Tile tile = region_tile;
+			tile.x += region.x;
+			tile.y += region.y;
+			FrameBuffer out(tile.width, tile.height);
+			counters.attach(thread);
+			const unsigned long long samples = RenderCounters::getRays(0);
+			if (wavefront && !adaptive.enabled) {
+				renderWavefront(tile, out, arenas[thread]);
+			}
+			else {
+				renderTile(tile, out);
+			}
+			if (checkpoint) checkpoint->addTile(tile, out, RenderCounters::getRays(0)-samples);
+			RenderCounters::detach();
+			counters.finishTile(thread, tile_timer.elapsed());
+			output(tile, out);
+			tile_done[tile.index] = timer.elapsed();
+		}, n_threads);
+	}
+	if (checkpoint) checkpoint->close();
+
+	statistics.seconds = timer.elapsed();
+	statistics.first_tile_seconds = (n_restored == tiles.size()) ? 0.0 : *std::min_element(tile_done.begin(), tile_done.end());
+	statistics.restored_tiles = n_restored;
+	statistics.restored_samples = restored_samples;
+	statistics.threads = threads;
+	statistics.counters = counters.getTotals();
+	statistics.primary_rays = statistics.counters.rays[0];
+	statistics.secondary_rays = statistics.counters.getRayCount(1);
+
+	if (verbose) {
+		const RenderCounters::Totals& c = statistics.counters;
+		scheduler.printStatistics(std::cout);
+		double rendered_pixels = 0.0;
+		for (unsigned int k=0; k<tiles.size(); ++k) {
+			if (!restored[k]) rendered_pixels += tiles[k].width*static_cast<double>(tiles[k].height);
+		}
+		std::cout << "Traced " << statistics.primary_rays << " primary rays ("
+			<< ((rendered_pixels > 0.0) ? statistics.primary_rays/rendered_pixels : 0.0) << " per pixel) and "
+			<< statistics.secondary_rays << " secondary rays" << std::endl;
+		std::cout << "Tested " << c.counters[RenderCounters::SPHERE_TESTS] << " spheres, "
+			<< c.counters[RenderCounters::TRIANGLE_TESTS] << " triangles and "
+			<< c.counters[RenderCounters::INSTANCE_TESTS] << " instances, with "
+			<< c.counters[RenderCounters::CUBEMAP_LOOKUPS] << " cube map lookups" << std::endl;
+		std::cout << "Traced " << c.counters[RenderCounters::SHADOW_RAYS] << " shadow rays, "
+			<< c.counters[RenderCounters::OCCLUDER_CACHE_HITS] << " blocked by the last occluder" << std::endl;
+	}
+	if (frame && !summary_file.empty()) writeSummary();
+}
+
+unsigned long long RayTracer::getCheckpointKey(FrameBuffer::Format format) const {
+	unsigned long long key = hashing::fnv_offset;
+	const unsigned int sizes[3] = { width, height, tile_size };
+	const unsigned int modes[3] = { packet_tracing ? 1u : 0u, (wavefront && !adaptive.enabled) ? 1u : 0u, static_cast<unsigned int>(format) };
+	hashing::fnv1a(key, sizes, sizeof(sizes));
+	hashing::fnv1a(key, modes, sizeof(modes));
+	hashing::fnv1a(key, &screen, sizeof(screen));
+	hashing::fnv1a(key, multisample, sizeof(multisample));
+	if (adaptive.enabled) {
+		hashing::fnv1a(key, &adaptive.min_samples, sizeof(adaptive.min_samples));
+		hashing::fnv1a(key, &adaptive.max_samples, sizeof(adaptive.max_samples));
+		hashing::fnv1a(key, &adaptive.threshold, sizeof(adaptive.threshold));
+	}
+
+	const glm::vec3 position = state->getCamPos();
+	const glm::mat3 rotation = state->getCamRotation();
+	const unsigned int depth = state->getMaxDepth();
+	const float threshold = state->getContributionThreshold();
+	const bool roulette = state->useRussianRoulette();
+	hashing::fnv1a(key, &position[0], 3*sizeof(float));
+	for (int c=0; c<3; ++c) hashing::fnv1a(key, &rotation[c][0], 3*sizeof(float));
+	hashing::fnv1a(key, &depth, sizeof(depth));
+	hashing::fnv1a(key, &threshold, sizeof(threshold));
+	hashing::fnv1a(key, &roulette, sizeof(roulette));
+	return key;
+}
+
+void RayTracer::removeCheckpoint() const {
+	if (!checkpoint_file.empty()) std::remove(checkpoint_file.c_str());
+}
+
+void RayTracer::writeSummary() const {
+	std::ofstream file(summary_file.c_str());
+	file << "{\"width\": " << width << ", \"height\": " << height << ", \"threads\": " << statistics.threads
+		<< ", \"seconds\": " << statistics.seconds << ", \"first_tile_seconds\": " << statistics.first_tile_seconds
+		<< ", \"primary_rays\": " << statistics.primary_rays << ", \"secondary_rays\": " << statistics.secondary_rays
+		<< ", \"restored_tiles\": " << statistics.restored_tiles << ", \"restored_samples\": " << statistics.restored_samples
+		<< ", \"counters\": ";
+	statistics.counters.writeJSON(file);
+	file << "}" << std::endl;
+
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to write " << summary_file;
+		throw std::runtime_error(log.str());
+	}
+}
+
+void RayTracer::renderSequence(unsigned int frames, const std::function<void(unsigned int frame)>& update,
+		std::string basename, std::string extension) {
+	const bool stream = (extension == "ppm" || extension == "pfm");
+
+	//Every frame has its own checkpoint, numbered like the images
+	const std::string sequence_checkpoint = checkpoint_file;
+	std::string::size_type dot = sequence_checkpoint.find_last_of('.');
+	if (dot == std::string::npos) dot = sequence_checkpoint.size();
+
+	for (unsigned int frame=0; frame<frames; ++frame) {
+		std::stringstream filename, checkpoint;
+		filename << basename << std::setw(4) << std::setfill('0') << frame << "." << extension;
+		checkpoint << sequence_checkpoint.substr(0, dot) << std::setw(4) << std::setfill('0') << frame
+			<< sequence_checkpoint.substr(dot);
+
+		if (!sequence_checkpoint.empty()) {
+			//The image of a frame exists without its checkpoint only once the frame is done
+			struct stat buffer;
+			if (resume && stat(filename.str().c_str(), &buffer) == 0 && stat(checkpoint.str().c_str(), &buffer) != 0) {
+				if (verbose) std::cout << "Skipped " << filename.str() << ", it is already done" << std::endl;
+				continue;
+			}
+
+			//Created before the image, which streaming starts writing right away
+			std::FILE* file = std::fopen(checkpoint.str().c_str(), "ab");
+			if (file) std::fclose(file);
+			checkpoint_file = checkpoint.str();
+		}
+
+		try {
+			update(frame);
+			if (stream) {
+				renderToFile(filename.str());
+			}
+			else {
+				render();
+				saveImage(filename.str());
+			}
+		}
+		catch (...) {
+			checkpoint_file = sequence_checkpoint;
+			throw;
+		}
+	}
+	checkpoint_file = sequence_checkpoint;
+}
+
 void RayTracer::save(std::string basename, std::string extension) {
-	ILuint texid;
 	struct stat buffer;
 	int i;
 	std::stringstream filename;
 
-	ilOriginFunc(IL_ORIGIN_UPPER_LEFT);
-
-	//Create image
-	ilGenImages(1, &texid);
-	ilBindImage(texid);
-	//FIXME: Ugly const cast:( DevILs fault, unfortunately
-	ilTexImage(fb->getWidth(), fb->getHeight(), 1, 3, IL_RGB, IL_FLOAT, const_cast<float*>(fb->getData().data()));
+	if (!fb) {
+		throw std::runtime_error("Nothing to save, call render() first");
+	}
 
 	//Find an unique filename...
 	for (i=0; i<10000; ++i) {
@@ -123,14 +564,46 @@ void RayTracer::save(std::string basename, std::string extension) {
 		throw std::runtime_error(log.str());
 	}
 
-	if (!ilSaveImage(filename.str().c_str())) {
+	saveImage(filename.str());
+}
+
+void RayTracer::saveImage(const std::string& filename) {
+	ILuint texid;
+
+	if (!fb) {
+		throw std::runtime_error("Nothing to save, call render() first");
+	}
+
+	ilOriginFunc(IL_ORIGIN_UPPER_LEFT);
+
+	//Create image
+	ilGenImages(1, &texid);
+	ilBindImage(texid);
+	ilTexImage(fb->getWidth(), fb->getHeight(), 1, 3, IL_RGB, IL_FLOAT, NULL);
+
+	//Decode the framebuffer in bands, so that only the DevIL image is ever fully stored as floats
+	const unsigned int band_height = 64;
+	std::vector<glm::vec3> band(fb->getWidth()*band_height);
+	for (unsigned int y=0; y<fb->getHeight(); y+=band_height) {
+		unsigned int rows = std::min(band_height, fb->getHeight()-y);
+		for (unsigned int j=0; j<rows; ++j) {
+			fb->getPixels(0, y+j, fb->getWidth(), &band[j*fb->getWidth()]);
+		}
+		ilSetPixels(0, y, 0, fb->getWidth(), rows, 1, IL_RGB, IL_FLOAT, &band[0]);
+	}
+
+	//Overwrite frames of an earlier run of the same sequence
+	ilEnable(IL_FILE_OVERWRITE);
+	bool saved = ilSaveImage(filename.c_str()) != 0;
+	ilDeleteImages(1, &texid);
+
+	if (!saved) {
 		std::stringstream log;
-		log << "Unable to save " << filename.str();
+		log << "Unable to save " << filename;
 		throw std::runtime_error(log.str());
 	}
 	else {
-		std::cout << "Saved " << filename.str() << std::endl;
+		std::cout << "Saved " << filename << std::endl;
 	}
-
-	ilDeleteImages(1, &texid);
-}
\ No newline at end of file
+	removeCheckpoint();
+}
@@ -0,0 +1,126 @@
+#include "RenderCounters.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "SceneObjectEffect.hpp"
+
+RT_THREAD_LOCAL RenderCounters::Block* RenderCounters::current = NULL;
+
+RenderCounters::Totals::Totals() {
+	std::memset(rays, 0, sizeof(rays));
+	std::memset(counters, 0, sizeof(counters));
+	tiles = 0;
+	tile_seconds = 0.0;
+	max_tile_seconds = 0.0;
+}
+
+void RenderCounters::Totals::writeJSON(std::ostream& out) const {
+	static const char* counter_names[COUNTER_COUNT] = {
+		"sphere_tests", "triangle_tests", "instance_tests", "cubemap_lookups", "misses",
+		"shadow_rays", "occluder_cache_hits"
+	};
+
+	out << "{\"tiles\": " << tiles
+		<< ", \"tile_seconds\": {\"mean\": " << (tiles > 0 ? tile_seconds/tiles : 0.0) << ", \"max\": " << max_tile_seconds << "}"
+		<< ", \"rays_per_depth\": [";
+	unsigned int depth = max_depth+1;
+	while (depth > 1 && rays[depth-1] == 0) --depth;
+	for (unsigned int d=0; d<depth; ++d) {
+		out << (d > 0 ? ", " : "") << rays[d];
+	}
+	out << "]";
+	for (unsigned int c=0; c<COUNTER_COUNT; ++c) {
+		out << ", \"" << counter_names[c] << "\": " << counters[c];
+	}
+	out << ", \"effect_hits\": {";
+	for (unsigned int k=0; k<effect_hits.size(); ++k) {
+		out << (k > 0 ? ", " : "") << "\"" << effect_hits[k].first << "\": " << effect_hits[k].second;
+	}
+	out << "}}";
+}
+
+RenderCounters::Block::Block() {
+	std::memset(rays, 0, sizeof(rays));
+	std::memset(counters, 0, sizeof(counters));
+	std::memset(effect_hits, 0, sizeof(effect_hits));
+	n_effects = 0;
+	tiles = 0;
+	tile_seconds = 0.0;
+	max_tile_seconds = 0.0;
+	tiles_done.store(0);
+	rays_done.store(0);
+}
+
+RenderCounters::RenderCounters(unsigned int n_threads) {
+	for (unsigned int t=0; t<n_threads; ++t) {
+		blocks.push_back(std::make_shared<Block>());
+	}
+}
+
+void RenderCounters::attach(unsigned int thread) {
+	current = blocks[thread].get();
+}
+
+void RenderCounters::addEffect(const SceneObjectEffect* effect) {
+	current->effects[current->n_effects] = effect;
+	current->effect_names[current->n_effects] = (effect != NULL) ? effect->getName() : "object";
+	current->n_effects++;
+}
+
+void RenderCounters::finishTile(unsigned int thread, double seconds) {
+	Block& b = *blocks[thread];
+	b.tiles++;
+	b.tile_seconds += seconds;
+	b.max_tile_seconds = std::max(b.max_tile_seconds, seconds);
+
+	//Only this thread writes the published values, so plain relaxed stores suffice
+	unsigned long long n_rays = 0;
+	for (unsigned int d=0; d<=max_depth; ++d) n_rays += b.rays[d];
+	b.rays_done.store(n_rays, std::memory_order_relaxed);
+	b.tiles_done.store(b.tiles, std::memory_order_relaxed);
+}
+
+unsigned int RenderCounters::getTilesDone() const {
+	unsigned int n = 0;
+	for (unsigned int t=0; t<blocks.size(); ++t) {
+		n += blocks[t]->tiles_done.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+unsigned long long RenderCounters::getRaysDone() const {
+	unsigned long long n = 0;
+	for (unsigned int t=0; t<blocks.size(); ++t) {
+		n += blocks[t]->rays_done.load(std::memory_order_relaxed);
+	}
+	return n;
+}
+
+RenderCounters::Totals RenderCounters::getTotals() const {
+	Totals totals;
+	unsigned long long other_hits = 0;
+
+	for (unsigned int t=0; t<blocks.size(); ++t) {
+		const Block& b = *blocks[t];
+		for (unsigned int d=0; d<=max_depth; ++d) totals.rays[d] += b.rays[d];
+		for (unsigned int c=0; c<COUNTER_COUNT; ++c) totals.counters[c] += b.counters[c];
+		totals.tiles += b.tiles;
+		totals.tile_seconds += b.tile_seconds;
+		totals.max_tile_seconds = std::max(totals.max_tile_seconds, b.max_tile_seconds);
+
+		//Effects of the same class share a name, and are reported together
+		for (unsigned int k=0; k<b.n_effects; ++k) {
+			unsigned int e = 0;
+			while (e < totals.effect_hits.size() && std::strcmp(totals.effect_hits[e].first, b.effect_names[k]) != 0) ++e;
+			if (e == totals.effect_hits.size()) {
+				totals.effect_hits.push_back(std::make_pair(b.effect_names[k], 0ull));
+			}
+			totals.effect_hits[e].second += b.effect_hits[k];
+		}
+		other_hits += b.effect_hits[max_effects];
+	}
+
+	if (other_hits > 0) totals.effect_hits.push_back(std::make_pair("other", other_hits));
+	return totals;
+}
@@ -0,0 +1,240 @@
+#include "Socket.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 //< Only Linux raises SIGPIPE on send, the others have no such flag
+#endif
+
+namespace {
+#ifdef _WIN32
+	typedef SOCKET Handle;
+	const Handle invalid_handle = INVALID_SOCKET;
+
+	inline int lastError() { return WSAGetLastError(); }
+	inline void closeHandle(Handle s) { closesocket(s); }
+	inline void setNoInherit(Handle s) { SetHandleInformation(reinterpret_cast<HANDLE>(s), HANDLE_FLAG_INHERIT, 0); }
+
+	/**
+	  * Winsock has to be started before the first socket is created
+	  */
+	struct Startup {
+		Startup() {
+			WSADATA data;
+			if (WSAStartup(MAKEWORD(2, 2), &data) != 0) throw std::runtime_error("Unable to start Winsock");
+		}
+		~Startup() { WSACleanup(); }
+	};
+
+	inline void startup() {
+		static Startup instance;
+	}
+#else
+	typedef int Handle;
+	const Handle invalid_handle = -1;
+
+	inline int lastError() { return errno; }
+	inline void closeHandle(Handle s) { close(s); }
+	inline void setNoInherit(Handle s) { fcntl(s, F_SETFD, FD_CLOEXEC); }
+	inline void startup() {}
+#endif
+
+	inline void throwError(const char* what) {
+		std::stringstream log;
+		log << "Unable to " << what << " (error " << lastError() << ")";
+		throw std::runtime_error(log.str());
+	}
+
+	inline Handle toHandle(size_t handle) { return static_cast<Handle>(handle); }
+
+	/**
+	  * Keeps processes started later, like local workers, from holding the
+	  * socket open after it is closed here
+	  */
+	inline Handle adopt(Handle s) {
+		setNoInherit(s);
+		return s;
+	}
+
+	inline void setNoDelay(Handle s) {
+		//Messages are written in one piece, so there is nothing to gain from Nagle's algorithm
+		int enable = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+	}
+}
+
+Socket::Socket(size_t handle) {
+	this->handle = handle;
+}
+
+Socket::~Socket() {
+	closeHandle(toHandle(handle));
+}
+
+std::shared_ptr<Socket> Socket::connect(const std::string& host, unsigned short port) {
+	startup();
+
+	std::stringstream service;
+	service << port;
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses = NULL;
+	if (getaddrinfo(host.c_str(), service.str().c_str(), &hints, &addresses) != 0) {
+		std::stringstream log;
+		log << "Unable to resolve " << host;
+		throw std::runtime_error(log.str());
+	}
+
+	//Try every address of the host until one accepts the connection
+	Handle s = invalid_handle;
+	for (addrinfo* a=addresses; a != NULL; a = a->ai_next) {
+		s = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s == invalid_handle) continue;
+		adopt(s);
+		if (::connect(s, a->ai_addr, static_cast<socklen_t>(a->ai_addrlen)) == 0) break;
+		closeHandle(s);
+		s = invalid_handle;
+	}
+	freeaddrinfo(addresses);
+
+	if (s == invalid_handle) {
+		std::stringstream log;
+		log << "Unable to connect to " << host << ":" << port;
+		throw std::runtime_error(log.str());
+	}
+	setNoDelay(s);
+	return std::shared_ptr<Socket>(new Socket(static_cast<size_t>(s)));
+}
+
+std::shared_ptr<Socket> Socket::listen(unsigned short port) {
+	startup();
+
+	Handle s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == invalid_handle) throwError("create a socket");
+	adopt(s);
+	std::shared_ptr<Socket> result(new Socket(static_cast<size_t>(s)));
+
+	//Allows restarting the coordinator right away on the same port
+	int enable = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (::bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		std::stringstream log;
+		log << "Unable to listen on port " << port << " (error " << lastError() << ")";
+		throw std::runtime_error(log.str());
+	}
+	if (::listen(s, SOMAXCONN) != 0) throwError("listen");
+	return result;
+}
+
+void Socket::wait(const std::vector<Socket*>& sockets, double timeout, std::vector<unsigned int>& ready) {
+	fd_set readable;
+	FD_ZERO(&readable);
+	Handle max_handle = 0;
+	for (unsigned int k=0; k<sockets.size(); ++k) {
+		Handle s = toHandle(sockets[k]->handle);
+		FD_SET(s, &readable);
+		if (s > max_handle) max_handle = s;
+	}
+
+	timeval tv;
+	tv.tv_sec = static_cast<long>(timeout);
+	tv.tv_usec = static_cast<long>((timeout - tv.tv_sec)*1e6);
+
+	ready.clear();
+	int n = ::select(static_cast<int>(max_handle)+1, &readable, NULL, NULL, &tv);
+	if (n < 0) {
+#ifndef _WIN32
+		if (errno == EINTR) return;
+#endif
+		throwError("wait for sockets");
+	}
+	for (unsigned int k=0; k<sockets.size() && n > 0; ++k) {
+		if (FD_ISSET(toHandle(sockets[k]->handle), &readable)) ready.push_back(k);
+	}
+}
+
+std::shared_ptr<Socket> Socket::accept() {
+	Handle s = ::accept(toHandle(handle), NULL, NULL);
+	if (s == invalid_handle) throwError("accept a connection");
+	adopt(s);
+	setNoDelay(s);
+	return std::shared_ptr<Socket>(new Socket(static_cast<size_t>(s)));
+}
+
+void Socket::send(const void* data, size_t size) {
+	const char* p = static_cast<const char*>(data);
+	while (size > 0) {
+		//Large buffers are sent in pieces, as the length is an int on Windows
+		int n = ::send(toHandle(handle), p, static_cast<int>(std::min<size_t>(size, 1 << 20)), MSG_NOSIGNAL);
+		if (n <= 0) throwError("send");
+		p += n;
+		size -= n;
+	}
+}
+
+bool Socket::receive(void* data, size_t size) {
+	char* p = static_cast<char*>(data);
+	const size_t total = size;
+	while (size > 0) {
+		int n = ::recv(toHandle(handle), p, static_cast<int>(std::min<size_t>(size, 1 << 20)), 0);
+		if (n == 0) {
+			if (size == total) return false;
+			throw std::runtime_error("Connection closed in the middle of a message");
+		}
+		if (n < 0) throwError("receive");
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+void Socket::setReceiveTimeout(double seconds) {
+#ifdef _WIN32
+	DWORD timeout = static_cast<DWORD>(seconds*1000.0);
+#else
+	timeval timeout;
+	timeout.tv_sec = static_cast<long>(seconds);
+	timeout.tv_usec = static_cast<long>((seconds - timeout.tv_sec)*1e6);
+#endif
+	if (setsockopt(toHandle(handle), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout)) != 0) {
+		throwError("set the receive timeout");
+	}
+}
+
+unsigned short Socket::getPort() const {
+	sockaddr_storage address;
+	socklen_t size = sizeof(address);
+	if (getsockname(toHandle(handle), reinterpret_cast<sockaddr*>(&address), &size) != 0) throwError("get the port");
+	if (address.ss_family == AF_INET6) return ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+	return ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+}
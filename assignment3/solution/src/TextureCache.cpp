@@ -0,0 +1,94 @@
+#include "TextureCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "Hash.h"
+
+namespace {
+	const char magic[8] = { 'R', 'T', 'T', 'E', 'X', 'C', 'A', 'C' };
+}
+
+std::string TextureCache::getFilename(const std::string& directory, unsigned long long key) {
+	std::stringstream filename;
+	filename << directory;
+	if (!directory.empty() && directory[directory.size()-1] != '/' && directory[directory.size()-1] != '\\') {
+		filename << "/";
+	}
+	//Files of other versions get other names, so they never replace each other
+	const unsigned int layout_version = version;
+	unsigned long long name = key;
+	hashing::fnv1a(name, &layout_version, sizeof(layout_version));
+	filename << std::hex << std::setw(16) << std::setfill('0') << name << ".texcache";
+	return filename.str();
+}
+
+std::shared_ptr<MappedFile> TextureCache::load(const std::string& filename, unsigned long long key,
+		MipTexture* const* textures, unsigned int count) {
+	std::shared_ptr<MappedFile> file;
+	try {
+		file.reset(new MappedFile(filename));
+	}
+	catch (std::runtime_error&) {
+		//No cache yet
+		return std::shared_ptr<MappedFile>();
+	}
+
+	const unsigned char* data = static_cast<const unsigned char*>(file->getData());
+	const size_t size = file->getSize();
+	if (size < sizeof(Header) + count*sizeof(Entry)) return std::shared_ptr<MappedFile>();
+
+	const Header* header = reinterpret_cast<const Header*>(data);
+	if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != version
+			|| header->count != count || header->key != key) {
+		return std::shared_ptr<MappedFile>();
+	}
+
+	const Entry* entries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+	for (unsigned int i=0; i<count; ++i) {
+		const Entry& entry = entries[i];
+		if (entry.offset % alignment != 0 || entry.offset > size || entry.size > size - entry.offset) {
+			return std::shared_ptr<MappedFile>();
+		}
+		textures[i]->attach(data + entry.offset, entry.width, entry.height);
+		if (textures[i]->getDataSize() != entry.size) return std::shared_ptr<MappedFile>();
+	}
+
+	return file;
+}
+
+void TextureCache::save(const std::string& filename, unsigned long long key,
+		const MipTexture* const* textures, unsigned int count) {
+	Header header;
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.count = count;
+	header.key = key;
+
+	std::vector<Entry> entries(count);
+	unsigned long long offset = sizeof(Header) + count*sizeof(Entry);
+	for (unsigned int i=0; i<count; ++i) {
+		offset = (offset + alignment-1)/alignment*alignment;
+		entries[i].width = textures[i]->getWidth();
+		entries[i].height = textures[i]->getHeight();
+		entries[i].offset = offset;
+		entries[i].size = textures[i]->getDataSize();
+		offset += entries[i].size;
+	}
+
+	writeFileAtomically(filename, [&](std::FILE* file) {
+		bool ok = std::fwrite(&header, sizeof(Header), 1, file) == 1;
+		if (count > 0) ok = ok && std::fwrite(entries.data(), sizeof(Entry), count, file) == count;
+		unsigned long long position = sizeof(Header) + count*sizeof(Entry);
+		const char padding[alignment] = { 0 };
+		for (unsigned int i=0; i<count && ok; ++i) {
+			ok = std::fwrite(padding, 1, static_cast<size_t>(entries[i].offset - position), file) == entries[i].offset - position;
+			ok = ok && std::fwrite(textures[i]->getData(), 1, static_cast<size_t>(entries[i].size), file) == entries[i].size;
+			position = entries[i].offset + entries[i].size;
+		}
+		return ok;
+	});
+}
@@ -0,0 +1,171 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <thread>
+#include <iomanip>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Timer.h"
+
+TileScheduler::TileScheduler(unsigned int width, unsigned int height, unsigned int tile_size) {
+	tile_size = std::max(tile_size, 1u);
+	const unsigned int nx = (width + tile_size - 1) / tile_size;
+	const unsigned int ny = (height + tile_size - 1) / tile_size;
+
+	std::vector<std::pair<unsigned int, Tile> > order;
+	for (unsigned int ty=0; ty<ny; ++ty) {
+		for (unsigned int tx=0; tx<nx; ++tx) {
+			Tile tile;
+			tile.x = tx*tile_size;
+			tile.y = ty*tile_size;
+			tile.width = std::min(tile_size, width - tile.x);
+			tile.height = std::min(tile_size, height - tile.y);
+			order.push_back(std::make_pair(mortonCode(tx, ty), tile));
+		}
+	}
+
+	//Sorting by Morton code also handles grids that are not powers of two
+	std::sort(order.begin(), order.end(),
+		[](const std::pair<unsigned int, Tile>& a, const std::pair<unsigned int, Tile>& b) {
+			return a.first < b.first;
+		});
+
+	tiles.resize(order.size());
+	for (unsigned int k=0; k<order.size(); ++k) {
+		tiles[k] = order[k].second;
+		tiles[k].index = k;
+	}
+	wall_time = 0.0;
+}
+
+unsigned int TileScheduler::mortonCode(unsigned int x, unsigned int y) {
+	//Interleave the lower 16 bits of x and y
+	x &= 0x0000ffff;
+	x = (x | (x << 8)) & 0x00ff00ff;
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	y &= 0x0000ffff;
+	y = (y | (y << 8)) & 0x00ff00ff;
+	y = (y | (y << 4)) & 0x0f0f0f0f;
+	y = (y | (y << 2)) & 0x33333333;
+	y = (y | (y << 1)) & 0x55555555;
+	return x | (y << 1);
+}
+
+unsigned int TileScheduler::getThreadCount(unsigned int n_threads) {
+	if (n_threads == 0) {
+#ifdef _OPENMP
+		n_threads = omp_get_max_threads();
+#else
+		n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+#endif
+	}
+	return n_threads;
+}
+
+void TileScheduler::run(const std::function<void(const Tile&, unsigned int)>& render_tile, unsigned int n_threads) {
+	n_threads = getThreadCount(n_threads);
+
+	//Give each thread a contiguous run of tiles along the curve
+	queues.resize(n_threads);
+	stats.assign(n_threads, ThreadStats());
+	for (unsigned int t=0; t<n_threads; ++t) {
+		queues[t].reset(new WorkQueue());
+		unsigned int begin = static_cast<unsigned int>((tiles.size()*t)/n_threads);
+		unsigned int end = static_cast<unsigned int>((tiles.size()*(t+1))/n_threads);
+		for (unsigned int k=begin; k<end; ++k) {
+			queues[t]->tiles.push_back(k);
+		}
+	}
+
+	Timer timer;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(n_threads)
+	{
+		worker(omp_get_thread_num(), render_tile);
+	}
+#else
+	std::vector<std::thread> threads;
+	for (unsigned int t=1; t<n_threads; ++t) {
+		threads.push_back(std::thread(&TileScheduler::worker, this, t, std::cref(render_tile)));
+	}
+	worker(0, render_tile);
+	for (unsigned int t=0; t<threads.size(); ++t) {
+		threads[t].join();
+	}
+#endif
+	wall_time = timer.elapsed();
+}
+
+void TileScheduler::worker(unsigned int thread, const std::function<void(const Tile&, unsigned int)>& render_tile) {
+	Timer total;
+	Timer busy;
+	ThreadStats& s = stats[thread];
+	unsigned int tile;
+
+	while (true) {
+		if (!pop(thread, tile)) {
+			if (!steal(thread)) break;
+			continue;
+		}
+
+		busy.restart();
+		render_tile(tiles[tile], thread);
+		s.busy += busy.elapsed();
+		s.tiles++;
+	}
+
+	s.total = total.elapsed();
+}
+
+bool TileScheduler::pop(unsigned int thread, unsigned int& tile) {
+	WorkQueue& q = *queues[thread];
+	std::lock_guard<std::mutex> guard(q.lock);
+	if (q.tiles.empty()) return false;
+	tile = q.tiles.front();
+	q.tiles.pop_front();
+	return true;
+}
+
+bool TileScheduler::steal(unsigned int thread) {
+	const unsigned int n = static_cast<unsigned int>(queues.size());
+
+	//Visit the other threads round robin, and take half of the first non-empty queue
+	for (unsigned int k=1; k<n; ++k) {
+		WorkQueue& victim = *queues[(thread+k) % n];
+		std::deque<unsigned int> loot;
+		{
+			std::lock_guard<std::mutex> guard(victim.lock);
+			unsigned int count = static_cast<unsigned int>((victim.tiles.size()+1)/2);
+			for (unsigned int i=0; i<count; ++i) {
+				loot.push_front(victim.tiles.back());
+				victim.tiles.pop_back();
+			}
+		}
+
+		if (!loot.empty()) {
+			WorkQueue& q = *queues[thread];
+			std::lock_guard<std::mutex> guard(q.lock);
+			q.tiles.insert(q.tiles.end(), loot.begin(), loot.end());
+			stats[thread].steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TileScheduler::printStatistics(std::ostream& out) const {
+	out << "Rendered " << tiles.size() << " tiles on " << stats.size() << " threads in " << wall_time << " seconds" << std::endl;
+	for (unsigned int t=0; t<stats.size(); ++t) {
+		double utilization = (wall_time > 0.0) ? 100.0*stats[t].busy/wall_time : 0.0;
+		out << "Thread " << std::setw(2) << t << ": " << std::setw(5) << stats[t].tiles << " tiles, "
+			<< std::setw(3) << stats[t].steals << " steals, "
+			<< std::fixed << std::setprecision(1) << utilization << "% busy" << std::endl;
+		out.unsetf(std::ios_base::floatfield);
+		out << std::setprecision(6);
+	}
+}
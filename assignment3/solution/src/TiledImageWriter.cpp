@@ -0,0 +1,111 @@
+#include "TiledImageWriter.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+
+namespace {
+	//64-bit file offsets, as images above 2 GB are the reason for streaming in the first place
+	inline int seek(std::FILE* file, long long offset) {
+#ifdef _WIN32
+		return _fseeki64(file, offset, SEEK_SET);
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+	}
+
+	inline bool isLittleEndian() {
+		const unsigned int one = 1;
+		return *reinterpret_cast<const unsigned char*>(&one) == 1;
+	}
+}
+
+TiledImageWriter::TiledImageWriter(std::string filename, unsigned int width, unsigned int height) {
+	std::string extension = filename.substr(std::min(filename.rfind('.'), filename.size()));
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	std::stringstream header;
+
+	if (extension == ".ppm") {
+		format = FORMAT_PPM;
+		bytes_per_pixel = 3;
+		header << "P6\n" << width << " " << height << "\n255\n";
+	}
+	else if (extension == ".pfm") {
+		format = FORMAT_PFM;
+		bytes_per_pixel = 3*sizeof(float);
+		//A negative scale means little endian data
+		header << "PF\n" << width << " " << height << "\n" << (isLittleEndian() ? "-1.0" : "1.0") << "\n";
+	}
+	else {
+		std::stringstream log;
+		log << "Unable to stream " << filename << ": only .ppm and .pfm are supported";
+		throw std::runtime_error(log.str());
+	}
+
+	this->filename = filename;
+	this->width = width;
+	this->height = height;
+	header_size = static_cast<long long>(header.str().size());
+	failed = false;
+
+	file = std::fopen(filename.c_str(), "wb");
+	if (!file) {
+		std::stringstream log;
+		log << "Unable to open " << filename << " for writing";
+		throw std::runtime_error(log.str());
+	}
+	std::fwrite(header.str().data(), 1, header.str().size(), file);
+}
+
+TiledImageWriter::~TiledImageWriter() {
+	if (file) std::fclose(file);
+}
+
+void TiledImageWriter::close() {
+	bool ok = !failed && std::fclose(file) == 0;
+	file = NULL;
+	if (!ok) {
+		std::stringstream log;
+		log << "Unable to write " << filename;
+		throw std::runtime_error(log.str());
+	}
+}
+
+long long TiledImageWriter::offset(unsigned int x, unsigned int y) const {
+	//PPM stores the top row first, PFM the bottom row first. Rows are written
+	//so that both show the image like RayTracer::save does.
+	unsigned int row = (format == FORMAT_PPM) ? y : height-1-y;
+	return header_size + (static_cast<long long>(row)*width + x)*bytes_per_pixel;
+}
+
+void TiledImageWriter::writeTile(unsigned int x, unsigned int y, FrameBuffer& tile) {
+	const unsigned int tile_width = tile.getWidth();
+	const unsigned int row_bytes = tile_width*bytes_per_pixel;
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (failed) return;
+	scanline.resize(row_bytes);
+	colors.resize(tile_width);
+
+	for (unsigned int j=0; j<tile.getHeight(); ++j) {
+		tile.getPixels(0, j, tile_width, &colors[0]);
+		const float* src = &colors[0].r;
+
+		if (format == FORMAT_PPM) {
+			for (unsigned int k=0; k<3*tile_width; ++k) {
+				float v = std::min(std::max(src[k], 0.0f), 1.0f);
+				scanline[k] = static_cast<unsigned char>(v*255.0f + 0.5f);
+			}
+		}
+		else {
+			std::copy(reinterpret_cast<const unsigned char*>(src),
+				reinterpret_cast<const unsigned char*>(src) + row_bytes, scanline.begin());
+		}
+
+		if (seek(file, offset(x, y+j)) != 0 || std::fwrite(&scanline[0], 1, row_bytes, file) != row_bytes) {
+			failed = true;
+			return;
+		}
+	}
+}
@@ -0,0 +1,146 @@
+#include "WavefrontTracer.h"
+
+#include <algorithm>
+
+#include "SceneObjectEffect.hpp"
+
+void WavefrontTracer::Arena::reset(unsigned int n_pixels) {
+	rays.clear();
+	pixels.clear();
+	colors.assign(n_pixels, glm::vec3(0.0f));
+	n_rays = 0;
+}
+
+void WavefrontTracer::trace(Arena& arena) {
+	RayTree tree(state);
+
+	//Every generation is one bounce deeper than the one before
+	for (unsigned int depth=0; !arena.rays.empty(); ++depth) {
+		arena.n_rays += static_cast<unsigned int>(arena.rays.size());
+		RenderCounters::addRays(depth, static_cast<unsigned int>(arena.rays.size()));
+		intersect(arena);
+		sort(arena);
+		shade(arena, tree);
+
+		arena.rays.swap(arena.next_rays);
+		arena.pixels.swap(arena.next_pixels);
+	}
+}
+
+void WavefrontTracer::intersect(Arena& arena) {
+	const std::vector<std::shared_ptr<SceneObject> >& scene = state.getScene();
+	const unsigned int n = static_cast<unsigned int>(arena.rays.size());
+	arena.hits.resize(n);
+
+	for (unsigned int k=0; k<n; k+=simd::width) {
+		glm::vec3 origins[simd::width];
+		glm::vec3 directions[simd::width];
+		unsigned int count = std::min(simd::width, n-k);
+
+		for (unsigned int l=0; l<count; ++l) {
+			origins[l] = arena.rays[k+l].getOrigin();
+			directions[l] = arena.rays[k+l].getDirection();
+		}
+
+		RayPacket packet(origins, directions, count);
+		HitPacket hits;
+		for (unsigned int o=0; o<scene.size(); ++o) {
+			scene[o]->intersect(packet, hits);
+		}
+
+		for (unsigned int l=0; l<count; ++l) {
+			arena.hits[k+l] = hits.get(l);
+		}
+	}
+}
+
+void WavefrontTracer::sort(Arena& arena) {
+	const unsigned int n = static_cast<unsigned int>(arena.rays.size());
+
+	//Hits are shaded by their effect, or by the object itself if it has none.
+	//Misses get the NULL key, and are shaded with the background color.
+	arena.ray_bins.resize(n);
+	arena.bins.clear();
+	arena.bin_offsets.clear();
+	for (unsigned int k=0; k<n; ++k) {
+		const HitRecord& hit = arena.hits[k];
+		const void* key = NULL;
+		if (hit.isHit()) {
+			SceneObjectEffect* effect = hit.object->getEffect(hit);
+			key = (effect != NULL) ? static_cast<const void*>(effect) : static_cast<const void*>(hit.object);
+			RenderCounters::addHit(effect);
+		}
+		else {
+			RenderCounters::add(RenderCounters::MISSES);
+		}
+
+		//A scene has only a handful of effects, so a linear search is fine
+		unsigned int b = static_cast<unsigned int>(std::find(arena.bins.begin(), arena.bins.end(), key) - arena.bins.begin());
+		if (b == arena.bins.size()) {
+			arena.bins.push_back(key);
+			arena.bin_offsets.push_back(0);
+		}
+		arena.ray_bins[k] = b;
+		arena.bin_offsets[b]++;
+	}
+
+	//Counting sort of the ray indices by bin: turn the counts into offsets...
+	unsigned int offset = 0;
+	for (unsigned int b=0; b<arena.bin_offsets.size(); ++b) {
+		unsigned int count = arena.bin_offsets[b];
+		arena.bin_offsets[b] = offset;
+		offset += count;
+	}
+	arena.bin_offsets.push_back(offset);
+
+	//...and scatter the indices, which moves every offset to the end of its bin
+	arena.order.resize(n);
+	for (unsigned int k=0; k<n; ++k) {
+		arena.order[arena.bin_offsets[arena.ray_bins[k]]++] = k;
+	}
+	for (unsigned int b=static_cast<unsigned int>(arena.bins.size()); b>0; --b) {
+		arena.bin_offsets[b] = arena.bin_offsets[b-1];
+	}
+	arena.bin_offsets[0] = 0;
+}
+
+void WavefrontTracer::shade(Arena& arena, RayTree& tree) {
+	arena.next_rays.clear();
+	arena.next_pixels.clear();
+
+	for (unsigned int b=0; b<arena.bins.size(); ++b) {
+		const unsigned int begin = arena.bin_offsets[b];
+		const unsigned int end = arena.bin_offsets[b+1];
+
+		if (arena.bins[b] == NULL) {
+			const glm::vec3 background = state.getBackground();
+			for (unsigned int n=begin; n<end; ++n) {
+				const unsigned int k = arena.order[n];
+				arena.colors[arena.pixels[k]] += arena.rays[k].getWeight()*background;
+			}
+			continue;
+		}
+
+		//Every ray in the bin is shaded by the same code, so the loop stays in one code path
+		for (unsigned int n=begin; n<end; ++n) {
+			const unsigned int k = arena.order[n];
+			Ray& ray = arena.rays[k];
+			const HitRecord& hit = arena.hits[k];
+			const unsigned int pixel = arena.pixels[k];
+
+			tree.seed(ray);
+			SceneObjectEffect* effect = hit.object->getEffect(hit);
+			glm::vec3 color = (effect != NULL)
+				? effect->rayTrace(ray, hit.t, hit.object->getNormal(ray, hit), tree)
+				: hit.object->rayTrace(ray, hit, tree);
+			arena.colors[pixel] += ray.getWeight()*color;
+
+			//Secondary rays go to the next generation
+			Ray secondary;
+			while (tree.pop(secondary)) {
+				arena.next_rays.push_back(secondary);
+				arena.next_pixels.push_back(pixel);
+			}
+		}
+	}
+}
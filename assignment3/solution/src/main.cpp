@@ -1,5 +1,11 @@
 #include <iostream>
 #include <string>
+#include <cstdlib>
+#include <stdexcept>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include <thread>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -7,6 +13,7 @@
 
 #include "RayTracer.h"
 #include "Sphere.hpp"
+#include "SphereBatch.hpp"
 #include "CubeMap.hpp"
 #include "Model.h"
 #include "Timer.h"
@@ -16,9 +23,28 @@
  */
 int main(int argc, char *argv[]) {
 	try {
+		//--resume anywhere continues the render of the checkpoint left by an interrupted run
+		bool resume = false;
+		for (int k=1; k<argc; ++k) {
+			if (std::string(argv[k]) != "--resume") continue;
+			resume = true;
+			for (int l=k; l+1<argc; ++l) argv[l] = argv[l+1];
+			--argc;
+			--k;
+		}
+
 		RayTracer* rt;
 		Timer t;
-		rt = new RayTracer(8000, 8000);
+		const unsigned int width = 8000, height = 8000;
+		rt = new RayTracer(width, height);
+		rt->setAdaptiveSampling(4, 64, 0.005f);
+		//Half floats keep the full HDR range of the 8000x8000 image in half the memory
+		rt->setFrameBufferFormat(FrameBuffer::FORMAT_RGB_HALF);
+		//Progress is printed while rendering, and the counters of every frame end up here
+		rt->setSummaryFile("statistics.json");
+		//Finished tiles are logged every minute, so an interruption loses at most that
+		rt->setCheckpointFile("render.checkpoint");
+		rt->setResume(resume);
 		
 		std::shared_ptr<SceneObjectEffect> fresnel(new FresnelEffect());
 		std::shared_ptr<SceneObjectEffect> steel(new SteelEffect());
@@ -27,10 +53,11 @@ int main(int argc, char *argv[]) {
 		std::shared_ptr<SceneObject> s0(new CubeMap(
 			"cubemaps/SaintLazarusChurch3/posx.jpg", "cubemaps/SaintLazarusChurch3/negx.jpg",
 			"cubemaps/SaintLazarusChurch3/posy.jpg", "cubemaps/SaintLazarusChurch3/negy.jpg",
-			"cubemaps/SaintLazarusChurch3/posz.jpg", "cubemaps/SaintLazarusChurch3/negz.jpg"));
+			"cubemaps/SaintLazarusChurch3/posz.jpg", "cubemaps/SaintLazarusChurch3/negz.jpg",
+			"cubemaps"));
 		rt->addSceneObject(s0);
-		std::shared_ptr<SceneObject> s1(new Sphere(glm::vec3(0.0f, 0.0f, 0.0f), 3.0f, fresnel));
-		rt->addSceneObject(s1);
+		std::shared_ptr<SphereBatch> spheres(new SphereBatch());
+		spheres->addSphere(glm::vec3(0.0f, 0.0f, 0.0f), 3.0f, fresnel);
 		/*
 		std::shared_ptr<SceneObject> s2(new Sphere(glm::vec3(-3.0f, -2.0f, 3.0f), 2.0f, steel));
 		rt->addSceneObject(s2);
@@ -40,24 +67,79 @@ int main(int argc, char *argv[]) {
 		rt->addSceneObject(s4);
 		std::shared_ptr<SceneObject> s5(new Model("models/icosahedron.obj", glm::vec3(0.0f, 0.0f, -3.0f), 4.0, fresnel));
 		rt->addSceneObject(s5);*/
-		std::shared_ptr<SceneObject> s6(new Sphere(glm::vec3(-3.5f, 3.5f, -3.0f), 2.0f, steel));
-		rt->addSceneObject(s6);
-		std::shared_ptr<SceneObject> s7(new Sphere(glm::vec3(3.5f, -3.5f, 3.0f), 2.5f, steel));
-		rt->addSceneObject(s7);
-		std::shared_ptr<SceneObject> s8(new Sphere(glm::vec3(-4.0f, -2.0f, 6.0f), 2.5f, steel));
-		rt->addSceneObject(s8);
-		std::shared_ptr<SceneObject> s9(new Sphere(glm::vec3(4.0f, 2.0f, 9.0f), 2.5f, steel));
-		rt->addSceneObject(s9);
+		spheres->addSphere(glm::vec3(-3.5f, 3.5f, -3.0f), 2.0f, steel);
+		spheres->addSphere(glm::vec3(3.5f, -3.5f, 3.0f), 2.5f, steel);
+		spheres->addSphere(glm::vec3(-4.0f, -2.0f, 6.0f), 2.5f, steel);
+		spheres->addSphere(glm::vec3(4.0f, 2.0f, 9.0f), 2.5f, steel);
+		std::shared_ptr<SceneObject> s1(spheres);
+		rt->addSceneObject(s1);
 		/*
 		std::shared_ptr<SceneObject> s10(new Sphere(glm::vec3(0.0f, 3.0f, 9.0f), 2.0f, phong));
 		rt->addSceneObject(s10);
 		*/
 				
 		t.restart();
-		rt->render();
-		double elapsed = t.elapsed();
-		std::cout << "Computed in " << elapsed << " seconds" <<  std::endl;
-		rt->save("test", "jpg");
+		if (argc > 3 && std::string(argv[1]) == "--worker") {
+			//Render chunks for the coordinator at argv[2], port argv[3], with the scene above
+			rt->setVerbose(false);
+			rt->serve(argv[2], static_cast<unsigned short>(std::strtoul(argv[3], NULL, 10)));
+		}
+		else if (argc > 3 && std::string(argv[1]) == "--coordinator") {
+			//Hand out chunks to workers connecting on port argv[2], and save the image as argv[3].
+			//argv[4] workers are started on this machine, for testing or to use its cores as well.
+			rt->setCheckpointFile("");
+			Coordinator coordinator(static_cast<unsigned short>(std::strtoul(argv[2], NULL, 10)), width, height);
+			unsigned int local_workers = (argc > 4) ? static_cast<unsigned int>(std::strtoul(argv[4], NULL, 10)) : 0;
+
+			std::stringstream command;
+			command << "\"" << argv[0] << "\" --worker 127.0.0.1 " << coordinator.getPort();
+#ifdef _WIN32
+			//cmd.exe strips the outer quotes of a command that starts with one
+			std::string line = "\"" + command.str() + "\"";
+#else
+			std::string line = command.str();
+#endif
+			std::vector<std::thread> workers;
+			for (unsigned int k=0; k<local_workers; ++k) {
+				workers.push_back(std::thread([line]() { std::system(line.c_str()); }));
+			}
+
+			rt->renderDistributed(coordinator, argv[3]);
+			coordinator.close();
+			for (unsigned int k=0; k<workers.size(); ++k) {
+				workers[k].join();
+			}
+			std::cout << "Computed in " << t.elapsed() << " seconds" <<  std::endl;
+		}
+		else if (argc > 2) {
+			//Turntable: render argv[2] frames of the camera circling the scene,
+			//saved as argv[1] with the frame number before the extension
+			std::string filename = argv[1];
+			std::string::size_type dot = filename.find_last_of('.');
+			if (dot == std::string::npos) throw std::runtime_error("Sequence filename needs an extension, e.g. frame.ppm");
+			unsigned int frames = static_cast<unsigned int>(std::strtoul(argv[2], NULL, 10));
+
+			rt->renderSequence(frames, [&](unsigned int frame) {
+				float angle = 2.0f*3.14159265f*frame/static_cast<float>(frames);
+				glm::mat4 camera(1.0f);
+				camera[0] = glm::vec4(std::cos(angle), 0.0f, -std::sin(angle), 0.0f);
+				camera[2] = glm::vec4(std::sin(angle), 0.0f, std::cos(angle), 0.0f);
+				camera[3] = glm::vec4(10.0f*camera[2].x, 0.0f, 10.0f*camera[2].z, 1.0f);
+				rt->setCamera(camera);
+			}, filename.substr(0, dot), filename.substr(dot+1));
+			std::cout << "Computed " << frames << " frames in " << t.elapsed() << " seconds" << std::endl;
+		}
+		else if (argc > 1) {
+			//Stream tiles straight to the given .ppm or .pfm file
+			rt->renderToFile(argv[1]);
+			std::cout << "Computed in " << t.elapsed() << " seconds" <<  std::endl;
+		}
+		else {
+			rt->render();
+			double elapsed = t.elapsed();
+			std::cout << "Computed in " << elapsed << " seconds" <<  std::endl;
+			rt->save("test", "jpg");
+		}
 
 		delete rt;
 	} catch (std::exception &e) {
@@ -0,0 +1,45 @@
+#ifndef _AOVBUFFERS_HPP__
+#define _AOVBUFFERS_HPP__
+
+#include <vector>
+#include <limits>
+
+#include "FrameBuffer.hpp"
+
+/**
+  * Auxiliary buffers (arbitrary output variables) written next to the image.
+  * They describe the first surface seen through every pixel, averaged over
+  * the samples of the pixel, and guide the denoiser and the depth of field
+  * post-process.
+  */
+class AOVBuffers {
+public:
+	AOVBuffers(unsigned int width, unsigned int height) :
+			normal(width, height),
+			albedo(width, height),
+			depth(width*height, std::numeric_limits<float>::infinity()),
+			effect_id(width*height, 0),
+			coverage(width*height, 1.0f),
+			variance(width*height, 0.0f) {
+		this->width = width;
+		this->height = height;
+	}
+
+	inline unsigned int getWidth() const { return width; }
+	inline unsigned int getHeight() const { return height; }
+
+	FrameBuffer normal; //< Surface normal, zero where no sample hit
+	FrameBuffer albedo; //< Albedo of the surface, one for the background
+	std::vector<float> depth; //< Distance from the camera along the view direction, infinity where no sample hit
+	std::vector<unsigned int> effect_id; //< Effect seen by the first sample of the pixel, 0 for the background
+	std::vector<float> coverage; //< Fraction of the samples of the pixel that see effect_id
+	std::vector<float> variance; //< Variance of the mean luminance of the pixel, an estimate of its noise
+
+private:
+	AOVBuffers(const AOVBuffers&);
+	AOVBuffers& operator=(const AOVBuffers&);
+
+	unsigned int width, height;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _DENOISER_H__
+#define _DENOISER_H__
+
+#include "FrameBuffer.hpp"
+#include "AOVBuffers.hpp"
+
+/**
+  * Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010, with the
+  * variance guided luminance weight of SVGF, Schied et al. 2017). Every
+  * iteration blurs the image with a 5x5 B3 spline kernel whose taps are
+  * spread 2^i pixels apart, so a few iterations cover a large footprint.
+  * The weight of a tap is cut down where the normal, depth, albedo or effect
+  * differ from the center pixel, and where the luminance differs by more
+  * than the noise of the pixel, so edges and features stay sharp.
+  *
+  * Pixels that see several surfaces, along edges and out of focus, have
+  * features as noisy as their color. The features are trusted only as far
+  * as both pixels see a single surface, so such regions are still smoothed,
+  * guarded by the luminance weight alone.
+  */
+class Denoiser {
+public:
+	Denoiser();
+
+	/**
+	  * Filters image in place, guided by the auxiliary buffers of the render
+	  */
+	void denoise(FrameBuffer& image, const AOVBuffers& aovs);
+
+	/**
+	  * Sets the number of filter iterations, the footprint is 2^(iterations+2)-3 pixels wide
+	  */
+	inline void setIterations(unsigned int iterations) { this->iterations = iterations; }
+
+	/**
+	  * Sets how many standard deviations of noise two luminances may differ
+	  * by and still be blurred together
+	  */
+	inline void setLuminanceSigma(float sigma) { sigma_luminance = sigma; }
+
+	/**
+	  * Sets the exponent of the cosine between two normals in the normal weight
+	  */
+	inline void setNormalPower(float power) { normal_power = power; }
+
+	/**
+	  * Sets the difference in depth, relative to the depth of the center and
+	  * per pixel of distance, that falls off by a factor of e
+	  */
+	inline void setDepthSigma(float sigma) { sigma_depth = sigma; }
+
+	/**
+	  * Sets the difference in albedo that falls off by a factor of e
+	  */
+	inline void setAlbedoSigma(float sigma) { sigma_albedo = sigma; }
+
+private:
+	unsigned int iterations;
+	float sigma_luminance;
+	float normal_power;
+	float sigma_depth;
+	float sigma_albedo;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _DEPTHBLUR_H__
+#define _DEPTHBLUR_H__
+
+#include <vector>
+
+#include "FrameBuffer.hpp"
+
+/**
+  * Depth of field as a post-process of a pinhole image and its depth
+  * buffer: every pixel is spread over its circle of confusion. The spreading
+  * (scatter) is computed as a gather, every pixel collects the pixels whose
+  * circles reach it. Pixels in front of the gathering pixel form a separate
+  * near layer, which is blended over the rest by how much of the pixel it
+  * covers, so blurred foreground spills over sharp background, while blurred
+  * background stays behind sharp foreground.
+  *
+  * The taps lie on a golden angle spiral within the largest circle of
+  * confusion that can reach the pixel, found per tile. Large circles get
+  * fewer taps than pixels, each reading the average color of its share of
+  * the circle from a summed area table, so there are no rings or noise.
+  */
+class DepthBlur {
+public:
+	DepthBlur();
+
+	/**
+	  * Blurs image in place
+	  * @param depth Depth of every pixel, infinity for the background
+	  * @param coc Radius of the circle of confusion of every pixel, in pixels
+	  */
+	void apply(FrameBuffer& image, const std::vector<float>& depth, const std::vector<float>& coc);
+
+	/**
+	  * Sets the largest number of taps per pixel
+	  */
+	inline void setMaxTaps(unsigned int taps) { max_taps = taps; }
+
+	/**
+	  * Sets the largest circle of confusion, larger ones are clamped
+	  */
+	inline void setMaxRadius(float pixels) { max_radius = pixels; }
+
+private:
+	unsigned int max_taps;
+	float max_radius;
+};
+
+#endif
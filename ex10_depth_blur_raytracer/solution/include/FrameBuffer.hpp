@@ -34,6 +34,15 @@ public:
 		data.at(index+2) = color.b;
 	}
 
+	/**
+	  * Returns the color of the pixel at (i, j)
+	  */
+	inline glm::vec3 getPixel(unsigned int i, unsigned int j) const {
+		assert(i < width && j < height);
+		unsigned int index = 3*(i+j*width);
+		return glm::vec3(data[index], data[index+1], data[index+2]);
+	}
+
 private:
 	std::vector<float> data;
 	unsigned int width, height;
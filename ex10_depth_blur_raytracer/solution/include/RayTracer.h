@@ -8,6 +8,10 @@
 #include "FrameBuffer.hpp"
 #include "SceneObject.hpp"
 #include "RayTracerState.hpp"
+#include "Sampler.hpp"
+#include "AOVBuffers.hpp"
+#include "Denoiser.h"
+#include "DepthBlur.h"
 
 /**
   * The RayTracer class is the main entry point for raytracing
@@ -15,6 +19,15 @@
   */
 class RayTracer {
 public:
+	/**
+	  * How depth of field is rendered
+	  */
+	enum DepthOfField {
+		DEPTH_OF_FIELD_NONE, //< Pinhole camera, everything is in focus
+		DEPTH_OF_FIELD_LENS, //< Rays through random points of a thin lens, needs many samples per pixel
+		DEPTH_OF_FIELD_POST  //< Pinhole image blurred by its depth buffer afterwards, see DepthBlur
+	};
+
 	RayTracer(unsigned int width, unsigned int height);
 
 	/**
@@ -27,14 +40,109 @@ public:
 	  */
 	void render();
 
+	/**
+	  * Sets the sample sequence and the number of samples per pixel used for
+	  * antialiasing and depth of field. The image only depends on the sampler,
+	  * sample count and seed, never on the number of threads.
+	  */
+	inline void setSampler(Sampler::Type type, unsigned int samples, unsigned int seed=0) {
+		sampler_type = type;
+		this->samples = samples;
+		this->seed = seed;
+	}
+
+	/**
+	  * Sets how depth of field is rendered. The post-process is a preview
+	  * quality approximation of the lens, with only enough samples per pixel
+	  * for antialiasing, and enables the auxiliary buffers for its depth.
+	  */
+	inline void setDepthOfField(DepthOfField mode) {
+		depth_of_field = mode;
+		if (mode == DEPTH_OF_FIELD_POST) setAOVs(true);
+	}
+
+	/**
+	  * Sets the thin lens of the camera
+	  * @param aperture Radius of the lens
+	  * @param focus_distance Distance from the lens to the plane in focus
+	  */
+	inline void setLens(float aperture, float focus_distance) {
+		this->aperture = aperture;
+		this->focus_distance = focus_distance;
+	}
+
+	inline DepthBlur& getDepthBlur() { return depth_blur; }
+
+	/**
+	  * Enables or disables tracing spheres with color and phong effects
+	  * without virtual calls, see StaticScene. The image is the same either way.
+	  */
+	inline void setStaticDispatch(bool enable) { static_dispatch = enable; }
+
+	/**
+	  * Enables or disables writing the auxiliary buffers (normal, depth,
+	  * albedo, effect id and noise) while rendering, see getAOVs(). Without
+	  * them, denoising is disabled and post-process depth of field falls
+	  * back to the lens.
+	  */
+	void setAOVs(bool enable);
+
+	/**
+	  * Returns the auxiliary buffers of the last render, NULL if disabled
+	  */
+	inline std::shared_ptr<AOVBuffers> getAOVs() { return aovs; }
+
+	/**
+	  * Enables or disables denoising the image after rendering, guided by the
+	  * auxiliary buffers, which are enabled with it
+	  */
+	inline void setDenoising(bool enable) {
+		denoising = enable;
+		if (enable) setAOVs(true);
+	}
+
+	inline Denoiser& getDenoiser() { return denoiser; }
+
 	/**
 	  * Saves the currently rendered frame as an image file
 	  */
 	void save(std::string basename, std::string extension);
 
+	/**
+	  * Saves the normal, albedo and depth buffers as image files, for inspection.
+	  * They get the number of the frame saved last, so basename_normalXXXX
+	  * belongs to basenameXXXX, or the first free number if none was saved
+	  */
+	void saveAOVs(std::string basename, std::string extension);
+
 private:
+	/**
+	  * Saves image to basenameXXXX.extension
+	  * @param index The number XXXX, replacing an existing file, or -1 for the first free number
+	  * @return The number used
+	  */
+	static int saveImage(FrameBuffer& image, std::string basename, std::string extension, int index=-1);
+
+	/**
+	  * Returns the radius in pixels of the circle of confusion of a point at
+	  * depth, the blur of the point when rendered with the lens
+	  */
+	float getCircleOfConfusion(float depth) const;
+
 	std::shared_ptr<FrameBuffer> fb;
+	std::shared_ptr<AOVBuffers> aovs;
+	Denoiser denoiser;
+	bool denoising;
+	DepthBlur depth_blur;
+	DepthOfField depth_of_field;
+	float aperture;
+	float focus_distance;
 	std::shared_ptr<RayTracerState> state;
+	bool static_dispatch;
+	Sampler::Type sampler_type;
+	unsigned int samples;
+	unsigned int seed;
+	int saved_index; //< Number of the frame saved last, -1 if none
 
 	/**
 	  * Defines the virtual screen we project our rays through
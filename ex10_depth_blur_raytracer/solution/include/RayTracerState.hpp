@@ -5,6 +5,7 @@
 
 #include <glm/glm.hpp>
 #include "SceneObject.hpp"
+#include "StaticScene.h"
 
 /**
   * The RayTracerState class keeps track of the state of the ray-tracing:
@@ -20,13 +21,32 @@ public:
 	inline std::vector<std::shared_ptr<SceneObject> >& getScene() { return scene; }
 	inline glm::vec3 getCamPos() { return camera_position; }
 
+	/**
+	  * Copies the scene for rayTrace(), call after changing the scene
+	  * @param static_dispatch If false, all objects are traced through their
+	  *        virtual functions, otherwise only those StaticScene does not know
+	  */
+	inline void prepare(bool static_dispatch=true) {
+		static_scene.build(scene, static_dispatch);
+	}
+
+	/**
+	  * The first intersection of a ray, for the auxiliary buffers
+	  */
+	struct Hit {
+		SceneObject* object; //< NULL if the ray hit nothing
+		float t;
+		glm::vec3 normal;
+	};
+
 	/**
 	  * Performs raycasting on the scene for the ray ray
 	  * @param ray The ray to raycast with
 	  * @param t The parameter so that t*ray gives the first intersection point
+	  * @param hit If not NULL, set to the first intersection of ray
 	  * @return -1 if no intersection found, otherwise the object index in the scene
 	  */
-	inline glm::vec3 rayTrace(Ray& ray) {
+	inline glm::vec3 rayTrace(Ray& ray, Hit* hit=NULL) {
 		const float z_offset = 10e-4f;
 
 		float t = -1;
@@ -35,10 +55,11 @@ public:
 
 		if (!ray.isValid()) return glm::vec3(0.0f);
 
-		//Loop through all the objects, to find the closest intersection, if any
-		//This is essentially just ray-casting
-		for (unsigned int k=0; k<scene.size(); ++k) {
-			t = scene.at(k)->intersect(ray);
+		//Ray-cast the spheres of the static scene inline, then the rest through their virtual functions
+		int s_min = static_scene.intersect(ray, t_min);
+		const std::vector<SceneObject*>& fallback = static_scene.getFallback();
+		for (unsigned int k=0; k<fallback.size(); ++k) {
+			t = fallback[k]->intersect(ray);
 
 			if (t > z_offset && t <= t_min) {
 				k_min = k;
@@ -46,8 +67,26 @@ public:
 			}
 		}
 
+		if (hit) {
+			hit->t = t_min;
+			if (k_min >= 0) {
+				hit->object = fallback[k_min];
+				hit->normal = fallback[k_min]->getNormal(ray, t_min);
+			}
+			else if (s_min >= 0) {
+				hit->object = static_scene.getObject(s_min);
+				hit->normal = static_scene.getNormal(s_min, ray, t_min);
+			}
+			else {
+				hit->object = NULL;
+			}
+		}
+
 		if (k_min >= 0) {
-			return scene.at(k_min)->rayTrace(ray, t_min, *this);
+			return fallback[k_min]->rayTrace(ray, t_min, *this);
+		}
+		else if (s_min >= 0) {
+			return static_scene.shade(s_min, ray, t_min);
 		}
 		else {
 			return glm::vec3(0.3f);
@@ -57,6 +96,7 @@ public:
 
 private:
 	std::vector<std::shared_ptr<SceneObject> > scene;
+	StaticScene static_scene;
 	glm::vec3 camera_position;
 };
 
@@ -0,0 +1,214 @@
+#ifndef _SAMPLER_HPP__
+#define _SAMPLER_HPP__
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+/**
+  * Small and fast PCG32 random number generator (see pcg-random.org).
+  * Every (seed, stream) pair gives an independent sequence, so there is no
+  * shared state between threads.
+  */
+class PCG32 {
+public:
+	PCG32(unsigned long long seed, unsigned long long stream) {
+		state = 0;
+		inc = (stream << 1) | 1;
+		next();
+		state += seed;
+		next();
+	}
+
+	inline unsigned int next() {
+		unsigned long long old = state;
+		state = old*6364136223846793005ULL + inc;
+		unsigned int xorshifted = static_cast<unsigned int>(((old >> 18) ^ old) >> 27);
+		unsigned int rot = static_cast<unsigned int>(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32-rot) & 31));
+	}
+
+	/**
+	  * Returns a uniform float in [0, 1)
+	  */
+	inline float nextFloat() {
+		return (next() >> 8)*(1.0f/16777216.0f);
+	}
+
+private:
+	unsigned long long state;
+	unsigned long long inc;
+};
+
+/**
+  * Generates the samples of one pixel. Samples are addressed by their index
+  * and dimension only, so the result never depends on which thread renders
+  * the pixel, or in which order. The quasi-Monte Carlo sequences are
+  * randomized per pixel, to turn the structured error into noise:
+  * Sobol is Owen scrambled, Halton and R2 get a random toroidal shift.
+  */
+class Sampler {
+public:
+	enum Type {
+		SAMPLER_RANDOM, //< Independent PCG32 random numbers
+		SAMPLER_HALTON, //< Halton sequence, bases 2 and 3 (5 and 7 for the second dimension)
+		SAMPLER_SOBOL,  //< Owen scrambled Sobol (0,2)-sequence
+		SAMPLER_R2      //< Roberts' R2 sequence, generalized to four dimensions
+	};
+
+	Sampler(Type type, unsigned int seed=0) {
+		this->type = type;
+		this->seed = seed;
+		pixel_seed = hash(seed);
+	}
+
+	inline Type getType() const { return type; }
+
+	/**
+	  * Sets the pixel the next samples are drawn for
+	  */
+	inline void startPixel(unsigned int i, unsigned int j) {
+		pixel_seed = hash(seed ^ hash(i ^ hash(j)));
+	}
+
+	/**
+	  * Returns the 2D sample with the given index in [0, 1)^2. Use a different
+	  * dimension for every quantity (pixel position, lens position, etc.)
+	  * that is sampled, so that they are not correlated.
+	  */
+	inline glm::vec2 get2D(unsigned int index, unsigned int dimension) const {
+		const unsigned int dim_seed = hash(pixel_seed + dimension);
+		switch (type) {
+		case SAMPLER_HALTON: {
+			static const unsigned int bases[][2] = { { 2, 3 }, { 5, 7 }, { 11, 13 }, { 17, 19 } };
+			const unsigned int* b = bases[dimension % 4];
+			return glm::vec2(shift(radicalInverse(index, b[0]), hash(dim_seed)),
+				shift(radicalInverse(index, b[1]), hash(dim_seed+1)));
+		}
+		case SAMPLER_SOBOL: {
+			//Shuffle the order of the points per dimension, so that dimensions are not correlated
+			unsigned int i = owenScramble(index, dim_seed);
+			return glm::vec2(toFloat(owenScramble(sobol0(i), hash(dim_seed+1))),
+				toFloat(owenScramble(sobol1(i), hash(dim_seed+2))));
+		}
+		case SAMPLER_R2: {
+			//Powers 1/g^k of the root g of x^5 = x+1, so that the pixel and lens
+			//dimensions together form one 4D sequence (R2 itself would correlate them)
+			static const double alpha[] = { 0.8566748838545029, 0.7338918566271260,
+				0.6287067210378087, 0.5385972572236101 };
+			const double* a = &alpha[2*(dimension % 2)];
+			double x = a[0]*index, y = a[1]*index;
+			return glm::vec2(shift(static_cast<float>(x-std::floor(x)), hash(dim_seed)),
+				shift(static_cast<float>(y-std::floor(y)), hash(dim_seed+1)));
+		}
+		case SAMPLER_RANDOM:
+		default: {
+			PCG32 rng(dim_seed, index);
+			float x = rng.nextFloat();
+			return glm::vec2(x, rng.nextFloat());
+		}
+		}
+	}
+
+	/**
+	  * Maps a point in [0, 1)^2 to the unit disk, using Shirley and Chiu's
+	  * concentric mapping. Unlike rejection sampling this needs exactly one
+	  * sample, and keeps the stratification of the input.
+	  */
+	static inline glm::vec2 squareToDisk(const glm::vec2& u) {
+		const float pi_4 = 0.785398163397448f;
+		float a = 2.0f*u.x - 1.0f;
+		float b = 2.0f*u.y - 1.0f;
+		if (a == 0.0f && b == 0.0f) return glm::vec2(0.0f);
+
+		float r, phi;
+		if (a*a > b*b) {
+			r = a;
+			phi = pi_4*(b/a);
+		}
+		else {
+			r = b;
+			phi = 2.0f*pi_4 - pi_4*(a/b);
+		}
+		return r*glm::vec2(std::cos(phi), std::sin(phi));
+	}
+
+	/**
+	  * Integer hash with good avalanche (the PCG output permutation)
+	  */
+	static inline unsigned int hash(unsigned int x) {
+		unsigned int state = x*747796405u + 2891336453u;
+		unsigned int word = ((state >> ((state >> 28) + 4)) ^ state)*277803737u;
+		return (word >> 22) ^ word;
+	}
+
+private:
+	static inline float toFloat(unsigned int x) {
+		return (x >> 8)*(1.0f/16777216.0f);
+	}
+
+	/**
+	  * Cranley-Patterson rotation by a hashed offset
+	  */
+	static inline float shift(float x, unsigned int offset) {
+		float y = x + toFloat(offset);
+		return (y >= 1.0f) ? y - 1.0f : y;
+	}
+
+	static inline float radicalInverse(unsigned int i, unsigned int base) {
+		const float inv_base = 1.0f/base;
+		float inv = inv_base, result = 0.0f;
+		while (i > 0) {
+			result += (i % base)*inv;
+			i /= base;
+			inv *= inv_base;
+		}
+		return std::min(result, 0.99999994f);
+	}
+
+	static inline unsigned int reverseBits(unsigned int x) {
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+		x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+		x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+		x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+		return x;
+	}
+
+	/**
+	  * First two Sobol dimensions as 32 bit fractions. The first is the van der
+	  * Corput sequence, the second uses the direction numbers of x+1.
+	  */
+	static inline unsigned int sobol0(unsigned int i) {
+		return reverseBits(i);
+	}
+
+	static inline unsigned int sobol1(unsigned int i) {
+		unsigned int result = 0;
+		for (unsigned int v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1) {
+			if (i & 1) result ^= v;
+		}
+		return result;
+	}
+
+	/**
+	  * Hash based nested uniform (Owen) scrambling of a 32 bit fraction,
+	  * following Burley, "Practical Hash-based Owen Scrambling" (JCGT 2020)
+	  */
+	static inline unsigned int owenScramble(unsigned int x, unsigned int seed) {
+		x = reverseBits(x);
+		x += seed;
+		x ^= x*0x6c50b47cu;
+		x ^= x*0xb82f1e52u;
+		x ^= x*0xc7afe638u;
+		x ^= x*0x8d22f6e6u;
+		return reverseBits(x);
+	}
+
+	Type type;
+	unsigned int seed;
+	unsigned int pixel_seed;
+};
+
+#endif
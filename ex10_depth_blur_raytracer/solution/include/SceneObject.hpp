@@ -34,6 +34,19 @@ public:
 	  */
 	virtual glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state) = 0;
 
+	/**
+	  * Returns the surface normal at the intersection t*r, used for the
+	  * auxiliary buffers. Objects without a surface face the ray.
+	  */
+	virtual glm::vec3 getNormal(const Ray& r, const float& t) {
+		return -glm::normalize(r.getDirection());
+	}
+
+	/**
+	  * Returns the effect that shades the object, NULL if it shades itself
+	  */
+	inline SceneObjectEffect* getEffect() const { return effect.get(); }
+
 protected:
 	std::shared_ptr<SceneObjectEffect> effect;
 	SceneObject() {};
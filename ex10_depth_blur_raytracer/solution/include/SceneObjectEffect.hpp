@@ -14,6 +14,12 @@ public:
 	  * and a ray. It can also fire new rays etc.
 	  */
 	virtual glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTracerState& state) = 0;
+
+	/**
+	  * Returns the reflectance of the surface, the color it would have under
+	  * white light. The denoiser keeps edges between different albedos sharp.
+	  */
+	virtual glm::vec3 getAlbedo() const { return glm::vec3(1.0f); }
 private:
 };
 
@@ -30,6 +36,10 @@ public:
 		return color;
 	}
 
+	glm::vec3 getAlbedo() const { return color; }
+
+	inline const glm::vec3& getColor() const { return color; }
+
 private:
 	glm::vec3 color;
 };
@@ -48,6 +58,12 @@ public:
 	}
 
 	glm::vec3 rayTrace(Ray &ray, const float& t, const glm::vec3& normal, RayTracerState& state);
+
+	glm::vec3 getAlbedo() const { return light_diff; }
+
+	inline const glm::vec3& getLightPosition() const { return light_pos; }
+	inline const glm::vec3& getLightDiffuse() const { return light_diff; }
+	inline const glm::vec3& getLightSpecular() const { return light_spec; }
 private:
 	glm::vec3 light_pos; //Light position
 	glm::vec3 light_diff; //Light diffuse component
@@ -30,6 +30,13 @@ public:
 	  */
 	const glm::vec3 computeNormal(const Ray& r, const float& t);
 
+	inline const glm::vec3& getCenter() const { return p; }
+	inline float getRadius() const { return r; }
+
+	glm::vec3 getNormal(const Ray& r, const float& t) {
+		return computeNormal(r, t);
+	}
+
 	glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state) {
 		glm::vec3 normal = computeNormal(ray, t);
 		return effect->rayTrace(ray, t, normal, state);
@@ -0,0 +1,173 @@
+#ifndef _STATICSCENE_H__
+#define _STATICSCENE_H__
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "Ray.hpp"
+#include "SceneObject.hpp"
+
+/**
+  * Computes the ray-sphere intersection
+  * @return The closest t beyond the offset, 0 or -1 if there is none
+  */
+inline float intersectSphere(const glm::vec3& center, float radius, const Ray& r) {
+	const float z_offset = 10e-4f;
+	const glm::vec3 d = r.getDirection();
+	const glm::vec3 p0 = r.getOrigin();
+	float a = glm::dot(d, d);
+	float b = 2.0f*glm::dot(d, (p0-center));
+	float c = glm::dot(p0-center, p0-center)-radius*radius;
+
+	//Solve ax^2 + bx + c = 0
+	if ((b*b-4.0f*a*c) < 0.0f) {
+		//No intersections
+		return false;
+	}
+	else {
+		//One or more intersections
+		float w1 = std::sqrt(b*b - 4.0f*a*c);
+		float w2 = 1.0f/(2.0f*a);
+
+		float t0, t1, tmp;
+		t0 = (-b + w1)*w2;
+		tmp = (-b - w1)*w2;
+		t1 = std::max(t0, tmp); //t1 is the "largest" intersection
+		t0 = std::min(t0, tmp); //t0 is the "smallest" intersection
+
+		if (t0 > z_offset)
+			return t0;
+		else if (t1 > z_offset)
+			return t1;
+		else
+			return -1;
+	}
+}
+
+/**
+  * Computes the normal of a sphere at the intersection point t*r
+  */
+inline glm::vec3 sphereNormal(const glm::vec3& center, float radius, const Ray& r, float t) {
+	return (r.getOrigin() + t*r.getDirection() - center) / radius;
+}
+
+/**
+  * Phong shading of the intersection point t*ray with a single point light
+  */
+inline glm::vec3 shadePhong(const glm::vec3& light_pos, const glm::vec3& light_diff, const glm::vec3& light_spec,
+		const Ray& ray, float t, const glm::vec3& normal) {
+	glm::vec3 p = ray.getOrigin() + t*ray.getDirection();
+	glm::vec3 l = glm::normalize(light_pos - p);
+	glm::vec3 v = glm::normalize(-ray.getDirection());
+	glm::vec3 h = glm::normalize(l+v);
+
+	glm::vec3 out_color = glm::vec3(0.0);
+	out_color += std::max(glm::dot(normal, l), 0.0f)*light_diff;
+	out_color += std::pow(glm::dot(normal, h), 128.0f)*light_spec;
+
+	return out_color;
+}
+
+/**
+  * Statically dispatched copy of the scene. The primitives and effects the
+  * ray tracer knows, spheres with color or phong effects, are copied into
+  * flat arrays: spheres as a structure of arrays, effects as a tag with
+  * their parameters. Intersection and shading of these are plain inline
+  * functions selected by a switch, so they are inlined into the loop over
+  * the scene instead of being called through two virtual functions each.
+  *
+  * Every other object, including subclasses of Sphere and objects with
+  * other effects, stays in a list of fallback objects that are intersected
+  * and shaded through their virtual functions as before.
+  */
+class StaticScene {
+public:
+	/**
+	  * The closed set of effects
+	  */
+	enum EffectType {
+		EFFECT_COLOR, //< ColorEffect
+		EFFECT_PHONG  //< PhongEffect
+	};
+
+	/**
+	  * Copies the scene. The objects must outlive the copy, it keeps plain pointers to them.
+	  * @param closed If false, all objects are fallback objects, for comparison
+	  */
+	void build(const std::vector<std::shared_ptr<SceneObject> >& scene, bool closed=true);
+
+	/**
+	  * Finds the closest sphere the ray hits closer than t_min
+	  * @param t_min Set to the parameter of the intersection, if found
+	  * @return -1 if no intersection found, otherwise the sphere index
+	  */
+	inline int intersect(const Ray& ray, float& t_min) const {
+		const float z_offset = 10e-4f;
+		int k_min = -1;
+		for (unsigned int k=0; k<radius.size(); ++k) {
+			float t = intersectSphere(glm::vec3(center_x[k], center_y[k], center_z[k]), radius[k], ray);
+
+			if (t > z_offset && t <= t_min) {
+				k_min = k;
+				t_min = t;
+			}
+		}
+		return k_min;
+	}
+
+	/**
+	  * Returns the normal of sphere k at the intersection point t*ray
+	  */
+	inline glm::vec3 getNormal(unsigned int k, const Ray& ray, float t) const {
+		return sphereNormal(glm::vec3(center_x[k], center_y[k], center_z[k]), radius[k], ray, t);
+	}
+
+	/**
+	  * Shades the intersection point t*ray on sphere k
+	  */
+	inline glm::vec3 shade(unsigned int k, const Ray& ray, float t) const {
+		const Effect& effect = effects[sphere_effect[k]];
+		switch (effect.type) {
+		case EFFECT_COLOR:
+			return effect.color;
+		case EFFECT_PHONG:
+			return shadePhong(effect.light_pos, effect.light_diff, effect.light_spec, ray, t, getNormal(k, ray, t));
+		default:
+			return glm::vec3(0.0f);
+		}
+	}
+
+	/**
+	  * Returns the scene object sphere k was copied from
+	  */
+	inline SceneObject* getObject(unsigned int k) const { return sphere_object[k]; }
+
+	/**
+	  * Returns the objects that are dispatched through their virtual functions
+	  */
+	inline const std::vector<SceneObject*>& getFallback() const { return fallback; }
+
+private:
+	/**
+	  * An effect of the closed set, only the parameters of its type are used
+	  */
+	struct Effect {
+		EffectType type;
+		glm::vec3 color;
+		glm::vec3 light_pos;
+		glm::vec3 light_diff;
+		glm::vec3 light_spec;
+	};
+
+	std::vector<float> center_x, center_y, center_z, radius;
+	std::vector<unsigned int> sphere_effect; //< Index into effects
+	std::vector<SceneObject*> sphere_object;
+	std::vector<Effect> effects;
+	std::vector<SceneObject*> fallback;
+};
+
+#endif
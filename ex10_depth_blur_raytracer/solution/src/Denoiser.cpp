@@ -0,0 +1,263 @@
+#include "Denoiser.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <emmintrin.h>
+
+namespace {
+	/**
+	  * The image with one plane per channel, so that four neighbouring
+	  * pixels are a single SSE load
+	  */
+	struct Planes {
+		Planes(unsigned int size) : r(size), g(size), b(size), variance(size) {}
+
+		std::vector<float> r, g, b;
+		std::vector<float> variance;
+	};
+
+	/**
+	  * Weights of the B3 spline kernel, by the distance from the center tap
+	  */
+	const float kernel[3] = { 3.0f/8.0f, 1.0f/4.0f, 1.0f/16.0f };
+
+	inline float luminance(float r, float g, float b) {
+		return 0.2126f*r + 0.7152f*g + 0.0722f*b;
+	}
+
+	/**
+	  * e^x for x <= 0, to a relative error of 2e-4: 2^(x/ln 2) is split into
+	  * an integer power, written straight into the exponent bits, and a cubic
+	  * for the fraction. Four at a time, unlike std::exp.
+	  */
+	inline __m128 fastExp(__m128 x) {
+		const __m128 t = _mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_mul_ps(x, _mm_set1_ps(1.442695041f)), _mm_set1_ps(-126.0f)), _mm_setzero_ps()), _mm_set1_ps(127.0f));
+		const __m128i i = _mm_cvttps_epi32(t);
+		const __m128 f = _mm_sub_ps(t, _mm_cvtepi32_ps(i));
+		const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(i, 23));
+		__m128 poly = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.0790209f)), _mm_set1_ps(0.2244947f));
+		poly = _mm_add_ps(_mm_mul_ps(f, poly), _mm_set1_ps(0.6960656f));
+		poly = _mm_add_ps(_mm_mul_ps(f, poly), _mm_set1_ps(1.0f));
+		return _mm_mul_ps(scale, poly);
+	}
+
+	inline float fastExp(float x) {
+		return _mm_cvtss_f32(fastExp(_mm_set_ss(x)));
+	}
+
+	inline __m128 absolute(__m128 x) {
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+	}
+
+	/**
+	  * The features of the image, and the edge-stopping weight between two of
+	  * its pixels, for one tap of the kernel
+	  */
+	struct Guide {
+		const float *nx, *ny, *nz, *depth, *ar, *ag, *ab, *purity;
+		const unsigned int* id;
+		const float *lum, *sigma; //< Luminance of the image, and its allowed difference
+		float normal_power;
+		float inv_distance; //< 1/(depth sigma * distance of the tap in pixels)
+		float inv_sigma_albedo2;
+
+		/**
+		  * Returns the weights of pixels q to q+3 in the filter of pixels p to p+3
+		  */
+		inline __m128 weight(int p, int q) const {
+			const __m128 e_luminance = _mm_div_ps(absolute(_mm_sub_ps(_mm_loadu_ps(lum+p), _mm_loadu_ps(lum+q))), _mm_loadu_ps(sigma+p));
+
+			const __m128 depth_p = _mm_loadu_ps(depth+p);
+			const __m128 e_depth = _mm_div_ps(_mm_mul_ps(absolute(_mm_sub_ps(depth_p, _mm_loadu_ps(depth+q))), _mm_set1_ps(inv_distance)),
+				_mm_add_ps(depth_p, _mm_set1_ps(1e-4f)));
+
+			const __m128 da_r = _mm_sub_ps(_mm_loadu_ps(ar+p), _mm_loadu_ps(ar+q));
+			const __m128 da_g = _mm_sub_ps(_mm_loadu_ps(ag+p), _mm_loadu_ps(ag+q));
+			const __m128 da_b = _mm_sub_ps(_mm_loadu_ps(ab+p), _mm_loadu_ps(ab+q));
+			const __m128 e_albedo = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(da_r, da_r), _mm_mul_ps(da_g, da_g)), _mm_mul_ps(da_b, da_b)),
+				_mm_set1_ps(inv_sigma_albedo2));
+
+			//e^(n(cos-1)) is close to cos^n, and shares the exponential with the other weights
+			const __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(nx+p), _mm_loadu_ps(nx+q)),
+				_mm_mul_ps(_mm_loadu_ps(ny+p), _mm_loadu_ps(ny+q))), _mm_mul_ps(_mm_loadu_ps(nz+p), _mm_loadu_ps(nz+q)));
+			const __m128 e_normal = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), cosine), _mm_set1_ps(normal_power));
+
+			//Only trusted as far as both pixels see a single surface, the luminance weight guards the rest
+			const __m128 trust = _mm_min_ps(_mm_loadu_ps(purity+p), _mm_loadu_ps(purity+q));
+			const __m128i same = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(id+p)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(id+q)));
+			const __m128 w_id = _mm_max_ps(_mm_and_ps(_mm_castsi128_ps(same), _mm_set1_ps(1.0f)), _mm_sub_ps(_mm_set1_ps(1.0f), trust));
+
+			const __m128 exponent = _mm_add_ps(e_luminance, _mm_mul_ps(trust, _mm_add_ps(_mm_add_ps(e_normal, e_depth), e_albedo)));
+			return _mm_mul_ps(w_id, fastExp(_mm_sub_ps(_mm_setzero_ps(), exponent)));
+		}
+
+		/**
+		  * Returns the weight of pixel q in the filter of pixel p
+		  */
+		inline float weight1(int p, int q) const {
+			const float e_luminance = std::abs(lum[p]-lum[q])/sigma[p];
+			const float e_depth = std::abs(depth[p]-depth[q])*inv_distance/(depth[p] + 1e-4f);
+			const float da_r = ar[p]-ar[q], da_g = ag[p]-ag[q], da_b = ab[p]-ab[q];
+			const float e_albedo = (da_r*da_r + da_g*da_g + da_b*da_b)*inv_sigma_albedo2;
+			const float e_normal = normal_power*(1.0f - (nx[p]*nx[q] + ny[p]*ny[q] + nz[p]*nz[q]));
+
+			const float trust = std::min(purity[p], purity[q]);
+			const float w_id = (id[p] == id[q]) ? 1.0f : 1.0f-trust;
+			return w_id*fastExp(-(e_luminance + trust*(e_normal + e_depth + e_albedo)));
+		}
+	};
+}
+
+Denoiser::Denoiser() {
+	iterations = 3;
+	sigma_luminance = 4.0f;
+	normal_power = 128.0f;
+	sigma_depth = 0.1f;
+	sigma_albedo = 0.3f;
+}
+
+void Denoiser::denoise(FrameBuffer& image, const AOVBuffers& aovs) {
+	const int width = static_cast<int>(aovs.getWidth());
+	const int height = static_cast<int>(aovs.getHeight());
+	const unsigned int size = width*height;
+	const std::vector<float>& color = image.getData();
+
+	//Features of the center pixel are compared to every tap, keep them in planes too
+	std::vector<float> nx(size), ny(size), nz(size), depth(size), ar(size), ag(size), ab(size), purity(size);
+	Planes current(size), next(size);
+	for (unsigned int p=0; p<size; ++p) {
+		const unsigned int i = p%width, j = p/width;
+		glm::vec3 n = aovs.normal.getPixel(i, j);
+		const float length = glm::length(n);
+		n = (length > 0.0f) ? n/length : glm::vec3(0.0f, 0.0f, 1.0f); //< All background pixels face the same way
+		nx[p] = n.x;
+		ny[p] = n.y;
+		nz[p] = n.z;
+		depth[p] = std::min(aovs.depth[p], 1e20f);
+
+		//Features of pixels that see several surfaces, at edges and out of focus, are as noisy as the color
+		purity[p] = std::abs(2.0f*aovs.coverage[p] - 1.0f);
+
+		const glm::vec3 a = aovs.albedo.getPixel(i, j);
+		ar[p] = a.r;
+		ag[p] = a.g;
+		ab[p] = a.b;
+
+		current.r[p] = color[3*p];
+		current.g[p] = color[3*p+1];
+		current.b[p] = color[3*p+2];
+		current.variance[p] = aovs.variance[p];
+	}
+
+	std::vector<float> lum(size), sigma(size);
+	Guide guide;
+	guide.nx = &nx[0];
+	guide.ny = &ny[0];
+	guide.nz = &nz[0];
+	guide.depth = &depth[0];
+	guide.ar = &ar[0];
+	guide.ag = &ag[0];
+	guide.ab = &ab[0];
+	guide.purity = &purity[0];
+	guide.id = &aovs.effect_id[0];
+	guide.lum = &lum[0];
+	guide.sigma = &sigma[0];
+	guide.normal_power = normal_power;
+	guide.inv_sigma_albedo2 = 1.0f/(sigma_albedo*sigma_albedo);
+
+	for (unsigned int iteration=0; iteration<iterations; ++iteration) {
+		const int step = 1 << iteration;
+
+		//The luminance may differ by sigma_luminance standard deviations of its noise,
+		//from the variance blurred over 3x3 pixels, as the estimate of a single pixel is noisy itself
+		for (unsigned int p=0; p<size; ++p) {
+			lum[p] = luminance(current.r[p], current.g[p], current.b[p]);
+		}
+#pragma omp parallel for
+		for (int j=0; j<height; ++j) {
+			for (int i=0; i<width; ++i) {
+				float sum = 0.0f, sum_w = 0.0f;
+				for (int dy=-1; dy<=1; ++dy) {
+					for (int dx=-1; dx<=1; ++dx) {
+						const int x = i+dx, y = j+dy;
+						if (x < 0 || x >= width || y < 0 || y >= height) continue;
+						const float w = (dx == 0 ? 0.5f : 0.25f)*(dy == 0 ? 0.5f : 0.25f);
+						sum += w*current.variance[x+y*width];
+						sum_w += w;
+					}
+				}
+				sigma[i+j*width] = sigma_luminance*std::sqrt(std::max(sum/sum_w, 0.0f)) + 1e-4f;
+			}
+		}
+
+#pragma omp parallel for
+		for (int j=0; j<height; ++j) {
+			const int row = j*width;
+			std::vector<float> sr(width), sg(width), sb(width), sv(width), sw(width);
+
+			//The center tap always counts fully, so the weights never sum to zero
+			const float w_center = kernel[0]*kernel[0];
+			for (int i=0; i<width; ++i) {
+				const int p = row+i;
+				sr[i] = w_center*current.r[p];
+				sg[i] = w_center*current.g[p];
+				sb[i] = w_center*current.b[p];
+				sv[i] = w_center*w_center*current.variance[p];
+				sw[i] = w_center;
+			}
+
+			//One tap at a time for a whole row, four pixels at a time
+			for (int dy=-2; dy<=2; ++dy) {
+				const int y = j+dy*step;
+				if (y < 0 || y >= height) continue;
+				for (int dx=-2; dx<=2; ++dx) {
+					if (dx == 0 && dy == 0) continue;
+					const int offset = (y-j)*width + dx*step;
+					const int i_begin = std::max(0, -dx*step);
+					const int i_end = std::min(width, width-dx*step);
+					const float w_kernel = kernel[std::abs(dx)]*kernel[std::abs(dy)];
+					Guide tap = guide;
+					tap.inv_distance = 1.0f/(sigma_depth*step*std::sqrt(static_cast<float>(dx*dx + dy*dy)));
+
+					int i = i_begin;
+					for (; i+4<=i_end; i+=4) {
+						const int p = row+i;
+						const int q = p+offset;
+						const __m128 w = _mm_mul_ps(tap.weight(p, q), _mm_set1_ps(w_kernel));
+						_mm_storeu_ps(&sr[i], _mm_add_ps(_mm_loadu_ps(&sr[i]), _mm_mul_ps(w, _mm_loadu_ps(&current.r[q]))));
+						_mm_storeu_ps(&sg[i], _mm_add_ps(_mm_loadu_ps(&sg[i]), _mm_mul_ps(w, _mm_loadu_ps(&current.g[q]))));
+						_mm_storeu_ps(&sb[i], _mm_add_ps(_mm_loadu_ps(&sb[i]), _mm_mul_ps(w, _mm_loadu_ps(&current.b[q]))));
+						_mm_storeu_ps(&sv[i], _mm_add_ps(_mm_loadu_ps(&sv[i]), _mm_mul_ps(_mm_mul_ps(w, w), _mm_loadu_ps(&current.variance[q]))));
+						_mm_storeu_ps(&sw[i], _mm_add_ps(_mm_loadu_ps(&sw[i]), w));
+					}
+					for (; i<i_end; ++i) {
+						const int p = row+i;
+						const int q = p+offset;
+						const float w = w_kernel*tap.weight1(p, q);
+						sr[i] += w*current.r[q];
+						sg[i] += w*current.g[q];
+						sb[i] += w*current.b[q];
+						sv[i] += w*w*current.variance[q];
+						sw[i] += w;
+					}
+				}
+			}
+
+			for (int i=0; i<width; ++i) {
+				const int p = row+i;
+				const float inv_w = 1.0f/sw[i];
+				next.r[p] = sr[i]*inv_w;
+				next.g[p] = sg[i]*inv_w;
+				next.b[p] = sb[i]*inv_w;
+				next.variance[p] = sv[i]*inv_w*inv_w;
+			}
+		}
+		std::swap(current, next);
+	}
+
+	for (unsigned int p=0; p<size; ++p) {
+		image.setPixel(p%width, p/width, glm::vec3(current.r[p], current.g[p], current.b[p]));
+	}
+}
@@ -0,0 +1,167 @@
+#include "DepthBlur.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	const float pi = 3.14159265f;
+	const float golden_angle = 2.39996323f; //< Turn between two taps of the spiral, pi*(3-sqrt(5))
+	const int tile_size = 16;
+	const float depth_tolerance = 0.02f; //< Relative difference in depth at which a pixel counts as in front
+
+	/**
+	  * Prefix sums of the color, so that the average over any rectangle takes
+	  * four lookups. In double, as the sums of large images lose too many bits in float.
+	  */
+	class SummedAreaTable {
+	public:
+		SummedAreaTable(const std::vector<float>& color, int width, int height) {
+			this->width = width;
+			sums.resize(3*(width+1)*(height+1), 0.0);
+			for (int j=0; j<height; ++j) {
+				double row[3] = { 0.0, 0.0, 0.0 };
+				for (int i=0; i<width; ++i) {
+					for (int c=0; c<3; ++c) {
+						row[c] += color[3*(i+j*width)+c];
+						sums[index(i+1, j+1)+c] = sums[index(i+1, j)+c] + row[c];
+					}
+				}
+			}
+		}
+
+		/**
+		  * Returns the average color of the pixels [x0, x1) x [y0, y1)
+		  */
+		inline glm::vec3 average(int x0, int y0, int x1, int y1) const {
+			const size_t a = index(x0, y0), b = index(x1, y0), c = index(x0, y1), d = index(x1, y1);
+			const double scale = 1.0/((x1-x0)*(y1-y0));
+			return glm::vec3(static_cast<float>((sums[d]   - sums[b]   - sums[c]   + sums[a]  )*scale),
+			                 static_cast<float>((sums[d+1] - sums[b+1] - sums[c+1] + sums[a+1])*scale),
+			                 static_cast<float>((sums[d+2] - sums[b+2] - sums[c+2] + sums[a+2])*scale));
+		}
+
+	private:
+		inline size_t index(int i, int j) const { return 3*(i + static_cast<size_t>(j)*(width+1)); }
+
+		std::vector<double> sums;
+		int width;
+	};
+
+	/**
+	  * Returns the number of pixels within a circle of confusion, over which a pixel spreads its color
+	  */
+	inline float area(float radius) {
+		return std::max(pi*radius*radius, 1.0f);
+	}
+}
+
+DepthBlur::DepthBlur() {
+	max_taps = 96;
+	max_radius = 64.0f;
+}
+
+void DepthBlur::apply(FrameBuffer& image, const std::vector<float>& depth, const std::vector<float>& coc) {
+	const int width = static_cast<int>(image.getWidth());
+	const int height = static_cast<int>(image.getHeight());
+	const std::vector<float> color = image.getData(); //< A copy, the image is overwritten
+
+	//Every pixel covers at least itself
+	std::vector<float> radius(width*height);
+	for (unsigned int p=0; p<radius.size(); ++p) {
+		radius[p] = std::min(std::max(coc[p], 0.5f), max_radius);
+	}
+
+	//The largest circle in every tile, and from that the largest circle that reaches into every tile
+	const int tiles_x = (width+tile_size-1)/tile_size;
+	const int tiles_y = (height+tile_size-1)/tile_size;
+	std::vector<float> tile_max(tiles_x*tiles_y, 0.5f), reach(tiles_x*tiles_y, 0.5f);
+	for (int j=0; j<height; ++j) {
+		for (int i=0; i<width; ++i) {
+			float& t = tile_max[i/tile_size + (j/tile_size)*tiles_x];
+			t = std::max(t, radius[i+j*width]);
+		}
+	}
+	const int range = static_cast<int>(std::ceil(max_radius/tile_size))+1;
+	for (int ty=0; ty<tiles_y; ++ty) {
+		for (int tx=0; tx<tiles_x; ++tx) {
+			float& r = reach[tx + ty*tiles_x];
+			for (int y=std::max(ty-range, 0); y<=std::min(ty+range, tiles_y-1); ++y) {
+				for (int x=std::max(tx-range, 0); x<=std::min(tx+range, tiles_x-1); ++x) {
+					//Distance between the closest pixels of the two tiles
+					const float gap_x = static_cast<float>(std::max(std::abs(x-tx)-1, 0)*tile_size);
+					const float gap_y = static_cast<float>(std::max(std::abs(y-ty)-1, 0)*tile_size);
+					const float t = tile_max[x + y*tiles_x];
+					if (gap_x*gap_x + gap_y*gap_y <= t*t) r = std::max(r, t);
+				}
+			}
+		}
+	}
+
+	SummedAreaTable table(color, width, height);
+	const float turn_cos = std::cos(golden_angle), turn_sin = std::sin(golden_angle);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int j=0; j<height; ++j) {
+		for (int i=0; i<width; ++i) {
+			const int p = i+j*width;
+			const float r_max = reach[i/tile_size + (j/tile_size)*tiles_x];
+
+			//Nothing around is blurred enough to reach beyond its own pixel
+			if (r_max <= 0.5f) continue;
+
+			//Sparse taps read the average color of the part of the circle they stand for
+			const unsigned int taps = std::min(max_taps, static_cast<unsigned int>(std::ceil(pi*r_max*r_max)));
+			const float tap_area = pi*r_max*r_max/taps;
+			const int side = std::max(static_cast<int>(std::sqrt(tap_area) + 0.5f), 1);
+
+			//The pixel itself, with its share of its own circle
+			const float r_p = radius[p];
+			const glm::vec3 color_p(color[3*p], color[3*p+1], color[3*p+2]);
+			glm::vec3 near_sum(0.0f), far_sum = color_p/area(r_p);
+			float near_w = 0.0f, far_w = 1.0f/area(r_p);
+
+			float dir_x = 1.0f, dir_y = 0.0f;
+			for (unsigned int k=0; k<taps; ++k) {
+				const float r = r_max*std::sqrt((k+0.5f)/taps);
+				const int x = i + static_cast<int>(std::floor(r*dir_x + 0.5f));
+				const int y = j + static_cast<int>(std::floor(r*dir_y + 0.5f));
+				const float next_x = dir_x*turn_cos - dir_y*turn_sin;
+				dir_y = dir_x*turn_sin + dir_y*turn_cos;
+				dir_x = next_x;
+				if (x < 0 || x >= width || y < 0 || y >= height) continue;
+				const int q = x+y*width;
+				if (q == p) continue;
+
+				//A pixel behind this one is hidden by it, beyond the circle of this pixel
+				const bool near = depth[q] < depth[p]*(1.0f-depth_tolerance);
+				const float c = near ? radius[q] : std::min(radius[q], r_p);
+				const float coverage = std::min(std::max(c - r + 0.5f, 0.0f), 1.0f);
+				if (coverage <= 0.0f) continue;
+
+				const float w = tap_area*coverage/area(c);
+				glm::vec3 color_q;
+				if (side > 1) {
+					const int x0 = std::max(x - side/2, 0), y0 = std::max(y - side/2, 0);
+					color_q = table.average(x0, y0, std::min(x0+side, width), std::min(y0+side, height));
+				}
+				else {
+					color_q = glm::vec3(color[3*q], color[3*q+1], color[3*q+2]);
+				}
+
+				if (near) {
+					near_sum += w*color_q;
+					near_w += w;
+				}
+				else {
+					far_sum += w*color_q;
+					far_w += w;
+				}
+			}
+
+			//The near layer covers the pixel as far as its circles add up to a whole pixel
+			const float alpha = std::min(near_w, 1.0f);
+			const glm::vec3 near_color = (near_w > 0.0f) ? near_sum/near_w : glm::vec3(0.0f);
+			image.setPixel(i, j, alpha*near_color + (1.0f-alpha)*far_sum/far_w);
+		}
+	}
+}
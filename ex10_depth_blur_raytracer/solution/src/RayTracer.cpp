@@ -4,12 +4,17 @@
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <cmath>
+#include <map>
+#include <algorithm>
 #include <sys/stat.h>
 
 #include <IL/il.h>
 #include <IL/ilu.h>
 
 #include "CubeMap.hpp"
+#include "SceneObjectEffect.hpp"
+#include "Timer.h"
 
 RayTracer::RayTracer(unsigned int width, unsigned int height) {
 	const glm::vec3 camera_position(0.0f, 0.0f, 10.0f);
@@ -22,21 +27,57 @@ RayTracer::RayTracer(unsigned int width, unsigned int height) {
 	screen.right = aspect;
 	screen.left = -aspect;
 	
+	//Scrambled Sobol converges with far fewer samples than random sampling
+	sampler_type = Sampler::SAMPLER_SOBOL;
+	samples = 64;
+	seed = 0;
+	denoising = false;
+	depth_of_field = DEPTH_OF_FIELD_LENS;
+	aperture = 0.25f;
+	focus_distance = 7.0f;
+	static_dispatch = true;
+	saved_index = -1;
+	
 	//Initialize state
 	state.reset(new RayTracerState(camera_position));
 	
 	//Initialize IL and ILU
 	ilInit();
 	iluInit();
-
-	srand(time(NULL));
 }
 
 void RayTracer::addSceneObject(std::shared_ptr<SceneObject>& o) {
 	state->getScene().push_back(o);
 }
 
+void RayTracer::setAOVs(bool enable) {
+	if (enable) {
+		if (!aovs) aovs.reset(new AOVBuffers(fb->getWidth(), fb->getHeight()));
+	}
+	else {
+		aovs.reset();
+		denoising = false;
+		if (depth_of_field == DEPTH_OF_FIELD_POST) depth_of_field = DEPTH_OF_FIELD_LENS;
+	}
+}
+
 void RayTracer::render() {
+	state->prepare(static_dispatch);
+
+	//Number the effects in the scene for the effect id buffer, objects without one get their own
+	std::map<const void*, unsigned int> effect_ids;
+	if (aovs) {
+		for (unsigned int k=0; k<state->getScene().size(); ++k) {
+			SceneObject* object = state->getScene().at(k).get();
+			const void* key = object->getEffect() ? static_cast<const void*>(object->getEffect()) : object;
+			if (effect_ids.find(key) == effect_ids.end()) {
+				unsigned int id = static_cast<unsigned int>(effect_ids.size())+1;
+				effect_ids[key] = id;
+			}
+		}
+	}
+	const glm::vec3 view_direction(0.0f, 0.0f, -1.0f);
+
 	//For every pixel, ray-trace using multiple CPUs
 #ifdef _OPENMP
 #pragma omp parallel for
@@ -46,40 +87,46 @@ void RayTracer::render() {
 #endif
 		for (unsigned int i=0; i<fb->getWidth(); ++i) {
 			glm::vec3 out_color(0.0, 0.0, 0.0);
-			float t = std::numeric_limits<float>::max();
-			int rays = 1000;
-			float x, y, z;
-
-			// "Flipped" ray definition Create the ray using the view screen definition	
-			x = 0.5*(screen.right - i*(screen.right-screen.left)/static_cast<float>(fb->getWidth()));
-			y = 0.5*(screen.top - j*(screen.top-screen.bottom)/static_cast<float>(fb->getHeight()));
-			z = 1.0f;
-			
-			//Find the virtual screen position at the z=1 plane
-			glm::vec3 virtual_screen_pixel_pos = glm::vec3(x, y, z);
+
+			//The ray leaves the lens at twice the offset of the sample on the apperture, see virtual_lens_ray_pos
+			const float rad = (depth_of_field == DEPTH_OF_FIELD_LENS) ? 0.5f*aperture : 0.0f;
+			Sampler sampler(sampler_type, seed);
+			sampler.startPixel(i, j);
 
 			//Set the center of the apperture at the z=0.5 plane
 			glm::vec3 aperture_center = glm::vec3(0, 0, 0.5);
 
-			//Find the direction of the pinhole ray
-			glm::vec3 pinhole_direction = (aperture_center - virtual_screen_pixel_pos) * 2.0f;
-
-			//Find the focus point
-			glm::vec3 focus_point = 7.0f * pinhole_direction;
-
-			//Create a lot of random rays
-			for (int k=0; k<rays; ++k) {
-				const float rad = 0.125;
-				//Generate a random point that is within the apperture
-				float x_rand = 2 * rad * rand() / static_cast<float>(RAND_MAX) - rad;
-				float y_rand = 2 * rad * rand() / static_cast<float>(RAND_MAX) - rad;
-				while (x_rand * x_rand + y_rand*y_rand > rad*rad) {
-					x_rand = 2 * rad * rand() / static_cast<float>(RAND_MAX) - rad;
-					y_rand = 2 * rad * rand() / static_cast<float>(RAND_MAX) - rad;
-				}
+			//Features of the first hits, and the running mean and squared deviation of the luminance
+			glm::vec3 normal_sum(0.0f), albedo_sum(0.0f);
+			float depth_sum = 0.0f;
+			unsigned int hits = 0;
+			unsigned int effect_id = 0, effect_samples = 0;
+			float luminance_mean = 0.0f, luminance_m2 = 0.0f;
+
+			for (unsigned int k=0; k<samples; ++k) {
+				//Jitter the sample position within the pixel for antialiasing
+				glm::vec2 pixel_offset = sampler.get2D(k, 0) - glm::vec2(0.5f);
+				float x, y, z;
+
+				// "Flipped" ray definition Create the ray using the view screen definition	
+				x = 0.5*(screen.right - (i+pixel_offset.x)*(screen.right-screen.left)/static_cast<float>(fb->getWidth()));
+				y = 0.5*(screen.top - (j+pixel_offset.y)*(screen.top-screen.bottom)/static_cast<float>(fb->getHeight()));
+				z = 1.0f;
+			
+				//Find the virtual screen position at the z=1 plane
+				glm::vec3 virtual_screen_pixel_pos = glm::vec3(x, y, z);
+
+				//Find the direction of the pinhole ray
+				glm::vec3 pinhole_direction = (aperture_center - virtual_screen_pixel_pos) * 2.0f;
+
+				//Find the focus point
+				glm::vec3 focus_point = focus_distance * pinhole_direction;
+
+				//Map the sample to a point within the apperture
+				glm::vec2 disk = rad*Sampler::squareToDisk(sampler.get2D(k, 1));
 				
 				//Find the offset from the apperture center to the random point
-				glm::vec3 random_vec = glm::vec3(x_rand, y_rand, 0.0f);
+				glm::vec3 random_vec = glm::vec3(disk.x, disk.y, 0.0f);
 
 				//Find the random point on the apperture
 				glm::vec3 aperture_random_point = aperture_center + random_vec;
@@ -97,19 +144,111 @@ void RayTracer::render() {
 				Ray r = Ray(state->getCamPos() + virtual_lens_ray_pos, direction);
 
 				//Add the color from the ray-tracing to the pixel color
-				out_color += state->rayTrace(r);
+				RayTracerState::Hit hit;
+				glm::vec3 color = state->rayTrace(r, aovs ? &hit : NULL);
+				out_color += color;
+
+				if (aovs) {
+					unsigned int sample_id = 0;
+					if (hit.object) {
+						SceneObjectEffect* effect = hit.object->getEffect();
+						glm::vec3 p = r.getOrigin() + hit.t*r.getDirection();
+						normal_sum += hit.normal;
+						albedo_sum += effect ? effect->getAlbedo() : glm::vec3(1.0f);
+						depth_sum += glm::dot(p - state->getCamPos(), view_direction);
+						++hits;
+						sample_id = effect_ids.find(effect ? static_cast<const void*>(effect) : hit.object)->second;
+					}
+					else {
+						albedo_sum += glm::vec3(1.0f);
+					}
+					if (k == 0) effect_id = sample_id;
+					if (sample_id == effect_id) ++effect_samples;
+
+					//Welford's update, numerically stable for many samples
+					float luminance = 0.2126f*color.r + 0.7152f*color.g + 0.0722f*color.b;
+					float delta = luminance - luminance_mean;
+					luminance_mean += delta/(k+1);
+					luminance_m2 += delta*(luminance - luminance_mean);
+				}
 			}
 			//Find average ray color
-			out_color /= static_cast<float>(rays);
+			out_color /= static_cast<float>(samples);
 
 			//Set output color
 			fb->setPixel(i, j, out_color);
+
+			if (aovs) {
+				const unsigned int index = i+j*fb->getWidth();
+				aovs->normal.setPixel(i, j, (hits > 0) ? glm::normalize(normal_sum) : glm::vec3(0.0f));
+				aovs->albedo.setPixel(i, j, albedo_sum/static_cast<float>(samples));
+				aovs->depth[index] = (hits > 0) ? depth_sum/hits : std::numeric_limits<float>::infinity();
+				aovs->effect_id[index] = effect_id;
+				aovs->coverage[index] = effect_samples/static_cast<float>(samples);
+				aovs->variance[index] = (samples > 1) ? luminance_m2/((samples-1)*static_cast<float>(samples)) : 0.0f;
+			}
 		}
 		std::cout << "Line " << j << " done (" << 100*j/static_cast<float>(fb->getHeight()) << ")%" << std::endl;
 	}
+
+	if (denoising) {
+		Timer t;
+		denoiser.denoise(*fb, *aovs);
+		std::cout << "Denoised in " << t.elapsed() << " seconds" << std::endl;
+	}
+
+	if (depth_of_field == DEPTH_OF_FIELD_POST) {
+		Timer t;
+		std::vector<float> coc(aovs->depth.size());
+		for (unsigned int k=0; k<coc.size(); ++k) {
+			coc[k] = getCircleOfConfusion(aovs->depth[k]);
+		}
+		depth_blur.apply(*fb, aovs->depth, coc);
+		std::cout << "Depth of field in " << t.elapsed() << " seconds" << std::endl;
+	}
+}
+
+float RayTracer::getCircleOfConfusion(float depth) const {
+	//A pixel at virtual screen position (x, y) looks along (x(1-2f), y(1-2f), -f) from (-x, -y) on the
+	//lens, f the focus distance, so a pixel spans (1+(2f-1)d/f)/height at depth d. The rays through a lens
+	//of radius a meet at the focus plane, and are a|1-d/f| apart from the pinhole ray at depth d.
+	const float height = static_cast<float>(fb->getHeight());
+	if (depth == std::numeric_limits<float>::infinity()) {
+		return aperture*height/(2.0f*focus_distance - 1.0f);
+	}
+	return aperture*height*std::abs(focus_distance - depth)/(focus_distance + (2.0f*focus_distance - 1.0f)*depth);
 }
 
 void RayTracer::save(std::string basename, std::string extension) {
+	saved_index = saveImage(*fb, basename, extension);
+}
+
+void RayTracer::saveAOVs(std::string basename, std::string extension) {
+	if (!aovs) throw std::runtime_error("Auxiliary buffers are not enabled");
+
+	const unsigned int width = aovs->getWidth(), height = aovs->getHeight();
+	FrameBuffer normal(width, height), depth(width, height);
+
+	//Normals mapped from [-1, 1] to [0, 1], depth scaled to the farthest surface, the background is white
+	float max_depth = 0.0f;
+	for (unsigned int k=0; k<aovs->depth.size(); ++k) {
+		if (aovs->depth[k] < std::numeric_limits<float>::infinity()) max_depth = std::max(max_depth, aovs->depth[k]);
+	}
+	for (unsigned int j=0; j<height; ++j) {
+		for (unsigned int i=0; i<width; ++i) {
+			const float d = aovs->depth[i+j*width];
+			normal.setPixel(i, j, 0.5f*aovs->normal.getPixel(i, j) + glm::vec3(0.5f));
+			depth.setPixel(i, j, glm::vec3((d < std::numeric_limits<float>::infinity()) ? d/max_depth : 1.0f));
+		}
+	}
+
+	//All buffers get the number of the frame they belong to
+	const int index = saveImage(normal, basename + "_normal", extension, saved_index);
+	saveImage(aovs->albedo, basename + "_albedo", extension, index);
+	saveImage(depth, basename + "_depth", extension, index);
+}
+
+int RayTracer::saveImage(FrameBuffer& image, std::string basename, std::string extension, int index) {
 	ILuint texid;
 	struct stat buffer;
 	int i;
@@ -121,19 +260,28 @@ void RayTracer::save(std::string basename, std::string extension) {
 	ilGenImages(1, &texid);
 	ilBindImage(texid);
 	//FIXME: Ugly const cast:( DevILs fault, unfortunately
-	ilTexImage(fb->getWidth(), fb->getHeight(), 1, 3, IL_RGB, IL_FLOAT, const_cast<float*>(fb->getData().data()));
+	ilTexImage(image.getWidth(), image.getHeight(), 1, 3, IL_RGB, IL_FLOAT, const_cast<float*>(image.getData().data()));
 
-	//Find a unique filename...
-	for (i=0; i<10000; ++i) {
-		filename.str("");
+	if (index >= 0) {
+		//A given number replaces what an earlier run left there
+		i = index;
 		filename << basename << std::setw(4) << std::setfill('0') << i << "." << extension;
-		if (stat(filename.str().c_str(), &buffer) != 0) break;
+		ilEnable(IL_FILE_OVERWRITE);
 	}
+	else {
+		//Find a unique filename...
+		for (i=0; i<10000; ++i) {
+			filename.str("");
+			filename << basename << std::setw(4) << std::setfill('0') << i << "." << extension;
+			if (stat(filename.str().c_str(), &buffer) != 0) break;
+		}
 
-	if (i == 10000) {
-		std::stringstream log;
-		log << "Unable to find unique filename for " << basename << "%d." << extension;
-		throw std::runtime_error(log.str());
+		if (i == 10000) {
+			std::stringstream log;
+			log << "Unable to find unique filename for " << basename << "%d." << extension;
+			throw std::runtime_error(log.str());
+		}
+		ilDisable(IL_FILE_OVERWRITE);
 	}
 
 	if (!ilSaveImage(filename.str().c_str())) {
@@ -146,4 +294,5 @@ void RayTracer::save(std::string basename, std::string extension) {
 	}
 
 	ilDeleteImages(1, &texid);
+	return i;
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "StaticScene.h"
+
+#include <map>
+#include <typeinfo>
+
+#include "Sphere.hpp"
+#include "SceneObjectEffect.hpp"
+
+void StaticScene::build(const std::vector<std::shared_ptr<SceneObject> >& scene, bool closed) {
+	center_x.clear();
+	center_y.clear();
+	center_z.clear();
+	radius.clear();
+	sphere_effect.clear();
+	sphere_object.clear();
+	effects.clear();
+	fallback.clear();
+
+	//Effects shared by several spheres are copied once
+	std::map<const SceneObjectEffect*, unsigned int> effect_index;
+
+	for (unsigned int k=0; k<scene.size(); ++k) {
+		SceneObject* object = scene.at(k).get();
+		const SceneObjectEffect* effect = object->getEffect();
+
+		//Only the exact types, subclasses may override any of the virtual functions
+		const bool closed_effect = effect != NULL
+			&& (typeid(*effect) == typeid(ColorEffect) || typeid(*effect) == typeid(PhongEffect));
+		if (!closed || typeid(*object) != typeid(Sphere) || !closed_effect) {
+			fallback.push_back(object);
+			continue;
+		}
+
+		std::map<const SceneObjectEffect*, unsigned int>::iterator it = effect_index.find(effect);
+		if (it == effect_index.end()) {
+			Effect e;
+			if (typeid(*effect) == typeid(ColorEffect)) {
+				const ColorEffect* color = static_cast<const ColorEffect*>(effect);
+				e.type = EFFECT_COLOR;
+				e.color = color->getColor();
+			}
+			else {
+				const PhongEffect* phong = static_cast<const PhongEffect*>(effect);
+				e.type = EFFECT_PHONG;
+				e.light_pos = phong->getLightPosition();
+				e.light_diff = phong->getLightDiffuse();
+				e.light_spec = phong->getLightSpecular();
+			}
+			it = effect_index.insert(std::make_pair(effect, static_cast<unsigned int>(effects.size()))).first;
+			effects.push_back(e);
+		}
+
+		const Sphere* sphere = static_cast<const Sphere*>(object);
+		center_x.push_back(sphere->getCenter().x);
+		center_y.push_back(sphere->getCenter().y);
+		center_z.push_back(sphere->getCenter().z);
+		radius.push_back(sphere->getRadius());
+		sphere_effect.push_back(it->second);
+		sphere_object.push_back(object);
+	}
+}
@@ -18,6 +18,20 @@ int main(int argc, char *argv[]) {
 		RayTracer* rt;
 		Timer t;
 		rt = new RayTracer(800, 600);
+
+		//--denoise filters the image guided by the auxiliary buffers, --aovs saves those buffers too,
+		//--post-dof blurs a pinhole image by its depth instead of sampling the lens
+		bool save_aovs = false;
+		for (int k=1; k<argc; ++k) {
+			std::string arg = argv[k];
+			if (arg == "--denoise") rt->setDenoising(true);
+			else if (arg == "--aovs") save_aovs = true;
+			else if (arg == "--post-dof") {
+				rt->setDepthOfField(RayTracer::DEPTH_OF_FIELD_POST);
+				rt->setSampler(Sampler::SAMPLER_SOBOL, 4); //< Enough for antialiasing
+			}
+		}
+		if (save_aovs) rt->setAOVs(true);
 		
 		std::shared_ptr<SceneObjectEffect> color(new ColorEffect(glm::vec3(0.0, 1.0, 0.0)));
 		std::shared_ptr<SceneObjectEffect> phong(new PhongEffect(glm::vec3(0.0, 0.0, 10.0)));
@@ -34,6 +48,7 @@ int main(int argc, char *argv[]) {
 		double elapsed = t.elapsed();
 		std::cout << "Computed in " << elapsed << " seconds" <<  std::endl;
 		rt->save("test", "bmp"); //We want to write out bmp's to get proper bit-maps (jpeg encoding is lossy)
+		if (save_aovs) rt->saveAOVs("test", "bmp");
 
 		delete rt;
 	} catch (std::exception &e) {